@@ -11,12 +11,16 @@ win32* {
 HEADERS += \
     $$PWD/include/DS_Client.h \
     $$PWD/include/DS_Config.h \
+    $$PWD/include/DS_Context.h \
     $$PWD/include/DS_Events.h \
     $$PWD/include/DS_Joysticks.h \
     $$PWD/include/DS_Types.h \
     $$PWD/include/DS_Utils.h \
     $$PWD/include/LibDS.h \
     $$PWD/include/DS_Array.h \
+    $$PWD/include/DS_ByteSpan.h \
+    $$PWD/include/DS_LinkStats.h \
+    $$PWD/include/DS_PacketTemplate.h \
     $$PWD/include/DS_Socket.h \
     $$PWD/include/DS_Protocol.h \
     $$PWD/include/DS_DefaultProtocols.h \
@@ -31,9 +35,13 @@ SOURCES += \
     $$PWD/src/protocols/frc_2020.c \
     $$PWD/src/client.c \
     $$PWD/src/config.c \
+    $$PWD/src/context.c \
     $$PWD/src/events.c \
     $$PWD/src/init.c \
     $$PWD/src/joysticks.c \
+    $$PWD/src/link_stats.c \
+    $$PWD/src/loopback.c \
+    $$PWD/src/packet_template.c \
     $$PWD/src/protocols.c \
     $$PWD/src/socket.c \
     $$PWD/src/utils.c \
@@ -0,0 +1,10 @@
+#-------------------------------------------------------------------------------
+# LibDS benchmarks (build with "qmake benchmarks.pro && make")
+#-------------------------------------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    latency \
+    micro \
+    scale
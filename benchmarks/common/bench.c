@@ -0,0 +1,501 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bench.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <LibDS.h>
+
+#if defined _WIN32
+#   include <windows.h>
+#else
+#   include <sys/time.h>
+#   include <sys/resource.h>
+#endif
+
+#if defined BENCH_WRAP_MALLOC
+/*
+ * Heap allocations made by the process, counted by the wrappers below (the
+ * executable must be linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc)
+ */
+static unsigned long long allocations = 0;
+static unsigned long long allocated_bytes = 0;
+
+extern void *__real_malloc(size_t size);
+extern void *__real_calloc(size_t count, size_t size);
+extern void *__real_realloc(void *ptr, size_t size);
+
+/**
+ * Counts the allocation of the given \a size
+ */
+static void count_allocation(const size_t size)
+{
+   __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+   __atomic_add_fetch(&allocated_bytes, size, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+   count_allocation(size);
+   return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+   count_allocation(count * size);
+   return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+   count_allocation(size);
+   return __real_realloc(ptr, size);
+}
+#endif
+
+/**
+ * Sorts two doubles in ascending order (for \c qsort())
+ */
+static int compare_doubles(const void *a, const void *b)
+{
+   double x = *(const double *)a;
+   double y = *(const double *)b;
+   return (x > y) - (x < y);
+}
+
+/**
+ * Writes the separator before a new member of the current object/array,
+ * followed by its \a name (if any)
+ */
+static void json_member(BenchJson *json, const char *name)
+{
+   if (json->depth > 0)
+   {
+      if (!json->empty[json->depth - 1])
+         fputc(',', json->file);
+
+      json->empty[json->depth - 1] = 0;
+      fprintf(json->file, "\n%*s", json->depth * 2, "");
+   }
+
+   if (name)
+      fprintf(json->file, "\"%s\": ", name);
+}
+
+/**
+ * Opens a new object/array with the given \a name, which starts with the
+ * \a opening bracket and ends with the \a closing bracket
+ */
+static void json_open(BenchJson *json, const char *name, const char opening, const char closing)
+{
+   assert(json->depth < BENCH_JSON_MAX_DEPTH);
+
+   json_member(json, name);
+   fputc(opening, json->file);
+   json->empty[json->depth] = 1;
+   json->closing[json->depth] = closing;
+   ++json->depth;
+}
+
+/**
+ * Adds the given \a value to the \a samples
+ */
+void Bench_AddSample(BenchSamples *samples, const double value)
+{
+   assert(samples);
+
+   if (samples->count >= samples->capacity)
+   {
+      samples->capacity = samples->capacity ? samples->capacity * 2 : 256;
+      samples->values = (double *)realloc(samples->values, samples->capacity * sizeof(double));
+   }
+
+   samples->values[samples->count++] = value;
+   samples->sorted = 0;
+}
+
+/**
+ * Returns the given \a percent (from 0 to 100) of the \a samples, using the
+ * nearest-rank method, or \c 0 if there are no samples
+ */
+double Bench_Percentile(BenchSamples *samples, const double percent)
+{
+   assert(samples);
+
+   if (samples->count == 0)
+      return 0;
+
+   if (!samples->sorted)
+   {
+      qsort(samples->values, samples->count, sizeof(double), &compare_doubles);
+      samples->sorted = 1;
+   }
+
+   double rank = ceil(percent / 100 * samples->count);
+   unsigned int index = (rank < 1) ? 0 : (unsigned int)rank - 1;
+   return samples->values[DS_Min(index, samples->count - 1)];
+}
+
+/**
+ * Returns the average of the given \a samples
+ */
+double Bench_Mean(const BenchSamples *samples)
+{
+   assert(samples);
+
+   unsigned int i;
+   double sum = 0;
+   for (i = 0; i < samples->count; ++i)
+      sum += samples->values[i];
+
+   return samples->count ? sum / samples->count : 0;
+}
+
+/**
+ * De-allocates the values of the given \a samples
+ */
+void Bench_FreeSamples(BenchSamples *samples)
+{
+   assert(samples);
+
+   DS_FREE(samples->values);
+   memset(samples, 0, sizeof(BenchSamples));
+}
+
+/**
+ * Returns \c 1 if the heap allocations of the process are counted (see
+ * \c BENCH_WRAP_MALLOC)
+ */
+int Bench_CountsAllocations(void)
+{
+#if defined BENCH_WRAP_MALLOC
+   return 1;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * Writes the number of heap allocations made so far (by any thread) and
+ * the number of bytes that they requested, or zeros if the allocations are
+ * not counted. Reallocations are counted as new allocations.
+ */
+void Bench_GetAllocations(unsigned long long *count, unsigned long long *bytes)
+{
+   assert(count);
+   assert(bytes);
+
+#if defined BENCH_WRAP_MALLOC
+   *count = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+   *bytes = __atomic_load_n(&allocated_bytes, __ATOMIC_RELAXED);
+#else
+   *count = 0;
+   *bytes = 0;
+#endif
+}
+
+/**
+ * Fills the given \a options with 100 ms of warmup and 10 repetitions of
+ * 50 ms each
+ */
+void Bench_DefaultOptions(BenchOptions *options)
+{
+   assert(options);
+
+   options->warmup = 100;
+   options->repetitions = 10;
+   options->duration = 50;
+}
+
+/**
+ * Measures the given \a function, which is called with \a data:
+ *    - During the warmup, the function is called repeatedly to estimate
+ *      its cost (and to fill the caches)
+ *    - In each repetition, the function is called enough times to last
+ *      the configured duration, and the average time of each call is
+ *      added to the \a result
+ *
+ * The allocations made during the repetitions are divided by the number
+ * of measured calls.
+ */
+void Bench_Run(BenchResult *result, BenchFunction function, void *data, const BenchOptions *options)
+{
+   assert(result);
+   assert(options);
+   assert(function);
+
+   memset(result, 0, sizeof(BenchResult));
+
+   /* Warm up, and estimate the cost of a call */
+   uint64_t elapsed = 0;
+   uint64_t iterations = 0;
+   uint64_t start = DS_GetMonotonicTime();
+   uint64_t warmup = (uint64_t)DS_Max(options->warmup, 0) * 1000000ULL;
+   do
+   {
+      function(data);
+      ++iterations;
+      elapsed = DS_GetMonotonicTime() - start;
+   } while (elapsed < warmup);
+
+   /* Get the number of calls that fill a repetition */
+   uint64_t duration = (uint64_t)DS_Max(options->duration, 1) * 1000000ULL;
+   uint64_t batch = (uint64_t)((double)iterations * duration / DS_Max(elapsed, 1));
+   batch = DS_Max(batch, 1);
+
+   /* Run the repetitions */
+   int i;
+   uint64_t n;
+   unsigned long long count = 0;
+   unsigned long long bytes = 0;
+   for (i = 0; i < options->repetitions; ++i)
+   {
+      unsigned long long count_start, count_end;
+      unsigned long long bytes_start, bytes_end;
+
+      Bench_GetAllocations(&count_start, &bytes_start);
+      start = DS_GetMonotonicTime();
+      for (n = 0; n < batch; ++n)
+         function(data);
+      elapsed = DS_GetMonotonicTime() - start;
+      Bench_GetAllocations(&count_end, &bytes_end);
+
+      Bench_AddSample(&result->ns_per_op, (double)elapsed / batch);
+      count += count_end - count_start;
+      bytes += bytes_end - bytes_start;
+      result->operations += batch;
+   }
+
+   /* Calculate the allocations of each call */
+   result->allocations_per_op = -1;
+   result->bytes_per_op = -1;
+   if (Bench_CountsAllocations() && result->operations > 0)
+   {
+      result->allocations_per_op = (double)count / result->operations;
+      result->bytes_per_op = (double)bytes / result->operations;
+   }
+}
+
+/**
+ * Reads the resources used by the process so far
+ */
+void Bench_GetUsage(BenchUsage *usage)
+{
+   assert(usage);
+
+   memset(usage, 0, sizeof(BenchUsage));
+   usage->wall_time = DS_GetMonotonicTime();
+
+#if defined _WIN32
+   FILETIME creation, exit, kernel, user;
+   if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+   {
+      ULARGE_INTEGER k, u;
+      k.LowPart = kernel.dwLowDateTime;
+      k.HighPart = kernel.dwHighDateTime;
+      u.LowPart = user.dwLowDateTime;
+      u.HighPart = user.dwHighDateTime;
+      usage->cpu_time = (k.QuadPart + u.QuadPart) * 100;
+   }
+#else
+   struct rusage ru;
+   if (getrusage(RUSAGE_SELF, &ru) == 0)
+   {
+      usage->cpu_time = (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL
+                        + (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+      usage->voluntary_switches = ru.ru_nvcsw;
+      usage->involuntary_switches = ru.ru_nivcsw;
+      usage->max_rss = ru.ru_maxrss;
+   }
+#endif
+
+#if defined __linux__
+   /* Get the current RSS and thread count */
+   char line[128];
+   FILE *status = fopen("/proc/self/status", "r");
+   while (status && fgets(line, sizeof(line), status))
+   {
+      if (strncmp(line, "VmRSS:", 6) == 0)
+         usage->rss = atol(line + 6);
+      else if (strncmp(line, "Threads:", 8) == 0)
+         usage->threads = atoi(line + 8);
+   }
+
+   if (status)
+      fclose(status);
+#endif
+}
+
+/**
+ * Returns the CPU time (in milliseconds) that the process used for each
+ * second of wall time between \a start and \a end
+ */
+double Bench_CPUPerSecond(const BenchUsage *start, const BenchUsage *end)
+{
+   assert(start);
+   assert(end);
+
+   if (end->wall_time <= start->wall_time)
+      return 0;
+
+   double cpu = (double)(end->cpu_time - start->cpu_time) / 1e6;
+   double wall = (double)(end->wall_time - start->wall_time) / 1e9;
+   return cpu / wall;
+}
+
+/**
+ * Starts writing a JSON document (an object) into the given \a file
+ */
+void Bench_JsonOpen(BenchJson *json, FILE *file)
+{
+   assert(json);
+   assert(file);
+
+   memset(json, 0, sizeof(BenchJson));
+   json->file = file;
+   json_open(json, NULL, '{', '}');
+}
+
+/**
+ * Closes every open object/array of the JSON document
+ */
+void Bench_JsonClose(BenchJson *json)
+{
+   assert(json);
+
+   while (json->depth > 0)
+      Bench_JsonEnd(json);
+
+   fputc('\n', json->file);
+   fflush(json->file);
+}
+
+/**
+ * Opens an object member with the given \a name (\c NULL inside arrays)
+ */
+void Bench_JsonObject(BenchJson *json, const char *name)
+{
+   assert(json);
+   json_open(json, name, '{', '}');
+}
+
+/**
+ * Opens an array member with the given \a name (\c NULL inside arrays)
+ */
+void Bench_JsonArray(BenchJson *json, const char *name)
+{
+   assert(json);
+   json_open(json, name, '[', ']');
+}
+
+/**
+ * Closes the last object/array opened in the JSON document
+ */
+void Bench_JsonEnd(BenchJson *json)
+{
+   assert(json);
+   assert(json->depth > 0);
+
+   --json->depth;
+   if (!json->empty[json->depth])
+      fprintf(json->file, "\n%*s", json->depth * 2, "");
+
+   fputc(json->closing[json->depth], json->file);
+}
+
+/**
+ * Writes a string member (the \a value must not need escaping)
+ */
+void Bench_JsonString(BenchJson *json, const char *name, const char *value)
+{
+   assert(json);
+
+   json_member(json, name);
+   fprintf(json->file, "\"%s\"", value ? value : "");
+}
+
+/**
+ * Writes a number member (non-finite values are written as \c null)
+ */
+void Bench_JsonNumber(BenchJson *json, const char *name, const double value)
+{
+   assert(json);
+
+   json_member(json, name);
+   if (isfinite(value))
+      fprintf(json->file, "%.6g", value);
+   else
+      fputs("null", json->file);
+}
+
+/**
+ * Writes an integer member
+ */
+void Bench_JsonInteger(BenchJson *json, const char *name, const long long value)
+{
+   assert(json);
+
+   json_member(json, name);
+   fprintf(json->file, "%lld", value);
+}
+
+/**
+ * Writes an object with the count, timeouts, mean, min, p50, p99, p99.9
+ * and max of the given \a samples
+ */
+void Bench_JsonSamples(BenchJson *json, const char *name, BenchSamples *samples)
+{
+   assert(json);
+   assert(samples);
+
+   Bench_JsonObject(json, name);
+   Bench_JsonInteger(json, "count", samples->count);
+   Bench_JsonInteger(json, "timeouts", samples->timeouts);
+   Bench_JsonNumber(json, "mean", Bench_Mean(samples));
+   Bench_JsonNumber(json, "min", Bench_Percentile(samples, 0));
+   Bench_JsonNumber(json, "p50", Bench_Percentile(samples, 50));
+   Bench_JsonNumber(json, "p99", Bench_Percentile(samples, 99));
+   Bench_JsonNumber(json, "p99.9", Bench_Percentile(samples, 99.9));
+   Bench_JsonNumber(json, "max", Bench_Percentile(samples, 100));
+   Bench_JsonEnd(json);
+}
+
+/**
+ * Writes an object with the time per operation (see \c Bench_JsonSamples()),
+ * the number of measured operations and the allocations per operation
+ * (\c null if they are not counted)
+ */
+void Bench_JsonResult(BenchJson *json, const char *name, BenchResult *result)
+{
+   assert(json);
+   assert(result);
+
+   Bench_JsonObject(json, name);
+   Bench_JsonSamples(json, "ns_per_op", &result->ns_per_op);
+   Bench_JsonInteger(json, "operations", (long long)result->operations);
+   Bench_JsonNumber(json, "allocs_per_op", result->allocations_per_op >= 0 ? result->allocations_per_op : NAN);
+   Bench_JsonNumber(json, "bytes_per_op", result->bytes_per_op >= 0 ? result->bytes_per_op : NAN);
+   Bench_JsonEnd(json);
+}
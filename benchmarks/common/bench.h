@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_BENCH_H
+#define _LIB_DS_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Maximum nesting of the objects and arrays written by BenchJson
+ */
+#define BENCH_JSON_MAX_DEPTH 16
+
+/**
+ * A growing set of measurements (e.g. latencies), from which the
+ * percentiles are calculated
+ */
+typedef struct
+{
+   double *values; /**< Measured values */
+   unsigned int count; /**< Number of values in \a values */
+   unsigned int capacity; /**< Number of values that fit in \a values */
+   unsigned int timeouts; /**< Measurements that did not complete */
+   int sorted; /**< 1 if \a values is sorted */
+} BenchSamples;
+
+/**
+ * Resources used by the process up to a point in time
+ */
+typedef struct
+{
+   uint64_t wall_time; /**< Monotonic time (in nanoseconds) */
+   uint64_t cpu_time; /**< User + system CPU time (in nanoseconds) */
+   long voluntary_switches; /**< Context switches caused by blocking */
+   long involuntary_switches; /**< Context switches caused by preemption */
+   long max_rss; /**< Peak resident set size (in kilobytes) */
+   long rss; /**< Current resident set size (in kilobytes, 0 if unknown) */
+   int threads; /**< Threads of the process (0 if unknown) */
+} BenchUsage;
+
+/**
+ * A benchmarked operation, which is called with the \a data given to
+ * \c Bench_Run()
+ */
+typedef void (*BenchFunction)(void *data);
+
+/**
+ * Controls how \c Bench_Run() measures an operation
+ */
+typedef struct
+{
+   int warmup; /**< Time spent running the operation before measuring it (in milliseconds) */
+   int repetitions; /**< Number of measurements */
+   int duration; /**< Duration of each measurement (in milliseconds) */
+} BenchOptions;
+
+/**
+ * Cost of an operation measured by \c Bench_Run()
+ */
+typedef struct
+{
+   BenchSamples ns_per_op; /**< Nanoseconds per operation in each repetition */
+   unsigned long long operations; /**< Operations measured (in every repetition) */
+   double allocations_per_op; /**< Heap allocations per operation (negative if not counted) */
+   double bytes_per_op; /**< Allocated bytes per operation (negative if not counted) */
+} BenchResult;
+
+/**
+ * Writes a JSON document to a file, keeping track of the separators
+ */
+typedef struct
+{
+   FILE *file; /**< Output file */
+   int depth; /**< Number of open objects/arrays */
+   int empty[BENCH_JSON_MAX_DEPTH]; /**< 1 while the object/array at each depth has no members */
+   char closing[BENCH_JSON_MAX_DEPTH]; /**< Bracket that closes the object/array at each depth */
+} BenchJson;
+
+extern void Bench_AddSample(BenchSamples *samples, const double value);
+extern double Bench_Percentile(BenchSamples *samples, const double percent);
+extern double Bench_Mean(const BenchSamples *samples);
+extern void Bench_FreeSamples(BenchSamples *samples);
+
+extern int Bench_CountsAllocations(void);
+extern void Bench_GetAllocations(unsigned long long *count, unsigned long long *bytes);
+
+extern void Bench_DefaultOptions(BenchOptions *options);
+extern void Bench_Run(BenchResult *result, BenchFunction function, void *data, const BenchOptions *options);
+
+extern void Bench_GetUsage(BenchUsage *usage);
+extern double Bench_CPUPerSecond(const BenchUsage *start, const BenchUsage *end);
+
+extern void Bench_JsonOpen(BenchJson *json, FILE *file);
+extern void Bench_JsonClose(BenchJson *json);
+extern void Bench_JsonObject(BenchJson *json, const char *name);
+extern void Bench_JsonArray(BenchJson *json, const char *name);
+extern void Bench_JsonEnd(BenchJson *json);
+extern void Bench_JsonString(BenchJson *json, const char *name, const char *value);
+extern void Bench_JsonNumber(BenchJson *json, const char *name, const double value);
+extern void Bench_JsonInteger(BenchJson *json, const char *name, const long long value);
+extern void Bench_JsonSamples(BenchJson *json, const char *name, BenchSamples *samples);
+extern void Bench_JsonResult(BenchJson *json, const char *name, BenchResult *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,11 @@
+#-------------------------------------------------------------------------------
+# Shared benchmark utilities (samples, resource usage and JSON output)
+#-------------------------------------------------------------------------------
+
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/bench.h
+
+SOURCES += \
+    $$PWD/bench.c
@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the latency between the application and the robot, with the DS
+ * of this process talking to a simulated robot (in another thread):
+ *
+ *    - joystick_to_wire:   DS_SetJoystickAxis() -> robot receives the value
+ *    - disable_to_wire:    DS_SetRobotEnabled(0) -> robot receives the command
+ *    - reply_to_event:     robot sends a new voltage -> DS_WaitEvent() returns it
+ *    - netconsole_to_event: robot sends a message -> DS_WaitEvent() returns it
+ *
+ * The "wire" times are the receive timestamps of the robot socket, which are
+ * taken by the kernel when using the network transport. The results are
+ * written as JSON (in microseconds), together with the CPU time used by the
+ * process for each second of each measurement.
+ */
+
+#include <bench.h>
+#include <robot_sim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+ * Time given to the DS to connect with the robot
+ */
+#define CONNECT_TIMEOUT 5000
+
+/*
+ * Time after which a stimulus that did not reach its destination is
+ * counted as a timeout
+ */
+#define SAMPLE_TIMEOUT 1000
+
+/*
+ * Maximum random delay before each stimulus, so that the stimuli are not
+ * synchronized with the packets sent by the DS every 20 ms
+ */
+#define MAX_DELAY 25
+
+/**
+ * Options given in the command line
+ */
+typedef struct
+{
+   int protocol; /**< Protocol year (2015, 2016 or 2020) */
+   int samples; /**< Measurements of each latency */
+   int idle; /**< Duration of the idle measurement (in seconds) */
+   int loopback; /**< 1 to use the loopback transport instead of the network */
+   const char *output; /**< JSON output file (or \c NULL for the standard output) */
+} Options;
+
+/**
+ * The simulated robot, which is serviced by its own thread
+ */
+typedef struct
+{
+   RobotSim robot;
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t cond;
+   int running;
+} Robot;
+
+/**
+ * The measurements of a single latency
+ */
+typedef struct
+{
+   const char *name;
+   BenchSamples samples;
+   double cpu_per_second;
+} Measurement;
+
+/**
+ * Checks if the robot has received the value sent by the DS, and if so
+ * writes the time at which the value was received into \a time
+ */
+typedef int (*RobotCondition)(const RobotSim *robot, const float value, uint64_t *time);
+
+/**
+ * Prints the command line options of the benchmark
+ */
+static void usage(const char *name)
+{
+   fprintf(stderr, "Usage: %s [options]\n\n", name);
+   fprintf(stderr, "  --protocol YEAR    Protocol used by the DS and robot (2015, 2016 or 2020)\n");
+   fprintf(stderr, "  --samples N        Measurements of each latency (default: 200)\n");
+   fprintf(stderr, "  --idle SECONDS     Duration of the idle CPU measurement (default: 2)\n");
+   fprintf(stderr, "  --loopback         Use the in-process transport instead of the network\n");
+   fprintf(stderr, "  --output FILE      Write the JSON results into FILE\n");
+}
+
+/**
+ * Reads the command line options into the given \a options
+ *
+ * \returns \c 1 if the options are valid
+ */
+static int read_options(int argc, char **argv, Options *options)
+{
+   options->protocol = 2020;
+   options->samples = 200;
+   options->idle = 2;
+   options->loopback = 0;
+   options->output = NULL;
+
+   int i;
+   for (i = 1; i < argc; ++i)
+   {
+      const char *option = argv[i];
+
+      /* Options without a value */
+      if (strcmp(option, "--loopback") == 0)
+      {
+         options->loopback = 1;
+         continue;
+      }
+
+      /* The other options need a value */
+      if (i + 1 >= argc)
+         return 0;
+
+      const char *value = argv[++i];
+      if (strcmp(option, "--protocol") == 0)
+         options->protocol = atoi(value);
+      else if (strcmp(option, "--samples") == 0)
+         options->samples = atoi(value);
+      else if (strcmp(option, "--idle") == 0)
+         options->idle = atoi(value);
+      else if (strcmp(option, "--output") == 0)
+         options->output = value;
+      else
+         return 0;
+   }
+
+   return options->samples > 0 && options->idle >= 0
+          && (options->protocol == 2015 || options->protocol == 2016 || options->protocol == 2020);
+}
+
+/**
+ * Returns the given protocol
+ */
+static DS_Protocol get_protocol(const int year)
+{
+   if (year == 2015)
+      return DS_GetProtocolFRC_2015();
+   if (year == 2016)
+      return DS_GetProtocolFRC_2016();
+
+   return DS_GetProtocolFRC_2020();
+}
+
+/**
+ * Converts the time between \a start and \a end to microseconds
+ */
+static double to_us(const uint64_t start, const uint64_t end)
+{
+   return (end > start) ? (double)(end - start) / 1000 : 0;
+}
+
+/**
+ * Replies to the packets of the DS until the benchmark finishes
+ */
+static void *robot_thread(void *data)
+{
+   Robot *robot = (Robot *)data;
+
+   int running = 1;
+   while (running)
+   {
+      DS_SocketWait(&robot->robot.robot_socket, 50);
+
+      pthread_mutex_lock(&robot->lock);
+      RobotSim_Process(&robot->robot);
+      pthread_cond_broadcast(&robot->cond);
+      running = robot->running;
+      pthread_mutex_unlock(&robot->lock);
+   }
+
+   return NULL;
+}
+
+/**
+ * Waits until the given \a condition is met by the robot
+ *
+ * \returns the time reported by the \a condition, or \c 0 on timeout
+ */
+static uint64_t wait_robot(Robot *robot, RobotCondition condition, const float value)
+{
+   struct timespec deadline;
+   clock_gettime(CLOCK_REALTIME, &deadline);
+   deadline.tv_sec += SAMPLE_TIMEOUT / 1000;
+   deadline.tv_nsec += (long)(SAMPLE_TIMEOUT % 1000) * 1000000L;
+   if (deadline.tv_nsec >= 1000000000L)
+   {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+   }
+
+   int error = 0;
+   uint64_t time = 0;
+   pthread_mutex_lock(&robot->lock);
+   while (!condition(&robot->robot, value, &time) && !error)
+      error = pthread_cond_timedwait(&robot->cond, &robot->lock, &deadline);
+   pthread_mutex_unlock(&robot->lock);
+
+   return time;
+}
+
+/**
+ * Waits for an event of the given \a type, discarding the other events.
+ * NetConsole events are only accepted if they contain the given \a text.
+ *
+ * \returns the time at which the event was obtained, or \c 0 on timeout
+ */
+static uint64_t wait_event(const DS_EventType type, const float voltage, const char *text)
+{
+   DS_Event event;
+   uint64_t deadline = DS_GetMonotonicTime() + (uint64_t)SAMPLE_TIMEOUT * 1000000ULL;
+
+   uint64_t time;
+   while ((time = DS_GetMonotonicTime()) < deadline)
+   {
+      int timeout = (int)((deadline - time + 999999ULL) / 1000000ULL);
+      if (!DS_WaitEvent(&event, timeout))
+         continue;
+
+      /* Get the time before checking the event */
+      time = DS_GetMonotonicTime();
+      int found = 0;
+      if (event.type == type && type == DS_ROBOT_VOLTAGE_CHANGED)
+         found = (event.robot.voltage > voltage - 0.05f && event.robot.voltage < voltage + 0.05f);
+
+      else if (event.type == DS_NETCONSOLE_NEW_MESSAGE)
+      {
+         found = (type == DS_NETCONSOLE_NEW_MESSAGE && strstr(event.netconsole.message, text) != NULL);
+         DS_FREE(event.netconsole.message);
+      }
+
+      if (found)
+         return time;
+   }
+
+   return 0;
+}
+
+/**
+ * Discards the pending events
+ */
+static void drain_events(void)
+{
+   DS_Event event;
+   while (DS_PollEvent(&event))
+   {
+      if (event.type == DS_NETCONSOLE_NEW_MESSAGE)
+         DS_FREE(event.netconsole.message);
+   }
+}
+
+/**
+ * Waits a random time, so that the stimuli do not follow the DS packets
+ */
+static void random_delay(void)
+{
+   drain_events();
+   DS_Sleep(rand() % MAX_DELAY);
+}
+
+/**
+ * Checks if the robot received the axis \a value
+ */
+static int axis_received(const RobotSim *robot, const float value, uint64_t *time)
+{
+   if (robot->joystick_count < 1 || robot->joysticks[0].num_axes < 1)
+      return 0;
+
+   float axis = robot->joysticks[0].axes[0];
+   if ((value > 0 && axis > 0) || (value < 0 && axis < 0))
+   {
+      *time = robot->joystick_time;
+      return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * Checks if the robot received the enabled state given by \a value
+ */
+static int enabled_received(const RobotSim *robot, const float value, uint64_t *time)
+{
+   int enabled = (robot->control & 0x04) != 0;
+   if (enabled == (value != 0))
+   {
+      *time = robot->control_time;
+      return 1;
+   }
+
+   return 0;
+}
+
+/**
+ * Measures the time between \c DS_SetJoystickAxis() and the reception of
+ * the new value by the robot (the DS only sends the joystick values while
+ * the robot is enabled)
+ */
+static void measure_joystick(Robot *robot, Measurement *m, const int samples)
+{
+   DS_SetRobotEnabled(1);
+   if (!wait_robot(robot, &enabled_received, 1))
+   {
+      m->samples.timeouts = (unsigned int)samples;
+      return;
+   }
+
+   int i;
+   for (i = 0; i < samples; ++i)
+   {
+      random_delay();
+
+      float value = (i % 2) ? -0.5f : 0.5f;
+      uint64_t start = DS_GetMonotonicTime();
+      DS_SetJoystickAxis(0, 0, value);
+
+      uint64_t end = wait_robot(robot, &axis_received, value);
+      if (end)
+         Bench_AddSample(&m->samples, to_us(start, end));
+      else
+         ++m->samples.timeouts;
+   }
+}
+
+/**
+ * Measures the time between \c DS_SetRobotEnabled(0) and the reception of
+ * the command by the robot (the robot is enabled before each measurement)
+ */
+static void measure_disable(Robot *robot, Measurement *m, const int samples)
+{
+   int i;
+   for (i = 0; i < samples; ++i)
+   {
+      DS_SetRobotEnabled(1);
+      if (!wait_robot(robot, &enabled_received, 1))
+      {
+         ++m->samples.timeouts;
+         continue;
+      }
+
+      random_delay();
+
+      uint64_t start = DS_GetMonotonicTime();
+      DS_SetRobotEnabled(0);
+
+      uint64_t end = wait_robot(robot, &enabled_received, 0);
+      if (end)
+         Bench_AddSample(&m->samples, to_us(start, end));
+      else
+         ++m->samples.timeouts;
+   }
+}
+
+/**
+ * Measures the time between the first robot reply with a new voltage and
+ * the delivery of the voltage event to the application
+ */
+static void measure_reply(Robot *robot, Measurement *m, const int samples)
+{
+   int i;
+   for (i = 0; i < samples; ++i)
+   {
+      random_delay();
+
+      float voltage = (i % 2) ? 12 : 11;
+      pthread_mutex_lock(&robot->lock);
+      robot->robot.config.voltage = voltage;
+      pthread_mutex_unlock(&robot->lock);
+
+      uint64_t end = wait_event(DS_ROBOT_VOLTAGE_CHANGED, voltage, NULL);
+
+      pthread_mutex_lock(&robot->lock);
+      uint64_t start = robot->robot.voltage_time;
+      pthread_mutex_unlock(&robot->lock);
+
+      if (end)
+         Bench_AddSample(&m->samples, to_us(start, end));
+      else
+         ++m->samples.timeouts;
+   }
+}
+
+/**
+ * Measures the time between the robot sending a NetConsole message and the
+ * delivery of the message event to the application
+ */
+static void measure_netconsole(Robot *robot, Measurement *m, const int samples)
+{
+   int i;
+   char text[64];
+   for (i = 0; i < samples; ++i)
+   {
+      random_delay();
+
+      int len = snprintf(text, sizeof(text), "LibDS benchmark %d\n", i);
+      uint64_t start = DS_GetMonotonicTime();
+      DS_SocketSendBytes(&robot->robot.netconsole_socket, text, (size_t)len);
+
+      text[len - 1] = '\0';
+      uint64_t end = wait_event(DS_NETCONSOLE_NEW_MESSAGE, 0, text);
+      if (end)
+         Bench_AddSample(&m->samples, to_us(start, end));
+      else
+         ++m->samples.timeouts;
+   }
+}
+
+/**
+ * Measures the CPU time used while the DS and the robot talk to each
+ * other, without any input from the application
+ */
+static double measure_idle(const int seconds)
+{
+   BenchUsage start, end;
+   Bench_GetUsage(&start);
+
+   uint64_t deadline = start.wall_time + (uint64_t)seconds * 1000000000ULL;
+   while (DS_GetMonotonicTime() < deadline)
+   {
+      DS_Event event;
+      if (DS_WaitEvent(&event, 100) && event.type == DS_NETCONSOLE_NEW_MESSAGE)
+         DS_FREE(event.netconsole.message);
+   }
+
+   Bench_GetUsage(&end);
+   return Bench_CPUPerSecond(&start, &end);
+}
+
+/**
+ * Writes the results of the benchmark as JSON
+ */
+static void write_results(FILE *file, const Options *options, Measurement *measurements, const int count,
+                          const double idle)
+{
+   int i;
+   BenchJson json;
+   Bench_JsonOpen(&json, file);
+   Bench_JsonString(&json, "benchmark", "latency");
+   Bench_JsonInteger(&json, "protocol", options->protocol);
+   Bench_JsonString(&json, "transport", options->loopback ? "loopback" : "network");
+   Bench_JsonString(&json, "unit", "us");
+
+   Bench_JsonObject(&json, "idle");
+   Bench_JsonInteger(&json, "duration_s", options->idle);
+   Bench_JsonNumber(&json, "cpu_ms_per_s", idle);
+   Bench_JsonEnd(&json);
+
+   Bench_JsonObject(&json, "results");
+   for (i = 0; i < count; ++i)
+   {
+      Bench_JsonObject(&json, measurements[i].name);
+      Bench_JsonSamples(&json, "latency", &measurements[i].samples);
+      Bench_JsonNumber(&json, "cpu_ms_per_s", measurements[i].cpu_per_second);
+      Bench_JsonEnd(&json);
+   }
+
+   Bench_JsonClose(&json);
+}
+
+/**
+ * Main entry point of the application
+ */
+int main(int argc, char **argv)
+{
+   /* Read the command line options */
+   Options options;
+   if (!read_options(argc, argv, &options))
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   /* Initialize LibDS and talk to the robot */
+   DS_Init();
+   DS_Protocol protocol = get_protocol(options.protocol);
+   if (options.loopback)
+   {
+      DS_SetTransport(DS_LoopbackTransport("ds"));
+      DS_SetCustomRobotAddress("robot");
+   }
+   else
+      DS_SetCustomRobotAddress("127.0.0.1");
+
+   DS_ConfigureProtocol(&protocol);
+   DS_JoysticksAdd(6, 1, 12);
+
+   /* Create the robot, it does not send NetConsole messages on its own */
+   Robot robot;
+   RobotSimConfig config;
+   RobotSim_DefaultConfig(&config);
+   config.protocol = options.protocol;
+   config.voltage = 12;
+   config.netconsole_rate = 0;
+   config.address = options.loopback ? "ds" : "127.0.0.1";
+   config.transport = options.loopback ? DS_LoopbackTransport("robot") : NULL;
+   RobotSim_Open(&robot.robot, &config);
+
+   robot.running = 1;
+   pthread_mutex_init(&robot.lock, NULL);
+   pthread_cond_init(&robot.cond, NULL);
+   pthread_create(&robot.thread, NULL, &robot_thread, &robot);
+
+   /* Wait until the DS sends joystick data to the robot */
+   int connected = 0;
+   uint64_t deadline = DS_GetMonotonicTime() + (uint64_t)CONNECT_TIMEOUT * 1000000ULL;
+   while (!connected && DS_GetMonotonicTime() < deadline)
+   {
+      DS_Sleep(10);
+      drain_events();
+
+      pthread_mutex_lock(&robot.lock);
+      connected = DS_GetRobotCommunications() && robot.robot.joystick_count > 0;
+      pthread_mutex_unlock(&robot.lock);
+   }
+
+   int status = EXIT_FAILURE;
+   if (connected)
+   {
+      /* Run the measurements */
+      int i;
+      Measurement measurements[] = {
+         {"joystick_to_wire", {0}, 0},
+         {"disable_to_wire", {0}, 0},
+         {"reply_to_event", {0}, 0},
+         {"netconsole_to_event", {0}, 0},
+      };
+
+      srand(1);
+      for (i = 0; i < 4; ++i)
+      {
+         BenchUsage start, end;
+         Bench_GetUsage(&start);
+
+         if (i == 0)
+            measure_joystick(&robot, &measurements[i], options.samples);
+         else if (i == 1)
+            measure_disable(&robot, &measurements[i], options.samples);
+         else if (i == 2)
+            measure_reply(&robot, &measurements[i], options.samples);
+         else
+            measure_netconsole(&robot, &measurements[i], options.samples);
+
+         Bench_GetUsage(&end);
+         measurements[i].cpu_per_second = Bench_CPUPerSecond(&start, &end);
+      }
+
+      double idle = measure_idle(options.idle);
+
+      /* Write the results */
+      FILE *file = options.output ? fopen(options.output, "w") : stdout;
+      if (file)
+      {
+         write_results(file, &options, measurements, 4, idle);
+         status = EXIT_SUCCESS;
+         if (file != stdout)
+            fclose(file);
+      }
+      else
+         fprintf(stderr, "Cannot write to %s\n", options.output);
+
+      for (i = 0; i < 4; ++i)
+         Bench_FreeSamples(&measurements[i].samples);
+   }
+   else
+      fprintf(stderr, "The DS did not connect to the robot\n");
+
+   /* Stop the robot */
+   pthread_mutex_lock(&robot.lock);
+   robot.running = 0;
+   pthread_mutex_unlock(&robot.lock);
+   pthread_join(robot.thread, NULL);
+   RobotSim_Close(&robot.robot);
+
+   pthread_mutex_destroy(&robot.lock);
+   pthread_cond_destroy(&robot.cond);
+   DS_Close();
+
+   return status;
+}
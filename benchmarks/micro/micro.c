@@ -0,0 +1,717 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the time and the heap allocations of the LibDS primitives that
+ * run on every packet: the DS_String, DS_Queue and DS_Array containers,
+ * DS_CRC32(), the joystick setters and the packet encoders/decoders of
+ * every protocol.
+ *
+ * The protocols are called directly (from this thread) on the default
+ * context, which never loads a protocol, so the event loop leaves it alone.
+ * The DS has six joysticks with 12 axes, one hat and 32 buttons, and the
+ * robot is enabled, so that the joystick values are encoded.
+ *
+ * With --check-allocations, the benchmarks are not run. Instead, every
+ * protocol sends robot and FMS packets through a UDP socket the way the
+ * event loop does, and the program fails if that allocates heap memory.
+ */
+
+#include <bench.h>
+#include <LibDS.h>
+#include <DS_Array.h>
+#include <DS_Queue.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Joystick load of the packet encoders
+ */
+#define JOYSTICK_COUNT 6
+#define JOYSTICK_AXES 12
+#define JOYSTICK_HATS 1
+#define JOYSTICK_BUTTONS 32
+
+/*
+ * Port used by the socket of the allocation check (which sends the packets
+ * to itself), and the packets sent before counting the allocations
+ */
+#define CHECK_PORT 51150
+#define CHECK_WARMUP_TICKS 100
+
+/**
+ * Options given in the command line
+ */
+typedef struct
+{
+   BenchOptions bench; /**< Warmup, repetitions and duration */
+   const char *filter; /**< Only run the benchmarks whose name contains this text */
+   const char *output; /**< JSON output file (or \c NULL for the standard output) */
+   int check_ticks; /**< Ticks of the allocation check (\c 0 to run the benchmarks) */
+} Options;
+
+/**
+ * Input of the container and CRC32 benchmarks
+ */
+typedef struct
+{
+   DS_String a;
+   DS_String b;
+   DS_Queue queue;
+   uint8_t item[64];
+   uint8_t block[1024];
+   unsigned int tick; /**< Changes the joystick values on every call */
+} Primitives;
+
+/**
+ * Input of the packet benchmarks of a protocol
+ */
+typedef struct
+{
+   const char *name; /**< Name of the protocol in the results */
+   DS_Protocol protocol; /**< Protocol under test */
+   DS_ByteSpan robot_packet; /**< Packet given to read_robot_packet() */
+   DS_ByteSpan fms_packet; /**< Packet given to read_fms_packet() */
+   uint8_t robot_data[1024]; /**< Storage of \a robot_packet */
+   uint8_t fms_data[32]; /**< Storage of \a fms_packet */
+   uint8_t buffer[DS_PACKET_BUFFER_SIZE]; /**< Output of the encode_* functions */
+} Codec;
+
+/**
+ * A benchmark and its input
+ */
+typedef struct
+{
+   const char *name;
+   BenchFunction function;
+   void *data;
+} Case;
+
+/*
+ * Container and CRC32 benchmarks
+ */
+
+static void string_new(void *data)
+{
+   (void)data;
+   DS_String string = DS_StrNew("roboRIO-3794-FRC.local");
+   DS_StrRmBuf(&string);
+}
+
+static void string_append(void *data)
+{
+   int i;
+   (void)data;
+   DS_String string = DS_StrNewLen(0);
+   for (i = 0; i < 256; ++i)
+      DS_StrAppend(&string, (uint8_t)i);
+
+   DS_StrRmBuf(&string);
+}
+
+static void string_append_bytes(void *data)
+{
+   Primitives *p = (Primitives *)data;
+   DS_String string = DS_StrNewLen(0);
+   DS_StrAppendBytes(&string, p->block, 64);
+   DS_StrAppendBytes(&string, p->block, sizeof(p->block));
+   DS_StrRmBuf(&string);
+}
+
+static void string_format(void *data)
+{
+   (void)data;
+   DS_String string = DS_StrFormat("Team %d: %s (%f V)", 3794, "Teleoperated", 12.5);
+   DS_StrRmBuf(&string);
+}
+
+static void string_to_char(void *data)
+{
+   Primitives *p = (Primitives *)data;
+   char *cstr = DS_StrToChar(&p->a);
+   DS_FREE(cstr);
+}
+
+static void string_compare(void *data)
+{
+   Primitives *p = (Primitives *)data;
+   DS_StrCompare(&p->a, &p->b);
+}
+
+static void queue_push_pop(void *data)
+{
+   Primitives *p = (Primitives *)data;
+   DS_QueuePush(&p->queue, p->item);
+   DS_QueuePop(&p->queue);
+}
+
+static void queue_fill_drain(void *data)
+{
+   int i;
+   Primitives *p = (Primitives *)data;
+   for (i = 0; i < 64; ++i)
+      DS_QueuePush(&p->queue, p->item);
+   for (i = 0; i < 64; ++i)
+      DS_QueuePop(&p->queue);
+}
+
+static void array_insert(void *data)
+{
+   int i;
+   (void)data;
+   DS_Array array;
+   DS_ArrayInit(&array, 8);
+
+   /* The array frees its elements, so only measure the array itself */
+   for (i = 0; i < 64; ++i)
+      DS_ArrayInsert(&array, NULL);
+
+   DS_ArrayFree(&array);
+}
+
+static void crc32_64(void *data)
+{
+   Primitives *p = (Primitives *)data;
+   DS_CRC32(p->block, 64);
+}
+
+static void crc32_1024(void *data)
+{
+   Primitives *p = (Primitives *)data;
+   DS_CRC32(p->block, sizeof(p->block));
+}
+
+static void crc32_stream(void *data)
+{
+   size_t i;
+   uint32_t crc = 0;
+   Primitives *p = (Primitives *)data;
+
+   /* Checksum the same 1024 bytes in chunks of 64 bytes */
+   for (i = 0; i < sizeof(p->block); i += 64)
+      crc = DS_CRC32Update(crc, p->block + i, 64);
+}
+
+/*
+ * Joystick benchmarks (they update all the values of the last joystick)
+ */
+
+static void joystick_set_elements(void *data)
+{
+   int j;
+   Primitives *p = (Primitives *)data;
+   int value = (int)(++p->tick & 1);
+
+   for (j = 0; j < JOYSTICK_AXES; ++j)
+      DS_SetJoystickAxis(JOYSTICK_COUNT - 1, j, (float)value / 2);
+   for (j = 0; j < JOYSTICK_HATS; ++j)
+      DS_SetJoystickHat(JOYSTICK_COUNT - 1, j, value * 90);
+   for (j = 0; j < JOYSTICK_BUTTONS; ++j)
+      DS_SetJoystickButton(JOYSTICK_COUNT - 1, j, value);
+}
+
+static void joystick_set_state(void *data)
+{
+   int j;
+   float axes[JOYSTICK_AXES];
+   int16_t hats[JOYSTICK_HATS];
+   Primitives *p = (Primitives *)data;
+   int value = (int)(++p->tick & 1);
+
+   for (j = 0; j < JOYSTICK_AXES; ++j)
+      axes[j] = (float)value / 2;
+   for (j = 0; j < JOYSTICK_HATS; ++j)
+      hats[j] = (int16_t)(value * 90);
+
+   DS_SetJoystickState(JOYSTICK_COUNT - 1, axes, value ? ~(uint64_t)0 : 0, hats);
+}
+
+/*
+ * Packet benchmarks
+ */
+
+static void create_robot_packet(void *data)
+{
+   DS_String packet = ((Codec *)data)->protocol.create_robot_packet();
+   DS_StrRmBuf(&packet);
+}
+
+static void create_fms_packet(void *data)
+{
+   DS_String packet = ((Codec *)data)->protocol.create_fms_packet();
+   DS_StrRmBuf(&packet);
+}
+
+static void create_radio_packet(void *data)
+{
+   DS_String packet = ((Codec *)data)->protocol.create_radio_packet();
+   DS_StrRmBuf(&packet);
+}
+
+static void encode_robot_packet(void *data)
+{
+   Codec *codec = (Codec *)data;
+   codec->protocol.encode_robot_packet(codec->buffer, sizeof(codec->buffer));
+}
+
+static void encode_fms_packet(void *data)
+{
+   Codec *codec = (Codec *)data;
+   codec->protocol.encode_fms_packet(codec->buffer, sizeof(codec->buffer));
+}
+
+static void read_robot_packet(void *data)
+{
+   Codec *codec = (Codec *)data;
+   codec->protocol.read_robot_packet(&codec->robot_packet);
+}
+
+static void read_fms_packet(void *data)
+{
+   Codec *codec = (Codec *)data;
+   codec->protocol.read_fms_packet(&codec->fms_packet);
+}
+
+/*
+ * Allocation check of the send path
+ */
+
+/**
+ * Sends a robot packet and an FMS packet of the given \a codec through the
+ * given \a socket, like \c send_robot_data() and \c send_fms_data() do in
+ * the event loop. A joystick value changes before every packet, so that
+ * the joystick cache encodes it again.
+ */
+static void send_packets(Codec *codec, DS_Socket *socket, Primitives *primitives)
+{
+   const DS_Protocol *p = &codec->protocol;
+   joystick_set_state(primitives);
+
+   if (p->encode_robot_packet)
+      DS_SocketSendBytes(socket, codec->buffer, p->encode_robot_packet(codec->buffer, sizeof(codec->buffer)));
+   else if (p->create_robot_packet)
+   {
+      DS_String data = p->create_robot_packet();
+      DS_SocketSend(socket, &data);
+      DS_StrRmBuf(&data);
+   }
+
+   if (p->encode_fms_packet)
+      DS_SocketSendBytes(socket, codec->buffer, p->encode_fms_packet(codec->buffer, sizeof(codec->buffer)));
+   else if (p->create_fms_packet)
+   {
+      DS_String data = p->create_fms_packet();
+      DS_SocketSend(socket, &data);
+      DS_StrRmBuf(&data);
+   }
+}
+
+/**
+ * Sends \a ticks robot and FMS packets with each of the given \a codecs
+ * (see \c send_packets()) and counts the heap allocations that they make.
+ * The packets are sent over UDP to the socket itself, which is read by
+ * the event loop of LibDS.
+ *
+ * \returns \c EXIT_SUCCESS if no protocol allocated memory while sending
+ */
+static int check_allocations(Codec *codecs, const int count, Primitives *primitives, const int ticks)
+{
+   /* The allocations are only counted when malloc() is wrapped */
+   if (!Bench_CountsAllocations())
+   {
+      fprintf(stderr, "Cannot check allocations: this build does not count them\n");
+      return EXIT_FAILURE;
+   }
+
+   /* Open the socket, and wait until its address is resolved */
+   int i;
+   DS_Socket *socket = DS_SocketEmpty();
+   socket->in_port = CHECK_PORT;
+   socket->out_port = CHECK_PORT;
+   socket->type = DS_SOCKET_UDP;
+   strcpy(socket->address, "127.0.0.1");
+   DS_SocketOpen(socket);
+
+   uint8_t byte = 0;
+   for (i = 0; i < 2000 && DS_SocketSendBytes(socket, &byte, 1) <= 0; ++i)
+      DS_Sleep(1);
+
+   if (i == 2000)
+   {
+      fprintf(stderr, "Cannot check allocations: the socket did not open\n");
+      DS_SocketClose(socket);
+      DS_FREE(socket);
+      return EXIT_FAILURE;
+   }
+
+   int status = EXIT_SUCCESS;
+   for (i = 0; i < count; ++i)
+   {
+      int n;
+      unsigned long long start_count, start_bytes, end_count, end_bytes;
+
+      /* Let the protocol build its templates and caches */
+      memset(DS_ProtocolData(), 0, DS_PROTOCOL_DATA_SIZE);
+      for (n = 0; n < CHECK_WARMUP_TICKS; ++n)
+         send_packets(&codecs[i], socket, primitives);
+
+      /* Count the allocations of the steady state */
+      Bench_GetAllocations(&start_count, &start_bytes);
+      for (n = 0; n < ticks; ++n)
+         send_packets(&codecs[i], socket, primitives);
+      Bench_GetAllocations(&end_count, &end_bytes);
+
+      int failed = (end_count != start_count);
+      fprintf(stderr, "%-36s %8.2f allocs/op %10.1f bytes/op %s\n", codecs[i].name,
+              (double)(end_count - start_count) / ticks, (double)(end_bytes - start_bytes) / ticks,
+              failed ? "FAIL" : "ok");
+
+      if (failed)
+         status = EXIT_FAILURE;
+   }
+
+   DS_SocketClose(socket);
+   DS_FREE(socket);
+   return status;
+}
+
+/**
+ * Prints the command line options of the benchmark
+ */
+static void usage(const char *name)
+{
+   fprintf(stderr, "Usage: %s [options]\n\n", name);
+   fprintf(stderr, "  --warmup MS        Time spent warming up each benchmark (default: 100)\n");
+   fprintf(stderr, "  --repetitions N    Measurements of each benchmark (default: 10)\n");
+   fprintf(stderr, "  --duration MS      Duration of each measurement (default: 50)\n");
+   fprintf(stderr, "  --filter TEXT      Only run the benchmarks whose name contains TEXT\n");
+   fprintf(stderr, "  --output FILE      Write the JSON results into FILE\n");
+   fprintf(stderr, "  --check-allocations N\n");
+   fprintf(stderr, "                     Send N packets with each protocol and fail if the send\n");
+   fprintf(stderr, "                     path allocates heap memory (instead of benchmarking)\n");
+}
+
+/**
+ * Reads the command line options into the given \a options
+ *
+ * \returns \c 1 if the options are valid
+ */
+static int read_options(int argc, char **argv, Options *options)
+{
+   Bench_DefaultOptions(&options->bench);
+   options->filter = NULL;
+   options->output = NULL;
+   options->check_ticks = 0;
+
+   int i;
+   for (i = 1; i + 1 < argc; i += 2)
+   {
+      const char *option = argv[i];
+      const char *value = argv[i + 1];
+
+      if (strcmp(option, "--warmup") == 0)
+         options->bench.warmup = atoi(value);
+      else if (strcmp(option, "--repetitions") == 0)
+         options->bench.repetitions = atoi(value);
+      else if (strcmp(option, "--duration") == 0)
+         options->bench.duration = atoi(value);
+      else if (strcmp(option, "--filter") == 0)
+         options->filter = value;
+      else if (strcmp(option, "--output") == 0)
+         options->output = value;
+      else if (strcmp(option, "--check-allocations") == 0)
+      {
+         options->check_ticks = atoi(value);
+         if (options->check_ticks <= 0)
+            return 0;
+      }
+      else
+         return 0;
+   }
+
+   /* An option is missing its value */
+   if (i < argc)
+      return 0;
+
+   return options->bench.warmup >= 0 && options->bench.repetitions > 0 && options->bench.duration > 0;
+}
+
+/**
+ * Writes the given \a value into \a out, in the byte order in which LibDS
+ * reads the floats of the extended robot tags
+ */
+static void write_float(uint8_t *out, const float value)
+{
+   memcpy(out, &value, sizeof(value));
+}
+
+/**
+ * Prepares the packets read by the benchmarks of the given \a codec
+ */
+static void init_codec(Codec *codec, const char *name, const DS_Protocol protocol, const int year)
+{
+   memset(codec, 0, sizeof(Codec));
+   codec->name = name;
+   codec->protocol = protocol;
+
+   uint8_t *robot = codec->robot_data;
+   uint8_t *fms = codec->fms_data;
+
+   /* cRIO status packet (12 V, not e-stopped) and FMS packet (enabled teleop, red 1) */
+   if (year == 2014)
+   {
+      robot[0] = 0x40;
+      robot[1] = 0x12;
+      codec->robot_packet = DS_SpanNew(robot, 1024);
+
+      fms[2] = 0x63;
+      fms[3] = 'R';
+      fms[4] = '1';
+      codec->fms_packet = DS_SpanNew(fms, 8);
+   }
+
+   /* roboRIO status packet (enabled, with code, 12.5 V and CPU info) and FMS
+    * packet (enabled teleop, red 1) */
+   else
+   {
+      int i;
+      robot[2] = 0x01;
+      robot[3] = 0x04;
+      robot[4] = 0x20;
+      robot[5] = 12;
+      robot[6] = 0x80;
+      robot[8] = 37;
+      robot[9] = 0x05;
+      write_float(robot + 10, 2);
+      for (i = 0; i < 2; ++i)
+      {
+         write_float(robot + 14 + (i * 16), 0);
+         write_float(robot + 18 + (i * 16), 0);
+         write_float(robot + 22 + (i * 16), 25);
+         write_float(robot + 26 + (i * 16), 75);
+      }
+      codec->robot_packet = DS_SpanNew(robot, 46);
+
+      fms[2] = 0x01;
+      fms[3] = 0x04;
+      codec->fms_packet = DS_SpanNew(fms, 22);
+   }
+}
+
+/**
+ * Registers the joysticks (with non-zero values) and enables the robot
+ */
+static void init_joysticks(void)
+{
+   int i, j;
+   for (i = 0; i < JOYSTICK_COUNT; ++i)
+   {
+      DS_JoysticksAdd(JOYSTICK_AXES, JOYSTICK_HATS, JOYSTICK_BUTTONS);
+
+      for (j = 0; j < JOYSTICK_AXES; ++j)
+         DS_SetJoystickAxis(i, j, (float)((j % 5) - 2) / 2);
+      for (j = 0; j < JOYSTICK_HATS; ++j)
+         DS_SetJoystickHat(i, j, 90);
+      for (j = 0; j < JOYSTICK_BUTTONS; ++j)
+         DS_SetJoystickButton(i, j, j % 3 == 0);
+   }
+
+   DS_SetRobotEnabled(1);
+}
+
+/**
+ * Adds a benchmark to \a cases (if it matches the \a filter)
+ */
+static void add_case(Case *cases, int *count, const Options *options, const char *name, BenchFunction function,
+                     void *data)
+{
+   if (options->filter && !strstr(name, options->filter))
+      return;
+
+   cases[*count].name = name;
+   cases[*count].function = function;
+   cases[*count].data = data;
+   ++(*count);
+}
+
+/**
+ * Runs the benchmarks that match the \a options and writes their results
+ *
+ * \returns \c EXIT_FAILURE if the results cannot be written
+ */
+static int run_benchmarks(const Options *options, Primitives *primitives, Codec *codecs)
+{
+   /* Register the benchmarks */
+   int i;
+   int count = 0;
+   Case cases[64];
+   char names[4][8][64];
+   add_case(cases, &count, options, "string/new", &string_new, primitives);
+   add_case(cases, &count, options, "string/append", &string_append, primitives);
+   add_case(cases, &count, options, "string/append_bytes", &string_append_bytes, primitives);
+   add_case(cases, &count, options, "string/format", &string_format, primitives);
+   add_case(cases, &count, options, "string/to_char", &string_to_char, primitives);
+   add_case(cases, &count, options, "string/compare", &string_compare, primitives);
+   add_case(cases, &count, options, "queue/push_pop", &queue_push_pop, primitives);
+   add_case(cases, &count, options, "queue/fill_drain_64", &queue_fill_drain, primitives);
+   add_case(cases, &count, options, "array/insert_64", &array_insert, primitives);
+   add_case(cases, &count, options, "crc32/64", &crc32_64, primitives);
+   add_case(cases, &count, options, "crc32/1024", &crc32_1024, primitives);
+   add_case(cases, &count, options, "crc32/stream_1024", &crc32_stream, primitives);
+
+   for (i = 0; i < 4; ++i)
+   {
+      int n = 0;
+      Codec *codec = &codecs[i];
+      const DS_Protocol *p = &codec->protocol;
+
+      /* Only measure the functions that the protocol implements */
+      struct
+      {
+         const char *name;
+         int present;
+         BenchFunction function;
+      } functions[] = {
+         {"create_robot_packet", p->create_robot_packet != NULL, &create_robot_packet},
+         {"encode_robot_packet", p->encode_robot_packet != NULL, &encode_robot_packet},
+         {"read_robot_packet", p->read_robot_packet != NULL, &read_robot_packet},
+         {"create_fms_packet", p->create_fms_packet != NULL, &create_fms_packet},
+         {"encode_fms_packet", p->encode_fms_packet != NULL, &encode_fms_packet},
+         {"read_fms_packet", p->read_fms_packet != NULL, &read_fms_packet},
+         {"create_radio_packet", p->create_radio_packet != NULL, &create_radio_packet},
+      };
+
+      for (n = 0; n < (int)(sizeof(functions) / sizeof(functions[0])); ++n)
+      {
+         if (!functions[n].present)
+            continue;
+
+         snprintf(names[i][n], sizeof(names[i][n]), "%s/%s", codec->name, functions[n].name);
+         add_case(cases, &count, options, names[i][n], functions[n].function, codec);
+      }
+   }
+
+   /* Measured last, because they change the joystick values */
+   add_case(cases, &count, options, "joysticks/set_elements", &joystick_set_elements, primitives);
+   add_case(cases, &count, options, "joysticks/set_state", &joystick_set_state, primitives);
+
+   /* Run the benchmarks */
+   BenchResult *results = (BenchResult *)calloc((size_t)DS_Max(count, 1), sizeof(BenchResult));
+   for (i = 0; i < count; ++i)
+   {
+      /* Each protocol starts with the state that it has when it is loaded */
+      if (i == 0 || cases[i].data != cases[i - 1].data)
+         memset(DS_ProtocolData(), 0, DS_PROTOCOL_DATA_SIZE);
+
+      Bench_Run(&results[i], cases[i].function, cases[i].data, &options->bench);
+      fprintf(stderr, "%-36s %10.1f ns/op %8.2f allocs/op %10.1f bytes/op\n", cases[i].name,
+              Bench_Percentile(&results[i].ns_per_op, 50), results[i].allocations_per_op, results[i].bytes_per_op);
+   }
+
+   /* Write the results */
+   int status = EXIT_SUCCESS;
+   FILE *file = options->output ? fopen(options->output, "w") : stdout;
+   if (file)
+   {
+      BenchJson json;
+      Bench_JsonOpen(&json, file);
+      Bench_JsonString(&json, "benchmark", "micro");
+      Bench_JsonInteger(&json, "warmup_ms", options->bench.warmup);
+      Bench_JsonInteger(&json, "repetitions", options->bench.repetitions);
+      Bench_JsonInteger(&json, "duration_ms", options->bench.duration);
+      Bench_JsonObject(&json, "results");
+      for (i = 0; i < count; ++i)
+         Bench_JsonResult(&json, cases[i].name, &results[i]);
+      Bench_JsonClose(&json);
+
+      if (file != stdout)
+         fclose(file);
+   }
+   else
+   {
+      fprintf(stderr, "Cannot write to %s\n", options->output);
+      status = EXIT_FAILURE;
+   }
+
+   /* Release the results */
+   for (i = 0; i < count; ++i)
+      Bench_FreeSamples(&results[i].ns_per_op);
+
+   DS_FREE(results);
+   return status;
+}
+
+/**
+ * Main entry point of the application
+ */
+int main(int argc, char **argv)
+{
+   /* Read the command line options */
+   Options options;
+   if (!read_options(argc, argv, &options))
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   /* Initialize LibDS (without a protocol) and the joysticks */
+   DS_Init();
+   init_joysticks();
+
+   /* Prepare the inputs of the container and CRC32 benchmarks */
+   int i;
+   Primitives primitives;
+   memset(&primitives, 0, sizeof(primitives));
+   for (i = 0; i < (int)sizeof(primitives.block); ++i)
+      primitives.block[i] = (uint8_t)(i * 31);
+
+   primitives.a = DS_StrNew("Loaded FRC 2020 protocol, team 3794");
+   primitives.b = DS_StrNew("Loaded FRC 2020 protocol, team 3795");
+   DS_QueueInit(&primitives.queue, 128, sizeof(primitives.item));
+
+   /* Prepare the inputs of the packet benchmarks */
+   Codec codecs[4];
+   init_codec(&codecs[0], "frc_2014", DS_GetProtocolFRC_2014(), 2014);
+   init_codec(&codecs[1], "frc_2015", DS_GetProtocolFRC_2015(), 2015);
+   init_codec(&codecs[2], "frc_2016", DS_GetProtocolFRC_2016(), 2016);
+   init_codec(&codecs[3], "frc_2020", DS_GetProtocolFRC_2020(), 2020);
+
+   /* Check the allocations of the send path, or run the benchmarks */
+   int status;
+   if (options.check_ticks > 0)
+      status = check_allocations(codecs, 4, &primitives, options.check_ticks);
+   else
+      status = run_benchmarks(&options, &primitives, codecs);
+
+   /* Release the inputs */
+   for (i = 0; i < 4; ++i)
+      DS_StrRmBuf(&codecs[i].protocol.name);
+
+   DS_StrRmBuf(&primitives.a);
+   DS_StrRmBuf(&primitives.b);
+   DS_QueueFree(&primitives.queue);
+   DS_Close();
+
+   return status;
+}
@@ -0,0 +1,39 @@
+#-------------------------------------------------------------------------------
+# Remove Qt dependency
+#-------------------------------------------------------------------------------
+
+CONFIG += console
+
+CONFIG -= qt
+CONFIG -= app_bundle
+
+DEFINES -= UNICODE QT_LARGEFILE_SUPPORT
+
+#-------------------------------------------------------------------------------
+# Deploy options
+#-------------------------------------------------------------------------------
+
+TARGET = micro-bench
+
+#-------------------------------------------------------------------------------
+# Count heap allocations (only supported by the GNU linker)
+#-------------------------------------------------------------------------------
+
+linux-g++*|linux-clang* {
+    DEFINES += BENCH_WRAP_MALLOC
+    QMAKE_LFLAGS += -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+}
+
+#-------------------------------------------------------------------------------
+# Include libraries
+#-------------------------------------------------------------------------------
+
+include ($$PWD/../../LibDS.pri)
+include ($$PWD/../common/bench.pri)
+
+#-------------------------------------------------------------------------------
+# Import source code
+#-------------------------------------------------------------------------------
+
+SOURCES += \
+    $$PWD/micro.c
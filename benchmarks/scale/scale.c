@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures how LibDS scales with the number of DS in a process: N contexts
+ * (1, 2, 4... up to --max) talk to N simulated robots through the loopback
+ * transport. For each N, the benchmark reports the resources used by the
+ * process (CPU, context switches, RSS and threads) and the regularity of the
+ * robot packets: the jitter of the time between two packets of the same DS
+ * (compared with the robot interval of the protocol) and the number of
+ * packets that arrived later than the tolerance allows.
+ *
+ * The robots run in the same process (in the main thread), so their CPU time
+ * is included in the results.
+ */
+
+#include <bench.h>
+#include <robot_sim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONNECT_TIMEOUT 10000 /* Time given to the DS to connect (in milliseconds) */
+
+/**
+ * Options given in the command line
+ */
+typedef struct
+{
+   int protocol; /**< Protocol year (2015, 2016 or 2020) */
+   int max; /**< Maximum number of DS */
+   int warmup; /**< Time given to the DS to settle once connected (in milliseconds) */
+   int duration; /**< Duration of each measurement (in seconds) */
+   int tolerance; /**< Delay after which a robot packet is late (in milliseconds) */
+   const char *output; /**< JSON output file (or \c NULL for the standard output) */
+} Options;
+
+/**
+ * Regularity of the robot packets of a measurement
+ */
+typedef struct
+{
+   int measuring; /**< 1 while the packets are measured */
+   uint64_t interval; /**< Expected time between two packets (in nanoseconds) */
+   uint64_t tolerance; /**< Delay after which a packet is late (in nanoseconds) */
+   BenchSamples jitter; /**< Deviation from the interval of each packet (in microseconds) */
+   unsigned long packets; /**< Measured packets */
+   unsigned long misses; /**< Packets that arrived later than the tolerance allows */
+} Timing;
+
+/**
+ * A DS and its robot
+ */
+typedef struct
+{
+   DS_Context *context;
+   RobotSim robot;
+   Timing *timing;
+   uint64_t last_packet;
+   char ds_name[32];
+   char robot_name[32];
+} Team;
+
+/**
+ * Prints the command line options of the benchmark
+ */
+static void usage(const char *name)
+{
+   fprintf(stderr, "Usage: %s [options]\n\n", name);
+   fprintf(stderr, "  --protocol YEAR    Protocol used by the DS and robots (2015, 2016 or 2020)\n");
+   fprintf(stderr, "  --max N            Maximum number of DS (default: 256)\n");
+   fprintf(stderr, "  --warmup MS        Time given to the DS to settle once connected (default: 1000)\n");
+   fprintf(stderr, "  --duration SECONDS Duration of each measurement (default: 5)\n");
+   fprintf(stderr, "  --tolerance MS     Delay after which a robot packet is late (default: 5)\n");
+   fprintf(stderr, "  --output FILE      Write the JSON results into FILE\n");
+}
+
+/**
+ * Reads the command line options into the given \a options
+ *
+ * \returns \c 1 if the options are valid
+ */
+static int read_options(int argc, char **argv, Options *options)
+{
+   options->protocol = 2020;
+   options->max = 256;
+   options->warmup = 1000;
+   options->duration = 5;
+   options->tolerance = 5;
+   options->output = NULL;
+
+   int i;
+   for (i = 1; i + 1 < argc; i += 2)
+   {
+      const char *option = argv[i];
+      const char *value = argv[i + 1];
+
+      if (strcmp(option, "--protocol") == 0)
+         options->protocol = atoi(value);
+      else if (strcmp(option, "--max") == 0)
+         options->max = atoi(value);
+      else if (strcmp(option, "--warmup") == 0)
+         options->warmup = atoi(value);
+      else if (strcmp(option, "--duration") == 0)
+         options->duration = atoi(value);
+      else if (strcmp(option, "--tolerance") == 0)
+         options->tolerance = atoi(value);
+      else if (strcmp(option, "--output") == 0)
+         options->output = value;
+      else
+         return 0;
+   }
+
+   /* An option is missing its value */
+   if (i < argc)
+      return 0;
+
+   return options->max > 0 && options->warmup >= 0 && options->duration > 0 && options->tolerance >= 0
+          && (options->protocol == 2015 || options->protocol == 2016 || options->protocol == 2020);
+}
+
+/**
+ * Returns the given protocol
+ */
+static DS_Protocol get_protocol(const int year)
+{
+   if (year == 2015)
+      return DS_GetProtocolFRC_2015();
+   if (year == 2016)
+      return DS_GetProtocolFRC_2016();
+
+   return DS_GetProtocolFRC_2020();
+}
+
+/**
+ * Measures the time since the previous packet received by the robot of
+ * the given team
+ */
+static void packet_received(void *data, const uint64_t time)
+{
+   Team *team = (Team *)data;
+   Timing *timing = team->timing;
+
+   if (timing->measuring && team->last_packet > 0 && time > team->last_packet)
+   {
+      uint64_t interval = time - team->last_packet;
+      uint64_t jitter = (interval > timing->interval) ? interval - timing->interval : timing->interval - interval;
+      Bench_AddSample(&timing->jitter, (double)jitter / 1000);
+
+      ++timing->packets;
+      if (interval > timing->interval + timing->tolerance)
+         ++timing->misses;
+   }
+
+   team->last_packet = time;
+}
+
+/**
+ * Creates the DS and robot of the given \a team, which talk to each other
+ * through the loopback transport
+ */
+static void open_team(Team *team, const int index, const int year, Timing *timing)
+{
+   memset(team, 0, sizeof(Team));
+   team->timing = timing;
+   snprintf(team->ds_name, sizeof(team->ds_name), "ds-%d", index);
+   snprintf(team->robot_name, sizeof(team->robot_name), "robot-%d", index);
+
+   /* Create the DS */
+   DS_Protocol protocol = get_protocol(year);
+   team->context = DS_ContextNew();
+   DS_ContextSetTeamNumber(team->context, 1000 + index);
+   DS_ContextSetTransport(team->context, DS_LoopbackTransport(team->ds_name));
+   DS_ContextConfigureProtocol(team->context, &protocol);
+
+   /* Set the robot address once the protocol sockets exist, so that the DS
+    * does not wait for its watchdog to apply it */
+   DS_ContextSetCustomRobotAddress(team->context, team->robot_name);
+
+   /* Create the robot */
+   RobotSimConfig config;
+   RobotSim_DefaultConfig(&config);
+   config.protocol = year;
+   config.address = team->ds_name;
+   config.transport = DS_LoopbackTransport(team->robot_name);
+   config.netconsole_rate = 0;
+   config.packet_received = &packet_received;
+   config.packet_data = team;
+   RobotSim_Open(&team->robot, &config);
+}
+
+/**
+ * Closes the DS and robot of the given \a team
+ */
+static void close_team(Team *team)
+{
+   RobotSim_Close(&team->robot);
+   DS_ContextFree(team->context);
+}
+
+/**
+ * Replies to the packets sent to every robot (waiting up to 5 ms for new
+ * packets) and discards the events of every DS
+ */
+static void process_teams(Team *teams, const int count)
+{
+   int i;
+   DS_Event event;
+   DS_SocketWait(&teams[0].robot.robot_socket, 5);
+
+   for (i = 0; i < count; ++i)
+   {
+      RobotSim_Process(&teams[i].robot);
+      while (DS_ContextPollEvent(teams[i].context, &event))
+      {
+         if (event.type == DS_NETCONSOLE_NEW_MESSAGE)
+            DS_FREE(event.netconsole.message);
+      }
+   }
+}
+
+/**
+ * Returns the number of DS that are talking to their robots
+ */
+static int count_connected(Team *teams, const int count)
+{
+   int i;
+   int connected = 0;
+   for (i = 0; i < count; ++i)
+      connected += DS_ContextGetRobotCommunications(teams[i].context) ? 1 : 0;
+
+   return connected;
+}
+
+/**
+ * Runs the teams until every DS is talking to its robot (or until the
+ * connection timeout expires), and then for \a warmup more milliseconds.
+ * The DS that did not connect are reported.
+ *
+ * \returns the time that the DS needed to connect (in milliseconds)
+ */
+static double warm_up(Team *teams, const int count, const int warmup)
+{
+   /* Wait until every DS is connected */
+   uint64_t start = DS_GetMonotonicTime();
+   uint64_t end = start + (uint64_t)CONNECT_TIMEOUT * 1000000ULL;
+   while (count_connected(teams, count) < count && DS_GetMonotonicTime() < end)
+      process_teams(teams, count);
+
+   /* Report the DS that did not connect */
+   int i;
+   double connect_time = (double)(DS_GetMonotonicTime() - start) / 1e6;
+   for (i = 0; i < count; ++i)
+   {
+      if (!DS_ContextGetRobotCommunications(teams[i].context))
+         fprintf(stderr, "%s did not connect to %s within %d ms\n", teams[i].ds_name, teams[i].robot_name,
+                 CONNECT_TIMEOUT);
+   }
+
+   /* Let the DS settle */
+   end = DS_GetMonotonicTime() + (uint64_t)warmup * 1000000ULL;
+   while (DS_GetMonotonicTime() < end)
+      process_teams(teams, count);
+
+   return connect_time;
+}
+
+/**
+ * Runs \a count DS and robots for the configured time, and writes the
+ * resources that they used and the regularity of their packets
+ */
+static void measure(BenchJson *json, const Options *options, const int count)
+{
+   int i;
+   Team *teams = (Team *)calloc((size_t)count, sizeof(Team));
+
+   /* Create the teams */
+   DS_Protocol protocol = get_protocol(options->protocol);
+   Timing timing;
+   memset(&timing, 0, sizeof(timing));
+   timing.interval = (uint64_t)protocol.robot_interval * 1000000ULL;
+   timing.tolerance = (uint64_t)options->tolerance * 1000000ULL;
+   DS_StrRmBuf(&protocol.name);
+
+   for (i = 0; i < count; ++i)
+      open_team(&teams[i], i, options->protocol, &timing);
+
+   /* Let the DS connect to their robots */
+   double connect_time = warm_up(teams, count, options->warmup);
+
+   /* Measure the teams */
+   BenchUsage start_usage, end_usage;
+   Bench_GetUsage(&start_usage);
+   timing.measuring = 1;
+
+   uint64_t end = start_usage.wall_time + (uint64_t)options->duration * 1000000000ULL;
+   while (DS_GetMonotonicTime() < end)
+      process_teams(teams, count);
+
+   timing.measuring = 0;
+   Bench_GetUsage(&end_usage);
+
+   /* Count the DS that are talking to their robots */
+   int connected = count_connected(teams, count);
+
+   /* Write the results */
+   double seconds = (double)(end_usage.wall_time - start_usage.wall_time) / 1e9;
+   long voluntary = end_usage.voluntary_switches - start_usage.voluntary_switches;
+   long involuntary = end_usage.involuntary_switches - start_usage.involuntary_switches;
+
+   Bench_JsonObject(json, NULL);
+   Bench_JsonInteger(json, "contexts", count);
+   Bench_JsonInteger(json, "connected", connected);
+   Bench_JsonNumber(json, "connect_ms", connect_time);
+   Bench_JsonNumber(json, "cpu_ms_per_s", Bench_CPUPerSecond(&start_usage, &end_usage));
+   Bench_JsonNumber(json, "voluntary_switches_per_s", voluntary / seconds);
+   Bench_JsonNumber(json, "involuntary_switches_per_s", involuntary / seconds);
+   Bench_JsonInteger(json, "rss_kb", end_usage.rss);
+   Bench_JsonInteger(json, "max_rss_kb", end_usage.max_rss);
+   Bench_JsonInteger(json, "threads", end_usage.threads);
+   Bench_JsonInteger(json, "packets", (long long)timing.packets);
+   Bench_JsonInteger(json, "deadline_misses", (long long)timing.misses);
+   Bench_JsonSamples(json, "jitter_us", &timing.jitter);
+   Bench_JsonEnd(json);
+
+   fprintf(stderr, "%4d DS: %8.1f ms CPU/s, %8.0f switches/s, %7ld KB RSS, %lu/%lu late, p99 jitter %.0f us\n",
+           count, Bench_CPUPerSecond(&start_usage, &end_usage), (voluntary + involuntary) / seconds, end_usage.rss,
+           timing.misses, timing.packets, Bench_Percentile(&timing.jitter, 99));
+
+   /* Close the teams */
+   for (i = 0; i < count; ++i)
+      close_team(&teams[i]);
+
+   Bench_FreeSamples(&timing.jitter);
+   DS_FREE(teams);
+}
+
+/**
+ * Main entry point of the application
+ */
+int main(int argc, char **argv)
+{
+   /* Read the command line options */
+   Options options;
+   if (!read_options(argc, argv, &options))
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   FILE *file = options.output ? fopen(options.output, "w") : stdout;
+   if (!file)
+   {
+      fprintf(stderr, "Cannot write to %s\n", options.output);
+      return EXIT_FAILURE;
+   }
+
+   /* Initialize LibDS */
+   DS_Init();
+
+   /* Measure 1, 2, 4... DS (and the maximum) */
+   BenchJson json;
+   Bench_JsonOpen(&json, file);
+   Bench_JsonString(&json, "benchmark", "scale");
+   Bench_JsonInteger(&json, "protocol", options.protocol);
+   Bench_JsonInteger(&json, "duration_s", options.duration);
+   Bench_JsonInteger(&json, "tolerance_ms", options.tolerance);
+   Bench_JsonArray(&json, "results");
+
+   int count;
+   for (count = 1; count < options.max; count *= 2)
+      measure(&json, &options, count);
+
+   measure(&json, &options, options.max);
+   Bench_JsonClose(&json);
+
+   if (file != stdout)
+      fclose(file);
+
+   DS_Close();
+   return EXIT_SUCCESS;
+}
@@ -27,7 +27,7 @@
 #include <stdio.h>
 #include <pthread.h>
 
-#define INVALID_ID -1
+#define MAX_JOYSTICKS 16
 #define SDL_AXIS_RANGE 0x8000
 
 /**
@@ -37,25 +37,11 @@
 static int initialized = 0;
 
 /**
- * SDL2 does not adjust the joystick IDs with the 'real' USB
- * ID's, which causes a lot of trouble when updating the
- * joystick values with the Driver Station
+ * The SDL joysticks, in the same order as they are registered
+ * with the Driver Station
  */
-static int joystick_tracker = -1;
-
-/**
- * Calculates the dynamic ID of the given joystick
- */
-static int get_id(const int id)
-{
-   int joystick = id;
-   joystick = abs(joystick_tracker - (joystick + 1));
-
-   if (joystick >= SDL_NumJoysticks())
-      joystick -= 1;
-
-   return joystick;
-}
+static int joystick_count = 0;
+static SDL_Joystick *joysticks[MAX_JOYSTICKS];
 
 /**
  * Registers all the detected SDL joysticks with the Driver Station
@@ -65,12 +51,14 @@ static void register_joysticks(void)
    DS_JoysticksReset();
 
    int i;
-   for (i = 0; i < SDL_NumJoysticks(); ++i)
+   joystick_count = 0;
+   for (i = 0; i < SDL_NumJoysticks() && joystick_count < MAX_JOYSTICKS; ++i)
    {
       SDL_Joystick *joystick = SDL_JoystickOpen(i);
 
       if (joystick)
       {
+         joysticks[joystick_count++] = joystick;
          DS_JoysticksAdd(SDL_JoystickNumAxes(joystick), SDL_JoystickNumHats(joystick),
                          SDL_JoystickNumButtons(joystick));
       }
@@ -78,85 +66,55 @@ static void register_joysticks(void)
 }
 
 /**
- * Extracts the hat/POV information from the given \a event
- * and updates the state of the Driver Station joysticks
+ * Converts the given SDL hat \a value to an angle
  */
-static void process_hat_event(SDL_Event *event)
+static int16_t get_hat_angle(const Uint8 value)
 {
-   if (!event)
-      return;
-
-   int angle = 0;
-   int hat = event->jhat.hat;
-   int joystick = get_id(event->jhat.which);
-
-   switch (event->jhat.value)
+   switch (value)
    {
       case SDL_HAT_RIGHTUP:
-         angle = 45;
-         break;
+         return 45;
       case SDL_HAT_RIGHTDOWN:
-         angle = 135;
-         break;
+         return 135;
       case SDL_HAT_LEFTDOWN:
-         angle = 225;
-         break;
+         return 225;
       case SDL_HAT_LEFTUP:
-         angle = 315;
-         break;
+         return 315;
       case SDL_HAT_UP:
-         angle = 0;
-         break;
+         return 0;
       case SDL_HAT_RIGHT:
-         angle = 90;
-         break;
+         return 90;
       case SDL_HAT_DOWN:
-         angle = 180;
-         break;
+         return 180;
       case SDL_HAT_LEFT:
-         angle = 270;
-         break;
+         return 270;
       default:
-         angle = -1;
-         break;
+         return -1;
    }
-
-   if (joystick > INVALID_ID)
-      DS_SetJoystickHat(joystick, hat, angle);
 }
 
 /**
- * Extracts the axis information from the given \a event and updates
- * the state of the Driver Station joysticks
+ * Reads the axes, buttons and hats of the given \a joystick and sends
+ * them to the Driver Station with a single call
  */
-static void process_axis_event(SDL_Event *event)
+static void update_joystick_state(const int joystick)
 {
-   if (!event)
-      return;
+   int i;
+   uint64_t buttons = 0;
+   float axes[DS_MAX_JOYSTICK_AXES];
+   int16_t hats[DS_MAX_JOYSTICK_HATS];
+   SDL_Joystick *stick = joysticks[joystick];
 
-   int axis = event->jaxis.axis;
-   int joystick = get_id(event->jaxis.which);
-   double value = ((double)(event->jaxis.value)) / SDL_AXIS_RANGE;
+   for (i = 0; i < DS_GetJoystickNumAxes(joystick); ++i)
+      axes[i] = (float)SDL_JoystickGetAxis(stick, i) / SDL_AXIS_RANGE;
 
-   if (joystick > INVALID_ID)
-      DS_SetJoystickAxis(joystick, axis, value);
-}
+   for (i = 0; i < DS_GetJoystickNumButtons(joystick); ++i)
+      buttons |= (uint64_t)(SDL_JoystickGetButton(stick, i) == SDL_PRESSED) << i;
 
-/**
- * Extracts the button information from the given \a event
- * and updates the state of the Driver Station joysticks
- */
-static void process_button_event(SDL_Event *event)
-{
-   if (!event)
-      return;
+   for (i = 0; i < DS_GetJoystickNumHats(joystick); ++i)
+      hats[i] = get_hat_angle(SDL_JoystickGetHat(stick, i));
 
-   int button = event->jbutton.button;
-   int joystick = get_id(event->jbutton.which);
-   int pressed = (event->jbutton.state == SDL_PRESSED);
-
-   if (joystick > INVALID_ID)
-      DS_SetJoystickButton(joystick, button, pressed);
+   DS_SetJoystickState(joystick, axes, buttons, hats);
 }
 
 /**
@@ -191,39 +149,41 @@ void close_joysticks(void)
 
 /**
  * Queries for new SDL joystick events and updates the
- * Driver Station with the new joystick information.
+ * Driver Station with the new joystick information,
+ * one call per joystick.
  */
 void update_joysticks(void)
 {
    if (!initialized)
       return;
 
+   int i;
+   int changed = 0;
    SDL_Event event;
    while (SDL_PollEvent(&event))
    {
       switch (event.type)
       {
          case SDL_JOYDEVICEADDED:
-            ++joystick_tracker;
-            register_joysticks();
-            break;
          case SDL_JOYDEVICEREMOVED:
             register_joysticks();
+            changed = 1;
             break;
          case SDL_JOYAXISMOTION:
-            process_axis_event(&event);
-            break;
          case SDL_JOYHATMOTION:
-            process_hat_event(&event);
-            break;
          case SDL_JOYBUTTONDOWN:
-            process_button_event(&event);
-            break;
          case SDL_JOYBUTTONUP:
-            process_button_event(&event);
+            changed = 1;
             break;
          default:
             break;
       }
    }
+
+   /* Send the new state of every joystick (unchanged ones are ignored) */
+   if (changed)
+   {
+      for (i = 0; i < joystick_count; ++i)
+         update_joystick_state(i);
+   }
 }
@@ -64,7 +64,6 @@ int main()
       process_events();
       update_interface();
       update_joysticks();
-      DS_Sleep(20);
    }
 
    /* Close the DS and the application modules */
@@ -77,13 +76,16 @@ int main()
 }
 
 /**
- * Checks if the LibDS has any new events and displays them
+ * Waits up to 20 milliseconds for new LibDS events and displays them
  * on the console screen.
  */
 static void process_events()
 {
    DS_Event event;
-   while (DS_PollEvent(&event))
+   if (!DS_WaitEvent(&event, 20))
+      return;
+
+   do
    {
       switch (event.type)
       {
@@ -119,7 +121,7 @@ static void process_events()
          default:
             break;
       }
-   }
+   } while (DS_PollEvent(&event));
 }
 
 /**
@@ -0,0 +1,39 @@
+#-------------------------------------------------------------------------------
+# Remove Qt dependency
+#-------------------------------------------------------------------------------
+
+CONFIG += console
+
+CONFIG -= qt
+CONFIG -= app_bundle
+
+DEFINES -= UNICODE QT_LARGEFILE_SUPPORT
+
+#-------------------------------------------------------------------------------
+# Deploy options
+#-------------------------------------------------------------------------------
+
+TARGET = fms-sim
+
+!win32* {
+    target.path = /usr/bin
+    INSTALLS += target
+}
+
+#-------------------------------------------------------------------------------
+# Include libraries
+#-------------------------------------------------------------------------------
+
+include ($$PWD/../../LibDS.pri)
+include ($$PWD/../RobotSim/RobotSim.pri)
+
+#-------------------------------------------------------------------------------
+# Import source code
+#-------------------------------------------------------------------------------
+
+HEADERS += \
+    $$PWD/src/fms_sim.h
+
+SOURCES += \
+    $$PWD/src/fms_sim.c \
+    $$PWD/src/main.c
@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fms_sim.h"
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Ports used by the FMS side of the FRC 2015/2016/2020 protocols
+ */
+#define FMS_PORT_IN 1160
+#define FMS_PORT_OUT 1120
+
+/*
+ * Length of the packets sent by the FMS
+ */
+#define FMS_PACKET_SIZE 22
+
+/*
+ * Control code bits that the DS forwards to the robot (e-stop, enabled
+ * state and control mode)
+ */
+#define ROBOT_CONTROL_MASK 0x87
+
+/*
+ * Protocol bytes
+ */
+static const uint8_t cCommVersion = 0x00;
+static const uint8_t cQualification = 0x02;
+
+/**
+ * Returns the current time of the simulator (in nanoseconds)
+ */
+static uint64_t now(void)
+{
+   return DS_GetMonotonicTime();
+}
+
+/**
+ * Returns \c 1 if the robot of the given \a station is running with the
+ * given \a control code and the team station assigned by the FMS
+ */
+static int reflected(const FMSSimStation *station, const uint8_t control)
+{
+   const RobotSim *robot = station->robot;
+   return (robot->control & ROBOT_CONTROL_MASK) == (control & ROBOT_CONTROL_MASK) && robot->station == station->station;
+}
+
+/**
+ * Adds a latency \a sample (in milliseconds) to the given \a latency
+ */
+static void add_sample(FMSSimLatency *latency, const double sample)
+{
+   if (latency->count >= latency->capacity)
+   {
+      unsigned int capacity = DS_Max(latency->capacity * 2, 64);
+      double *samples = (double *)realloc(latency->samples, capacity * sizeof(double));
+      if (!samples)
+         return;
+
+      latency->samples = samples;
+      latency->capacity = capacity;
+   }
+
+   latency->samples[latency->count++] = sample;
+}
+
+/**
+ * Compares two latency samples (used to sort them)
+ */
+static int compare_samples(const void *a, const void *b)
+{
+   double x = *(const double *)a;
+   double y = *(const double *)b;
+   return (x > y) - (x < y);
+}
+
+/**
+ * Writes the packet that the FMS sends to the given \a station into the
+ * given \a out buffer, it contains:
+ *    - The packet index
+ *    - The control code of the current phase
+ *    - The team station
+ *    - The tournament level, match number and play number
+ *    - The current date/time (UTC)
+ *    - The time remaining in the current phase
+ *
+ * \returns the length of the packet
+ */
+static size_t encode_fms_packet(FMSSim *sim, const FMSSimStation *station, const uint64_t timestamp, uint8_t *out)
+{
+   /* Get current date/time */
+   struct tm date;
+   time_t rt = time(NULL);
+#if defined _WIN32
+   gmtime_s(&date, &rt);
+#else
+   gmtime_r(&rt, &date);
+#endif
+
+   /* Get remaining time of the phase (in seconds) */
+   uint64_t remaining = 0;
+   if (sim->phase_end > timestamp)
+      remaining = (sim->phase_end - timestamp) / 1000000000ULL;
+
+   /* Add packet index, comm version, control code and team station */
+   out[0] = (uint8_t)(sim->packet_index >> 8);
+   out[1] = (uint8_t)(sim->packet_index);
+   out[2] = cCommVersion;
+   out[3] = sim->script[sim->phase].control;
+   out[4] = 0;
+   out[5] = station->station;
+
+   /* Add match information */
+   out[6] = cQualification;
+   out[7] = 0;
+   out[8] = 1;
+   out[9] = 1;
+
+   /* Add date/time */
+   memset(out + 10, 0, 4);
+   out[14] = (uint8_t)date.tm_sec;
+   out[15] = (uint8_t)date.tm_min;
+   out[16] = (uint8_t)date.tm_hour;
+   out[17] = (uint8_t)date.tm_mday;
+   out[18] = (uint8_t)date.tm_mon;
+   out[19] = (uint8_t)date.tm_year;
+
+   /* Add remaining time */
+   out[20] = (uint8_t)(remaining >> 8);
+   out[21] = (uint8_t)(remaining);
+
+   return FMS_PACKET_SIZE;
+}
+
+/**
+ * Sends the packet of the current phase to every DS
+ */
+static void send_packets(FMSSim *sim)
+{
+   int i;
+   uint8_t packet[FMS_PACKET_SIZE];
+
+   for (i = 0; i < sim->station_count; ++i)
+   {
+      FMSSimStation *station = &sim->stations[i];
+
+      /* Latency is measured from the first packet of the phase */
+      uint64_t timestamp = now();
+      if (station->command_pending && station->command_time == 0)
+         station->command_time = timestamp;
+
+      size_t len = encode_fms_packet(sim, station, timestamp, packet);
+      if (DS_SocketSendBytes(&station->socket, packet, len) > 0)
+         ++station->sent_packets;
+   }
+
+   ++sim->packet_index;
+}
+
+/**
+ * Reads the status packets sent by the DS of the given \a station, which
+ * contain the DS control code and the team number
+ */
+static void read_ds_packets(FMSSimStation *station)
+{
+   DS_ByteSpan data;
+   while (DS_SocketPeek(&station->socket, &data))
+   {
+      if (data.n >= 8)
+      {
+         station->ds_status = DS_SpanU8(&data, 3);
+         station->team = DS_SpanU16(&data, 4);
+         ++station->received_packets;
+      }
+
+      DS_SocketRelease(&station->socket);
+   }
+}
+
+/**
+ * Checks if the robot of the given \a station reflects the command of the
+ * current phase, and records how long it took. A robot that stops reflecting
+ * the command (e.g. because the DS dropped it) is counted once as lost.
+ */
+static void check_robot(FMSSim *sim, FMSSimStation *station)
+{
+   const RobotSim *robot = station->robot;
+   if (station->command_reflected && !reflected(station, sim->script[sim->phase].control))
+   {
+      ++sim->latency[sim->phase].lost;
+      station->command_reflected = 0;
+   }
+
+   if (!station->command_pending || station->command_time == 0)
+      return;
+
+   if (robot->control_time >= station->command_time && reflected(station, sim->script[sim->phase].control))
+   {
+      double latency = (double)(robot->control_time - station->command_time) / 1000000.0;
+      add_sample(&sim->latency[sim->phase], latency);
+      station->command_pending = 0;
+      station->command_reflected = 1;
+   }
+}
+
+/**
+ * Starts the current phase of the match, the FMS sends the new control
+ * code to every DS immediately
+ */
+static void begin_phase(FMSSim *sim, const uint64_t timestamp)
+{
+   int i;
+   const FMSSimPhase *phase = &sim->script[sim->phase];
+
+   sim->next_packet = timestamp;
+   sim->phase_end = timestamp + (uint64_t)phase->duration * 1000000ULL;
+
+   /* Only measure the robots that are not running the command yet */
+   for (i = 0; i < sim->station_count; ++i)
+   {
+      FMSSimStation *station = &sim->stations[i];
+      station->command_time = 0;
+      station->command_pending = station->robot && !reflected(station, phase->control);
+      station->command_reflected = station->robot && !station->command_pending;
+   }
+}
+
+/**
+ * Ends the current phase of the match, the robots that did not reflect its
+ * command are counted as timeouts
+ */
+static void end_phase(FMSSim *sim)
+{
+   int i;
+   for (i = 0; i < sim->station_count; ++i)
+   {
+      if (sim->stations[i].command_pending)
+         ++sim->latency[sim->phase].timeouts;
+
+      sim->stations[i].command_pending = 0;
+      sim->stations[i].command_reflected = 0;
+   }
+}
+
+/**
+ * Writes the default match script into the given \a script buffer (which
+ * must hold \c FMS_SIM_MAX_PHASES phases). The duration of each phase is
+ * multiplied by the given \a scale.
+ *
+ * \returns the number of phases in the script
+ */
+int FMSSim_DefaultScript(FMSSimPhase *script, const double scale)
+{
+   static const FMSSimPhase match[] = {
+      { "Pre-match", 3000, FMS_SIM_AUTONOMOUS },
+      { "Autonomous", 15000, FMS_SIM_AUTONOMOUS | FMS_SIM_ENABLED },
+      { "Transition", 3000, FMS_SIM_TELEOPERATED },
+      { "Teleoperated", 135000, FMS_SIM_TELEOPERATED | FMS_SIM_ENABLED },
+      { "Disabled", 3000, FMS_SIM_TELEOPERATED },
+      { "E-stop", 3000, FMS_SIM_TELEOPERATED | FMS_SIM_EMERGENCY_STOP },
+   };
+
+   assert(script);
+
+   int i;
+   int count = (int)(sizeof(match) / sizeof(match[0]));
+   for (i = 0; i < count; ++i)
+   {
+      script[i] = match[i];
+      script[i].duration = DS_Max((int)(match[i].duration * scale), 1);
+   }
+
+   return count;
+}
+
+/**
+ * Opens the socket used by the FMS to talk with the DS at the given
+ * \a address, which is assigned the given team station \a position (from
+ * \c 0 for red 1 to \c 5 for blue 3).
+ *
+ * If a \a robot is given, the FMS measures how long its DS takes to forward
+ * the commands of the FMS to it.
+ */
+void FMSSim_OpenStation(FMSSimStation *station, const DS_Transport *transport, const char *address,
+                        const int position, RobotSim *robot)
+{
+   assert(station);
+   assert(address);
+
+   memset(station, 0, sizeof(FMSSimStation));
+   station->robot = robot;
+   station->station = (uint8_t)(position % 6);
+
+   DS_Socket *empty = DS_SocketEmpty();
+   station->socket = *empty;
+   DS_FREE(empty);
+
+   station->socket.disabled = 0;
+   station->socket.in_port = FMS_PORT_IN;
+   station->socket.out_port = FMS_PORT_OUT;
+   station->socket.type = DS_SOCKET_UDP;
+   station->socket.transport = transport;
+   snprintf(station->socket.address, sizeof(station->socket.address), "%s", address);
+
+   DS_SocketOpen(&station->socket);
+}
+
+/**
+ * Closes the socket of the given \a station
+ */
+void FMSSim_CloseStation(FMSSimStation *station)
+{
+   assert(station);
+   DS_SocketClose(&station->socket);
+}
+
+/**
+ * Starts a match with the given \a stations, which follows the given
+ * \a script. The FMS sends a packet to each DS every \a interval
+ * milliseconds, and when a new phase begins.
+ */
+void FMSSim_Start(FMSSim *sim, FMSSimStation *stations, const int count, const FMSSimPhase *script,
+                  const int phases, const int interval)
+{
+   assert(sim);
+   assert(script);
+   assert(stations || count == 0);
+
+   memset(sim, 0, sizeof(FMSSim));
+   sim->stations = stations;
+   sim->station_count = count;
+   sim->interval = DS_Max(interval, 1);
+   sim->phase_count = DS_Min(phases, FMS_SIM_MAX_PHASES);
+   memcpy(sim->script, script, sim->phase_count * sizeof(FMSSimPhase));
+
+   if (sim->phase_count > 0)
+      begin_phase(sim, now());
+}
+
+/**
+ * Runs the match: sends the FMS packets that are due, reads the packets
+ * sent by each DS and checks if the robots reflect the current command.
+ * This function never blocks, the robots must be processed separately
+ * (see \c RobotSim_Process()).
+ *
+ * \returns \c 1 while the match is running, \c 0 once it has ended
+ */
+int FMSSim_Process(FMSSim *sim)
+{
+   assert(sim);
+
+   int i;
+   uint64_t timestamp = now();
+
+   /* Match has ended */
+   if (sim->phase >= sim->phase_count)
+      return 0;
+
+   /* Go to the next phase */
+   if (timestamp >= sim->phase_end)
+   {
+      end_phase(sim);
+      if (++sim->phase >= sim->phase_count)
+         return 0;
+
+      begin_phase(sim, timestamp);
+   }
+
+   /* Send the FMS packets */
+   if (timestamp >= sim->next_packet)
+   {
+      send_packets(sim);
+      sim->next_packet = timestamp + (uint64_t)sim->interval * 1000000ULL;
+   }
+
+   /* Read the DS packets and check the robots */
+   for (i = 0; i < sim->station_count; ++i)
+   {
+      read_ds_packets(&sim->stations[i]);
+      check_robot(sim, &sim->stations[i]);
+   }
+
+   return 1;
+}
+
+/**
+ * Prints the command propagation latency (from the FMS to the robot) that
+ * was measured in each phase of the match
+ */
+void FMSSim_Report(const FMSSim *sim)
+{
+   assert(sim);
+
+   int i;
+   printf("%-14s %8s %9s %9s %9s %9s %9s %9s\n", "Phase", "Robots", "Min (ms)", "Avg (ms)", "P99 (ms)", "Max (ms)",
+          "Timeouts", "Lost");
+
+   for (i = 0; i < sim->phase_count; ++i)
+   {
+      const FMSSimLatency *latency = &sim->latency[i];
+      if (latency->count == 0)
+      {
+         printf("%-14s %8u %9s %9s %9s %9s %9u %9u\n", sim->script[i].name, 0, "-", "-", "-", "-", latency->timeouts,
+                latency->lost);
+         continue;
+      }
+
+      /* Sort a copy of the samples to get the percentiles */
+      unsigned int j;
+      double sum = 0;
+      double *sorted = (double *)malloc(latency->count * sizeof(double));
+      if (!sorted)
+         continue;
+
+      memcpy(sorted, latency->samples, latency->count * sizeof(double));
+      qsort(sorted, latency->count, sizeof(double), &compare_samples);
+      for (j = 0; j < latency->count; ++j)
+         sum += sorted[j];
+
+      unsigned int p99 = (latency->count * 99 + 99) / 100 - 1;
+      printf("%-14s %8u %9.3f %9.3f %9.3f %9.3f %9u %9u\n", sim->script[i].name, latency->count, sorted[0],
+             sum / latency->count, sorted[p99], sorted[latency->count - 1], latency->timeouts, latency->lost);
+
+      free(sorted);
+   }
+}
+
+/**
+ * Releases the latency samples of the given match
+ */
+void FMSSim_Free(FMSSim *sim)
+{
+   assert(sim);
+
+   int i;
+   for (i = 0; i < FMS_SIM_MAX_PHASES; ++i)
+   {
+      DS_FREE(sim->latency[i].samples);
+      sim->latency[i].count = 0;
+      sim->latency[i].capacity = 0;
+   }
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _FMS_SIM_H
+#define _FMS_SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <LibDS.h>
+#include <robot_sim.h>
+
+/*
+ * Maximum number of phases in a match script
+ */
+#define FMS_SIM_MAX_PHASES 16
+
+/*
+ * Control code flags sent by the FMS
+ */
+#define FMS_SIM_TELEOPERATED 0x00
+#define FMS_SIM_TEST 0x01
+#define FMS_SIM_AUTONOMOUS 0x02
+#define FMS_SIM_ENABLED 0x04
+#define FMS_SIM_EMERGENCY_STOP 0x80
+
+/**
+ * A step of the match script, during which the FMS sends the same control
+ * code to every driver station
+ */
+typedef struct
+{
+   const char *name; /**< Name of the phase (e.g. "Autonomous") */
+   int duration; /**< Duration of the phase (in milliseconds) */
+   uint8_t control; /**< Control code sent during the phase */
+} FMSSimPhase;
+
+/**
+ * Link between the FMS and a driver station
+ */
+typedef struct
+{
+   DS_Socket socket; /**< Exchanges packets with the DS */
+   RobotSim *robot; /**< Robot of the DS, used to measure latency (may be \c NULL) */
+   uint8_t station; /**< Team station assigned to the DS */
+   int team; /**< Team number reported by the DS */
+   uint8_t ds_status; /**< Last control code reported by the DS */
+   int command_pending; /**< 1 until the robot reflects the current command */
+   int command_reflected; /**< 1 while the robot reflects the current command */
+   uint64_t command_time; /**< Time at which the current command was sent */
+   unsigned long sent_packets; /**< Packets sent to the DS */
+   unsigned long received_packets; /**< Packets received from the DS */
+} FMSSimStation;
+
+/**
+ * Time that the robots took to reflect the command of a phase
+ */
+typedef struct
+{
+   double *samples; /**< Latency of each robot (in milliseconds) */
+   unsigned int count; /**< Number of values in \a samples */
+   unsigned int capacity; /**< Number of values that fit in \a samples */
+   unsigned int timeouts; /**< Robots that did not reflect the command before the phase ended */
+   unsigned int lost; /**< Robots that stopped reflecting the command before the phase ended */
+} FMSSimLatency;
+
+/**
+ * Holds the state of a match driven by the simulated FMS
+ */
+typedef struct
+{
+   FMSSimPhase script[FMS_SIM_MAX_PHASES]; /**< Phases of the match */
+   int phase_count; /**< Number of phases in \a script */
+   int phase; /**< Index of the current phase */
+   int interval; /**< Time between the packets sent to each DS (in milliseconds) */
+   uint64_t phase_end; /**< Time at which the current phase ends */
+   uint64_t next_packet; /**< Time at which the next packets are sent */
+   uint16_t packet_index; /**< Index of the next FMS packet */
+   int station_count; /**< Number of stations in \a stations */
+   FMSSimStation *stations; /**< Driver stations in the match */
+   FMSSimLatency latency[FMS_SIM_MAX_PHASES]; /**< Latency measured in each phase */
+} FMSSim;
+
+extern int FMSSim_DefaultScript(FMSSimPhase *script, const double scale);
+
+extern void FMSSim_OpenStation(FMSSimStation *station, const DS_Transport *transport, const char *address,
+                               const int position, RobotSim *robot);
+extern void FMSSim_CloseStation(FMSSimStation *station);
+
+extern void FMSSim_Start(FMSSim *sim, FMSSimStation *stations, const int count, const FMSSimPhase *script,
+                         const int phases, const int interval);
+extern int FMSSim_Process(FMSSim *sim);
+extern void FMSSim_Report(const FMSSim *sim);
+extern void FMSSim_Free(FMSSim *sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
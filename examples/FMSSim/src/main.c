@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "fms_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Time given to the robots to connect with their DS before the match starts
+ */
+#define CONNECT_TIMEOUT 5000
+
+/**
+ * Options given in the command line
+ */
+typedef struct
+{
+   int stations; /**< Number of DS in the match */
+   int protocol; /**< Protocol year (2015, 2016 or 2020) */
+   int interval; /**< Time between FMS packets (in milliseconds) */
+   double scale; /**< Multiplier of the phase durations */
+   const char *address; /**< Address of an external DS (or \c NULL) */
+} Options;
+
+/**
+ * A DS (running in this process) and its robot
+ */
+typedef struct
+{
+   DS_Context *context;
+   RobotSim robot;
+   char ds_name[32];
+   char fms_name[32];
+   char robot_name[32];
+} Team;
+
+/**
+ * Prints the command line options of the simulator
+ */
+static void usage(const char *name)
+{
+   printf("Usage: %s [options]\n\n", name);
+   printf("  --stations N       Number of DS in the match (default: 6)\n");
+   printf("  --protocol YEAR    Protocol used by the DS and robots (2015, 2016 or 2020)\n");
+   printf("  --interval MS      Time between the packets sent to each DS (default: 250)\n");
+   printf("  --scale FACTOR     Multiplies the duration of each phase (default: 1)\n");
+   printf("  --network HOST     Drive an external DS over the network instead\n");
+}
+
+/**
+ * Reads the command line options into the given \a options
+ *
+ * \returns \c 1 if the options are valid
+ */
+static int read_options(int argc, char **argv, Options *options)
+{
+   options->stations = 6;
+   options->protocol = 2020;
+   options->interval = 250;
+   options->scale = 1;
+   options->address = NULL;
+
+   int i;
+   for (i = 1; i + 1 < argc; i += 2)
+   {
+      const char *option = argv[i];
+      const char *value = argv[i + 1];
+
+      if (strcmp(option, "--stations") == 0)
+         options->stations = atoi(value);
+      else if (strcmp(option, "--protocol") == 0)
+         options->protocol = atoi(value);
+      else if (strcmp(option, "--interval") == 0)
+         options->interval = atoi(value);
+      else if (strcmp(option, "--scale") == 0)
+         options->scale = atof(value);
+      else if (strcmp(option, "--network") == 0)
+         options->address = value;
+      else
+         return 0;
+   }
+
+   /* An option is missing its value */
+   if (i < argc)
+      return 0;
+
+   /* An external DS can only be assigned one station */
+   if (options->address)
+      options->stations = 1;
+
+   return options->stations > 0 && options->interval > 0 && options->scale > 0
+          && (options->protocol == 2015 || options->protocol == 2016 || options->protocol == 2020);
+}
+
+/**
+ * Returns the given protocol
+ */
+static DS_Protocol get_protocol(const int year)
+{
+   if (year == 2015)
+      return DS_GetProtocolFRC_2015();
+   if (year == 2016)
+      return DS_GetProtocolFRC_2016();
+
+   return DS_GetProtocolFRC_2020();
+}
+
+/**
+ * Creates the DS and robot of the given \a team, which exchange their
+ * packets (and those of the FMS) through the loopback transport
+ */
+static void open_team(Team *team, const int index, const Options *options)
+{
+   snprintf(team->ds_name, sizeof(team->ds_name), "ds-%d", index);
+   snprintf(team->fms_name, sizeof(team->fms_name), "fms-%d", index);
+   snprintf(team->robot_name, sizeof(team->robot_name), "robot-%d", index);
+
+   /* Create the DS */
+   DS_Protocol protocol = get_protocol(options->protocol);
+   team->context = DS_ContextNew();
+   DS_ContextSetTeamNumber(team->context, 1000 + index);
+   DS_ContextSetTransport(team->context, DS_LoopbackTransport(team->ds_name));
+   DS_ContextSetCustomFMSAddress(team->context, team->fms_name);
+   DS_ContextSetCustomRobotAddress(team->context, team->robot_name);
+   DS_ContextConfigureProtocol(team->context, &protocol);
+
+   /* Create the robot */
+   RobotSimConfig config;
+   RobotSim_DefaultConfig(&config);
+   config.protocol = options->protocol;
+   config.address = team->ds_name;
+   config.transport = DS_LoopbackTransport(team->robot_name);
+   RobotSim_Open(&team->robot, &config);
+}
+
+/**
+ * Discards the events of the DS of the given \a team
+ */
+static void drain_events(Team *team)
+{
+   DS_Event event;
+   while (DS_ContextPollEvent(team->context, &event))
+   {
+      if (event.type == DS_NETCONSOLE_NEW_MESSAGE)
+         DS_FREE(event.netconsole.message);
+   }
+}
+
+/**
+ * Replies to the packets sent to every robot, waiting up to \a timeout
+ * milliseconds for new packets
+ */
+static void process_robots(Team *teams, RobotSim *robot, const int count, const int timeout)
+{
+   int i;
+
+   /* Wait for the DS to talk with the (first) robot */
+   DS_SocketWait(teams ? &teams[0].robot.robot_socket : &robot->robot_socket, timeout);
+
+   /* Answer every robot, and discard the events of its DS */
+   if (robot)
+      RobotSim_Process(robot);
+
+   for (i = 0; teams && i < count; ++i)
+   {
+      RobotSim_Process(&teams[i].robot);
+      drain_events(&teams[i]);
+   }
+}
+
+/**
+ * Returns \c 1 once every robot is talking with its DS
+ */
+static int robots_connected(Team *teams, RobotSim *robot, const int count)
+{
+   int i;
+   if (robot)
+      return robot->sent_packets > 0;
+
+   for (i = 0; i < count; ++i)
+   {
+      if (!DS_ContextGetRobotCommunications(teams[i].context))
+         return 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Main entry point of the application
+ */
+int main(int argc, char **argv)
+{
+   /* Read the command line options */
+   Options options;
+   if (!read_options(argc, argv, &options))
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   /* Initialize LibDS */
+   DS_Init();
+
+   int i;
+   Team *teams = NULL;
+   RobotSim *robot = NULL;
+   FMSSimStation *stations = (FMSSimStation *)calloc(options.stations, sizeof(FMSSimStation));
+
+   /* Talk to an external DS (and act as its robot) */
+   if (options.address)
+   {
+      RobotSimConfig config;
+      RobotSim_DefaultConfig(&config);
+      config.protocol = options.protocol;
+      config.address = options.address;
+
+      robot = (RobotSim *)calloc(1, sizeof(RobotSim));
+      RobotSim_Open(robot, &config);
+      FMSSim_OpenStation(&stations[0], NULL, options.address, 0, robot);
+   }
+
+   /* Create the DS and robots in this process */
+   else
+   {
+      teams = (Team *)calloc(options.stations, sizeof(Team));
+      for (i = 0; i < options.stations; ++i)
+      {
+         open_team(&teams[i], i, &options);
+         FMSSim_OpenStation(&stations[i], DS_LoopbackTransport(teams[i].fms_name), teams[i].ds_name, i,
+                            &teams[i].robot);
+      }
+   }
+
+   /* Wait for the robots to connect */
+   uint64_t deadline = DS_GetMonotonicTime() + (uint64_t)CONNECT_TIMEOUT * 1000000ULL;
+   while (!robots_connected(teams, robot, options.stations) && DS_GetMonotonicTime() < deadline)
+      process_robots(teams, robot, options.stations, 10);
+
+   /* Run the match */
+   FMSSim sim;
+   FMSSimPhase script[FMS_SIM_MAX_PHASES];
+   int phases = FMSSim_DefaultScript(script, options.scale);
+   printf("Running a match with %d DS (FRC %d protocol)\n", options.stations, options.protocol);
+   FMSSim_Start(&sim, stations, options.stations, script, phases, options.interval);
+   while (FMSSim_Process(&sim))
+      process_robots(teams, robot, options.stations, 1);
+
+   /* Show the FMS -> DS -> robot latency of each phase */
+   FMSSim_Report(&sim);
+   FMSSim_Free(&sim);
+
+   /* Close the stations, robots and DS */
+   for (i = 0; i < options.stations; ++i)
+   {
+      FMSSim_CloseStation(&stations[i]);
+      if (teams)
+      {
+         RobotSim_Close(&teams[i].robot);
+         DS_ContextFree(teams[i].context);
+      }
+   }
+
+   if (robot)
+      RobotSim_Close(robot);
+
+   DS_FREE(teams);
+   DS_FREE(robot);
+   DS_FREE(stations);
+   DS_Close();
+
+   return EXIT_SUCCESS;
+}
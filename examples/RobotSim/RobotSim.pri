@@ -0,0 +1,11 @@
+#-------------------------------------------------------------------------------
+# Robot simulator sources (can be included by other projects, e.g. benchmarks)
+#-------------------------------------------------------------------------------
+
+INCLUDEPATH += $$PWD/src
+
+HEADERS += \
+    $$PWD/src/robot_sim.h
+
+SOURCES += \
+    $$PWD/src/robot_sim.c
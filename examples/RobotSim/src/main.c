@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "robot_sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+static volatile sig_atomic_t running = 1;
+
+/**
+ * Stops the simulator when the user presses Ctrl+C
+ */
+static void stop(int signal)
+{
+   (void)signal;
+   running = 0;
+}
+
+/**
+ * Prints the command line options of the simulator
+ */
+static void usage(const char *name)
+{
+   printf("Usage: %s [options]\n\n", name);
+   printf("  --protocol YEAR    Protocol to speak (2015, 2016 or 2020)\n");
+   printf("  --address HOST     Address of the DS (default: 127.0.0.1)\n");
+   printf("  --voltage VOLTS    Reported battery voltage\n");
+   printf("  --cpu PERCENT      Reported CPU usage\n");
+   printf("  --ram PERCENT      Reported RAM usage\n");
+   printf("  --disk PERCENT     Reported disk usage\n");
+   printf("  --can PERCENT      Reported CAN utilization\n");
+   printf("  --extended N       Send an extended tag every N packets (0 to disable)\n");
+   printf("  --netconsole RATE  NetConsole messages per second (0 to disable)\n");
+   printf("  --no-code          Report that the robot code is not running\n");
+   printf("  --no-time          Do not request the date/time from the DS\n");
+}
+
+/**
+ * Reads the command line options into the given \a config
+ *
+ * \returns \c 1 if the options are valid
+ */
+static int read_options(int argc, char **argv, RobotSimConfig *config)
+{
+   int i;
+   for (i = 1; i < argc; ++i)
+   {
+      const char *option = argv[i];
+
+      /* Options without a value */
+      if (strcmp(option, "--no-code") == 0)
+      {
+         config->has_code = 0;
+         continue;
+      }
+      else if (strcmp(option, "--no-time") == 0)
+      {
+         config->request_time = 0;
+         continue;
+      }
+
+      /* The other options need a value */
+      if (i + 1 >= argc)
+         return 0;
+
+      const char *value = argv[++i];
+      if (strcmp(option, "--protocol") == 0)
+         config->protocol = atoi(value);
+      else if (strcmp(option, "--address") == 0)
+         config->address = value;
+      else if (strcmp(option, "--voltage") == 0)
+         config->voltage = (float)atof(value);
+      else if (strcmp(option, "--cpu") == 0)
+         config->cpu_usage = atoi(value);
+      else if (strcmp(option, "--ram") == 0)
+         config->ram_usage = atoi(value);
+      else if (strcmp(option, "--disk") == 0)
+         config->disk_usage = atoi(value);
+      else if (strcmp(option, "--can") == 0)
+         config->can_usage = atoi(value);
+      else if (strcmp(option, "--extended") == 0)
+         config->extended_interval = atoi(value);
+      else if (strcmp(option, "--netconsole") == 0)
+         config->netconsole_rate = atoi(value);
+      else
+         return 0;
+   }
+
+   return config->protocol == 2015 || config->protocol == 2016 || config->protocol == 2020;
+}
+
+/**
+ * Prints the state of the simulated robot
+ */
+static void print_status(const RobotSim *sim)
+{
+   printf("rx=%lu tx=%lu netconsole=%lu control=0x%02x station=%d joysticks=%d%s%s\n", sim->received_packets,
+          sim->sent_packets, sim->netconsole_messages, sim->control, sim->station, sim->joystick_count,
+          sim->estopped ? " e-stopped" : "", sim->time_received ? "" : " waiting-for-time");
+   fflush(stdout);
+}
+
+/**
+ * Main entry point of the application
+ */
+int main(int argc, char **argv)
+{
+   /* Read the command line options */
+   RobotSimConfig config;
+   RobotSim_DefaultConfig(&config);
+   if (!read_options(argc, argv, &config))
+   {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+   }
+
+   /* Initialize LibDS (which reads the sockets) and the simulator */
+   DS_Init();
+   RobotSim sim;
+   RobotSim_Open(&sim, &config);
+   signal(SIGINT, &stop);
+   signal(SIGTERM, &stop);
+
+   /* Reply to the DS and print the robot state every second */
+   printf("Simulating a FRC %d robot, talking to the DS at %s\n", config.protocol, config.address);
+   uint64_t next_status = DS_GetMonotonicTime();
+   while (running)
+   {
+      RobotSim_Wait(&sim, 100);
+
+      if (DS_GetMonotonicTime() >= next_status)
+      {
+         print_status(&sim);
+         next_status += 1000000000ULL;
+      }
+   }
+
+   /* Close the simulator */
+   RobotSim_Close(&sim);
+   DS_Close();
+
+   return EXIT_SUCCESS;
+}
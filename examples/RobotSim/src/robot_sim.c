@@ -0,0 +1,533 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "robot_sim.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+/*
+ * Ports used by the robot side of the FRC 2015/2016/2020 protocols
+ */
+#define ROBOT_PORT_IN 1110
+#define ROBOT_PORT_OUT 1150
+#define NETCONSOLE_PORT_IN 6668
+#define NETCONSOLE_PORT_OUT 6666
+
+/*
+ * Maximum number of NetConsole messages sent in a single call to
+ * RobotSim_Process() (to catch up after a long pause)
+ */
+#define MAX_MESSAGE_BURST 100
+
+/*
+ * Protocol bytes (as seen from the robot side)
+ */
+static const uint8_t cEnabled = 0x04;
+static const uint8_t cEmergencyStop = 0x80;
+static const uint8_t cRequestReboot = 0x08;
+static const uint8_t cRequestRestartCode = 0x04;
+static const uint8_t cCommVersion = 0x01;
+static const uint8_t cTagDate = 0x0f;
+static const uint8_t cTagJoystick = 0x0c;
+static const uint8_t cTagTimezone = 0x10;
+static const uint8_t cRTagCANInfo = 0x0e;
+static const uint8_t cRTagCPUInfo = 0x05;
+static const uint8_t cRTagRAMInfo = 0x06;
+static const uint8_t cRTagDiskInfo = 0x04;
+static const uint8_t cRequestTime = 0x01;
+static const uint8_t cRobotHasCode = 0x20;
+
+/*
+ * Size (in bytes) of the RAM and disk of the simulated roboRIO
+ */
+static const float max_ram_bytes = 256000000;
+static const float max_disk_bytes = 512000000;
+
+/**
+ * Returns the current time of the simulator (in nanoseconds)
+ */
+static uint64_t now(void)
+{
+   return DS_GetMonotonicTime();
+}
+
+/**
+ * Converts the given number of milliseconds to nanoseconds
+ */
+static uint64_t ms_to_ns(const int ms)
+{
+   return (uint64_t)ms * 1000000ULL;
+}
+
+/**
+ * Writes the given \a value into \a out. The floats are written in the byte
+ * order in which LibDS reads them (see \c extract_float() in frc_2020.c)
+ */
+static void write_float(uint8_t *out, const float value)
+{
+   memcpy(out, &value, sizeof(value));
+}
+
+/**
+ * Initializes the given \a socket to send data to the DS from the
+ * \a in_port to the \a out_port of the DS
+ */
+static void init_socket(DS_Socket *socket, const RobotSimConfig *config, const int in_port, const int out_port)
+{
+   DS_Socket *empty = DS_SocketEmpty();
+   *socket = *empty;
+   DS_FREE(empty);
+
+   socket->disabled = 0;
+   socket->in_port = in_port;
+   socket->out_port = out_port;
+   socket->type = DS_SOCKET_UDP;
+   socket->transport = config->transport;
+
+   if (config->address)
+      snprintf(socket->address, sizeof(socket->address), "%s", config->address);
+}
+
+/**
+ * Reads the date/time and the timezone sent by the DS. The FRC 2020 protocol
+ * (as implemented by LibDS) places the tag before the size of each block.
+ *
+ * \returns \c 1 if the packet contained the date/time
+ */
+static int read_date(RobotSim *sim, const DS_ByteSpan *data)
+{
+   /* Get the position of the date/time block */
+   size_t date = 6;
+   int tag_first = (sim->config.protocol >= 2020);
+   if (DS_SpanU8(data, tag_first ? date : date + 1) != cTagDate)
+      return 0;
+
+   /* Get the position of the timezone block and of its string */
+   size_t timezone = tag_first ? date + 11 : date + 12;
+   size_t tag_pos = tag_first ? timezone : timezone + 1;
+   size_t tz_len = DS_SpanU8(data, tag_first ? timezone + 1 : timezone);
+
+   /* Copy the timezone string (if it is present) */
+   sim->timezone[0] = '\0';
+   if (DS_SpanU8(data, tag_pos) == cTagTimezone && timezone + 2 + tz_len <= data->n)
+   {
+      tz_len = DS_Min(tz_len, sizeof(sim->timezone) - 1);
+      memcpy(sim->timezone, data->p + timezone + 2, tz_len);
+      sim->timezone[tz_len] = '\0';
+   }
+
+   sim->time_received = 1;
+   return 1;
+}
+
+/**
+ * Reads the joystick tags of the given packet. The layout of each joystick
+ * is parsed instead of trusting its size byte, which LibDS calculates
+ * differently for each protocol.
+ *
+ * The \a time is the time at which the packet was received.
+ */
+static void read_joysticks(RobotSim *sim, const DS_ByteSpan *data, const uint64_t time)
+{
+   int i;
+   size_t pos = 6;
+   int count = 0;
+   RobotSimJoystick joysticks[ROBOT_SIM_MAX_JOYSTICKS];
+   memset(joysticks, 0, sizeof(joysticks));
+
+   while (count < ROBOT_SIM_MAX_JOYSTICKS && pos + 2 < data->n && DS_SpanU8(data, pos + 1) == cTagJoystick)
+   {
+      RobotSimJoystick *joystick = &joysticks[count];
+      size_t p = pos + 2;
+
+      /* Get axis data */
+      int num_axes = DS_SpanU8(data, p++);
+      joystick->num_axes = DS_Min(num_axes, ROBOT_SIM_MAX_AXES);
+      for (i = 0; i < num_axes; ++i, ++p)
+      {
+         if (i < ROBOT_SIM_MAX_AXES)
+            joystick->axes[i] = (float)(int8_t)DS_SpanU8(data, p) / 127;
+      }
+
+      /* Get button data */
+      joystick->num_buttons = DS_SpanU8(data, p++);
+      joystick->buttons = DS_SpanU16(data, p);
+      p += 2;
+
+      /* Get hat data */
+      int num_hats = DS_SpanU8(data, p++);
+      joystick->num_hats = DS_Min(num_hats, ROBOT_SIM_MAX_HATS);
+      for (i = 0; i < num_hats; ++i, p += 2)
+      {
+         if (i < ROBOT_SIM_MAX_HATS)
+            joystick->hats[i] = (int16_t)DS_SpanU16(data, p);
+      }
+
+      /* Joystick was truncated */
+      if (p > data->n)
+         break;
+
+      pos = p;
+      ++count;
+   }
+
+   /* Remember when the DS changed the joystick values */
+   size_t size = (size_t)count * sizeof(RobotSimJoystick);
+   if (count != sim->joystick_count || memcmp(joysticks, sim->joysticks, size) != 0)
+      sim->joystick_time = time;
+
+   memcpy(sim->joysticks, joysticks, size);
+   sim->joystick_count = count;
+}
+
+/**
+ * Reboots the simulated robot, which stops replying to the DS for
+ * \c ROBOT_SIM_REBOOT_TIME milliseconds and forgets its state
+ */
+static void reboot(RobotSim *sim)
+{
+   sim->estopped = 0;
+   sim->time_received = 0;
+   sim->joystick_count = 0;
+   sim->reboot_end = now() + ms_to_ns(ROBOT_SIM_REBOOT_TIME);
+   sim->restart_end = sim->reboot_end + ms_to_ns(ROBOT_SIM_RESTART_TIME);
+}
+
+/**
+ * Interprets a packet sent by the DS, which contains:
+ *    - The control code (control mode, enabled state and e-stop)
+ *    - The request code (reboot or restart the robot code)
+ *    - The team station
+ *    - The date/time (if the robot asked for it) or the joystick values
+ *
+ * The \a time is the time at which the packet was received.
+ *
+ * \returns \c 1 if the packet is valid
+ */
+static int read_ds_packet(RobotSim *sim, const DS_ByteSpan *data, const uint64_t time)
+{
+   /* Packet is too small */
+   if (data->n < 6)
+      return 0;
+
+   uint8_t control = DS_SpanU8(data, 3);
+   uint8_t request = DS_SpanU8(data, 4);
+
+   /* The e-stop state is latched until the robot reboots */
+   if (control & cEmergencyStop)
+      sim->estopped = 1;
+
+   /* The DS repeats its requests, only react when they are set */
+   uint8_t requested = request & ~sim->request;
+   if (requested & cRequestReboot)
+      reboot(sim);
+   else if (requested & cRequestRestartCode)
+      sim->restart_end = now() + ms_to_ns(ROBOT_SIM_RESTART_TIME);
+
+   /* Remember when the DS changed the control code or team station */
+   uint8_t station = DS_SpanU8(data, 5);
+   if (control != sim->control || station != sim->station)
+      sim->control_time = time;
+
+   sim->control = control;
+   sim->request = request;
+   sim->station = station;
+
+   /* Read the date/time or the joystick data */
+   if (!read_date(sim, data))
+      read_joysticks(sim, data, time);
+
+   return 1;
+}
+
+/**
+ * Writes the next extended tag (CAN, CPU, RAM or disk information) into the
+ * given \a out buffer
+ *
+ * \returns the number of written bytes
+ */
+static size_t encode_extended(RobotSim *sim, uint8_t *out)
+{
+   int i;
+   size_t len = 0;
+
+   switch (sim->extended_tag++ % 4)
+   {
+      /* CAN utilization, bus-off count, TX full count, RX and TX errors */
+      case 0:
+         memset(out, 0, 16);
+         out[1] = cRTagCANInfo;
+         write_float(out + 2, (float)sim->config.can_usage);
+         len = 16;
+         break;
+
+      /* Number of CPUs, then the time spent in each priority by each CPU */
+      case 1:
+         out[1] = cRTagCPUInfo;
+         write_float(out + 2, 2);
+         for (i = 0; i < 2; ++i)
+         {
+            write_float(out + 6 + (i * 16), 0);
+            write_float(out + 10 + (i * 16), 0);
+            write_float(out + 14 + (i * 16), (float)sim->config.cpu_usage);
+            write_float(out + 18 + (i * 16), (float)(100 - sim->config.cpu_usage));
+         }
+         len = 38;
+         break;
+
+      /* RAM block size and free RAM */
+      case 2:
+         out[1] = cRTagRAMInfo;
+         write_float(out + 2, max_ram_bytes);
+         write_float(out + 6, max_ram_bytes * (100 - sim->config.ram_usage) / 100);
+         len = 10;
+         break;
+
+      /* Free disk space */
+      default:
+         out[1] = cRTagDiskInfo;
+         write_float(out + 2, max_disk_bytes * (100 - sim->config.disk_usage) / 100);
+         len = 6;
+         break;
+   }
+
+   /* The size does not include the size byte itself */
+   out[0] = (uint8_t)(len - 1);
+   return len;
+}
+
+/**
+ * Writes the reply to the DS packet with the given \a index, it contains:
+ *    - The packet index (echoed from the DS packet)
+ *    - The control code (echoed, with the e-stop state of the robot)
+ *    - The robot code status
+ *    - The battery voltage
+ *    - The date/time request flag
+ *    - An extended tag (every \c extended_interval packets)
+ *
+ * \returns the length of the packet
+ */
+static size_t encode_robot_packet(RobotSim *sim, const uint16_t index, uint8_t *out)
+{
+   /* Add packet index and comm version */
+   out[0] = (uint8_t)(index >> 8);
+   out[1] = (uint8_t)(index);
+   out[2] = cCommVersion;
+
+   /* An e-stopped robot cannot be enabled */
+   uint8_t control = sim->control;
+   if (sim->estopped)
+      control = (control | cEmergencyStop) & ~cEnabled;
+
+   /* Add control code and robot code status */
+   out[3] = control;
+   out[4] = 0;
+   if (sim->config.has_code && now() >= sim->restart_end)
+      out[4] |= cRobotHasCode;
+
+   /* Add battery voltage (and remember when it was first reported) */
+   float voltage = DS_Max(sim->config.voltage, 0);
+   if (voltage != sim->reported_voltage || sim->voltage_time == 0)
+   {
+      sim->voltage_time = now();
+      sim->reported_voltage = voltage;
+   }
+
+   out[5] = (uint8_t)voltage;
+   out[6] = (uint8_t)DS_Min((voltage - (int)voltage) * 0xff + 0.5f, 0xff);
+
+   /* Ask for the date/time until the DS sends it */
+   out[7] = 0;
+   if (sim->config.request_time && !sim->time_received)
+      out[7] = cRequestTime;
+
+   /* Add extended information */
+   size_t len = 8;
+   if (sim->config.extended_interval > 0 && (sim->sent_packets % sim->config.extended_interval) == 0)
+      len += encode_extended(sim, out + len);
+
+   return len;
+}
+
+/**
+ * Sends the NetConsole messages that are due at the given \a time
+ */
+static void send_messages(RobotSim *sim, const uint64_t time)
+{
+   if (sim->config.netconsole_rate <= 0)
+      return;
+
+   /* Do not try to catch up after a long pause */
+   if (time > sim->next_message + ms_to_ns(1000))
+      sim->next_message = time;
+
+   int burst = 0;
+   char message[64];
+   uint64_t interval = 1000000000ULL / (uint64_t)sim->config.netconsole_rate;
+   while (time >= sim->next_message && burst < MAX_MESSAGE_BURST)
+   {
+      int len = snprintf(message, sizeof(message), "RobotSim: message %lu\n", sim->netconsole_messages);
+      DS_SocketSendBytes(&sim->netconsole_socket, message, (size_t)len);
+
+      ++burst;
+      ++sim->netconsole_messages;
+      sim->next_message += interval;
+   }
+}
+
+/**
+ * Fills the given \a config with the default behaviour of the simulator:
+ * a robot running the FRC 2020 protocol on the local computer, with its
+ * robot code running and reporting extended information twice a second
+ */
+void RobotSim_DefaultConfig(RobotSimConfig *config)
+{
+   assert(config);
+
+   config->protocol = 2020;
+   config->address = "127.0.0.1";
+   config->transport = NULL;
+   config->voltage = 12.5f;
+   config->cpu_usage = 25;
+   config->ram_usage = 40;
+   config->disk_usage = 30;
+   config->can_usage = 10;
+   config->has_code = 1;
+   config->request_time = 1;
+   config->extended_interval = 25;
+   config->netconsole_rate = 1;
+   config->packet_received = NULL;
+   config->packet_data = NULL;
+}
+
+/**
+ * Opens the sockets of the given robot simulator, which will reply to the
+ * packets sent by the DS once \c RobotSim_Process() or \c RobotSim_Wait()
+ * are called.
+ *
+ * \note \c DS_Init() must be called before this function
+ */
+void RobotSim_Open(RobotSim *sim, const RobotSimConfig *config)
+{
+   assert(sim);
+   assert(config);
+
+   memset(sim, 0, sizeof(RobotSim));
+   sim->config = *config;
+   sim->next_message = now();
+
+   init_socket(&sim->robot_socket, config, ROBOT_PORT_IN, ROBOT_PORT_OUT);
+   init_socket(&sim->netconsole_socket, config, NETCONSOLE_PORT_IN, NETCONSOLE_PORT_OUT);
+
+   DS_SocketOpen(&sim->robot_socket);
+   DS_SocketOpen(&sim->netconsole_socket);
+}
+
+/**
+ * Closes the sockets of the given robot simulator
+ */
+void RobotSim_Close(RobotSim *sim)
+{
+   assert(sim);
+
+   DS_SocketClose(&sim->robot_socket);
+   DS_SocketClose(&sim->netconsole_socket);
+}
+
+/**
+ * Replies to every packet that the DS has sent to the simulated robot and
+ * sends the NetConsole messages that are due. This function never blocks.
+ *
+ * \returns the number of packets that were answered
+ */
+int RobotSim_Process(RobotSim *sim)
+{
+   assert(sim);
+
+   int replies = 0;
+   DS_ByteSpan span;
+   uint8_t packet[DS_PACKET_BUFFER_SIZE];
+
+   /* Reply to the DS packets (unless we are rebooting) */
+   while (DS_SocketPeek(&sim->robot_socket, &span))
+   {
+      ++sim->received_packets;
+      uint64_t time = DS_SocketTimestamp(&sim->robot_socket);
+      if (sim->config.packet_received)
+         sim->config.packet_received(sim->config.packet_data, time);
+
+      if (now() >= sim->reboot_end && read_ds_packet(sim, &span, time))
+      {
+         /* The packet may have asked the robot to reboot */
+         if (now() >= sim->reboot_end)
+         {
+            size_t len = encode_robot_packet(sim, DS_SpanU16(&span, 0), packet);
+            if (DS_SocketSendBytes(&sim->robot_socket, packet, len) > 0)
+               ++sim->sent_packets;
+
+            ++replies;
+         }
+      }
+
+      DS_SocketRelease(&sim->robot_socket);
+   }
+
+   /* Discard the NetConsole messages sent by the DS */
+   while (DS_SocketPeek(&sim->netconsole_socket, &span))
+      DS_SocketRelease(&sim->netconsole_socket);
+
+   /* Send the pending NetConsole messages */
+   send_messages(sim, now());
+
+   return replies;
+}
+
+/**
+ * Waits until the DS sends a packet to the simulated robot (or until
+ * \a timeout milliseconds have passed, or a NetConsole message is due)
+ * and then calls \c RobotSim_Process().
+ *
+ * A negative \a timeout waits indefinitely.
+ *
+ * \returns the number of packets that were answered
+ */
+int RobotSim_Wait(RobotSim *sim, const int timeout)
+{
+   assert(sim);
+
+   /* Wake up in time to send the next NetConsole message */
+   int wait = timeout;
+   if (sim->config.netconsole_rate > 0)
+   {
+      uint64_t time = now();
+      int due = 0;
+      if (sim->next_message > time)
+         due = (int)((sim->next_message - time + 999999ULL) / 1000000ULL);
+
+      wait = (timeout < 0) ? due : DS_Min(timeout, due);
+   }
+
+   DS_SocketWait(&sim->robot_socket, wait);
+   return RobotSim_Process(sim);
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _ROBOT_SIM_H
+#define _ROBOT_SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <LibDS.h>
+
+/*
+ * Limits of the joystick data decoded by the simulator
+ */
+#define ROBOT_SIM_MAX_JOYSTICKS 6
+#define ROBOT_SIM_MAX_AXES 12
+#define ROBOT_SIM_MAX_HATS 4
+
+/*
+ * Time (in milliseconds) that the simulated robot needs to reboot, and
+ * to restart its robot code
+ */
+#define ROBOT_SIM_REBOOT_TIME 2000
+#define ROBOT_SIM_RESTART_TIME 1000
+
+/**
+ * Joystick values decoded from the packets sent by the DS
+ */
+typedef struct
+{
+   int num_axes; /**< Number of axes in \a axes */
+   int num_hats; /**< Number of hats in \a hats */
+   int num_buttons; /**< Number of buttons in \a buttons */
+   float axes[ROBOT_SIM_MAX_AXES]; /**< Axis values (from -1 to 1) */
+   int hats[ROBOT_SIM_MAX_HATS]; /**< Hat angles (or -1) */
+   uint32_t buttons; /**< Pressed buttons (bit N is button N) */
+} RobotSimJoystick;
+
+/**
+ * Behaviour of the simulated robot, see \c RobotSim_DefaultConfig()
+ */
+typedef struct
+{
+   int protocol; /**< Protocol year (2015, 2016 or 2020) */
+   const char *address; /**< Address of the DS */
+   const DS_Transport *transport; /**< Transport of the sockets (\c NULL for the network) */
+   float voltage; /**< Reported battery voltage */
+   int cpu_usage; /**< Reported CPU usage (in percent) */
+   int ram_usage; /**< Reported RAM usage (in percent) */
+   int disk_usage; /**< Reported disk usage (in percent) */
+   int can_usage; /**< Reported CAN utilization (in percent) */
+   int has_code; /**< 1 if the robot code is running */
+   int request_time; /**< 1 to request the date/time until the DS sends it */
+   int extended_interval; /**< Packets between extended (CPU/RAM/disk/CAN) tags, 0 to disable them */
+   int netconsole_rate; /**< NetConsole messages sent per second, 0 to disable them */
+   void (*packet_received)(void *data, const uint64_t time); /**< Called with the receive time of each DS packet */
+   void *packet_data; /**< Argument given to \a packet_received */
+} RobotSimConfig;
+
+/**
+ * Holds the sockets and the state of a simulated robot
+ */
+typedef struct
+{
+   RobotSimConfig config; /**< Behaviour of the robot */
+   DS_Socket robot_socket; /**< Exchanges packets with the DS */
+   DS_Socket netconsole_socket; /**< Sends NetConsole messages to the DS */
+
+   uint8_t control; /**< Last control code received from the DS */
+   uint8_t request; /**< Last request code received from the DS */
+   uint8_t station; /**< Last team station received from the DS */
+   uint64_t control_time; /**< Time at which the control code or the team station last changed */
+   int estopped; /**< Set when the DS e-stops the robot (cleared by a reboot) */
+   int time_received; /**< 1 once the DS has sent the date/time */
+   char timezone[32]; /**< Timezone sent by the DS */
+
+   int joystick_count; /**< Number of joysticks in \a joysticks */
+   RobotSimJoystick joysticks[ROBOT_SIM_MAX_JOYSTICKS]; /**< Joysticks sent by the DS */
+   uint64_t joystick_time; /**< Time at which the joystick values last changed */
+
+   float reported_voltage; /**< Voltage reported in the last reply */
+   uint64_t voltage_time; /**< Time at which the robot started to report \a reported_voltage */
+
+   uint64_t reboot_end; /**< The robot does not reply until this time */
+   uint64_t restart_end; /**< The robot code is not running until this time */
+   uint64_t next_message; /**< Time at which the next NetConsole message is sent */
+   unsigned int extended_tag; /**< Index of the next extended tag */
+
+   unsigned long received_packets; /**< Packets received from the DS */
+   unsigned long sent_packets; /**< Packets sent to the DS */
+   unsigned long netconsole_messages; /**< NetConsole messages sent to the DS */
+} RobotSim;
+
+extern void RobotSim_DefaultConfig(RobotSimConfig *config);
+
+extern void RobotSim_Open(RobotSim *sim, const RobotSimConfig *config);
+extern void RobotSim_Close(RobotSim *sim);
+
+extern int RobotSim_Process(RobotSim *sim);
+extern int RobotSim_Wait(RobotSim *sim, const int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_BYTE_SPAN_H
+#define _LIB_DS_BYTE_SPAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "DS_String.h"
+
+#if defined _MSC_VER && !defined __cplusplus
+#   define DS_INLINE __inline
+#else
+#   define DS_INLINE inline
+#endif
+
+/**
+ * Read-only view over a block of bytes (e.g. a received datagram), the
+ * view does not own the data and becomes invalid when the data is released
+ */
+typedef struct
+{
+   const uint8_t *p; /**< First byte of the view */
+   size_t n; /**< Number of bytes in the view */
+} DS_ByteSpan;
+
+/**
+ * Returns a view over the given \a len bytes of \a data
+ */
+static DS_INLINE DS_ByteSpan DS_SpanNew(const void *data, const size_t len)
+{
+   DS_ByteSpan span;
+   span.p = (const uint8_t *)data;
+   span.n = data ? len : 0;
+   return span;
+}
+
+/**
+ * Returns a view over the contents of the given \a string
+ */
+static DS_INLINE DS_ByteSpan DS_SpanFromStr(const DS_String *string)
+{
+   if (!string)
+      return DS_SpanNew(NULL, 0);
+
+   return DS_SpanNew(string->buf, string->len);
+}
+
+/**
+ * Returns a view over \a len bytes of the given \a span, starting at \a pos.
+ * The returned view is clamped to the bounds of \a span.
+ */
+static DS_INLINE DS_ByteSpan DS_SpanSub(const DS_ByteSpan *span, const size_t pos, const size_t len)
+{
+   if (!span || pos >= span->n)
+      return DS_SpanNew(NULL, 0);
+
+   return DS_SpanNew(span->p + pos, (len < span->n - pos) ? len : span->n - pos);
+}
+
+/**
+ * Returns the byte at the given \a pos, or \c 0 if \a pos is out of range
+ */
+static DS_INLINE uint8_t DS_SpanU8(const DS_ByteSpan *span, const size_t pos)
+{
+   if (span && pos < span->n)
+      return span->p[pos];
+
+   return 0;
+}
+
+/**
+ * Returns the big-endian 16-bit value at the given \a pos, bytes that are
+ * out of range are read as \c 0
+ */
+static DS_INLINE uint16_t DS_SpanU16(const DS_ByteSpan *span, const size_t pos)
+{
+   if (span && span->n >= 2 && pos <= span->n - 2)
+      return (uint16_t)((span->p[pos] << 8) | span->p[pos + 1]);
+
+   return (uint16_t)((DS_SpanU8(span, pos) << 8) | DS_SpanU8(span, pos + 1));
+}
+
+/**
+ * Returns the big-endian 32-bit value at the given \a pos, bytes that are
+ * out of range are read as \c 0
+ */
+static DS_INLINE uint32_t DS_SpanU32(const DS_ByteSpan *span, const size_t pos)
+{
+   return ((uint32_t)DS_SpanU16(span, pos) << 16) | DS_SpanU16(span, pos + 2);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -47,6 +47,10 @@ extern "C" {
 #define RECONFIGURE_ROBOT 0x04
 #define RECONFIGURE_ALL 0x01 | 0x02 | 0x04
 
+/* Init/Close functions */
+extern void CFG_Init(void);
+extern void CFG_Close(void);
+
 /* Misc */
 extern void CFG_ReconfigureAddresses(const int flags);
 
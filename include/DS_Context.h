@@ -0,0 +1,110 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_CONTEXT_H
+#define _LIB_DS_CONTEXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+
+#include "DS_Types.h"
+#include "DS_Events.h"
+#include "DS_Protocol.h"
+
+/**
+ * Holds the complete state of a driver station (protocol, sockets, timers,
+ * robot configuration, joysticks and events).
+ *
+ * The library creates a default context in \c DS_Init(), which is used by
+ * the rest of the API unless another context is made current for the
+ * calling thread with \c DS_SetCurrentContext(). Every context is serviced
+ * by the same protocol event loop thread.
+ */
+typedef struct _context DS_Context;
+
+/*
+ * Modules that keep their state inside a context
+ */
+typedef enum
+{
+   DS_CONTEXT_CLIENT,
+   DS_CONTEXT_CONFIG,
+   DS_CONTEXT_EVENTS,
+   DS_CONTEXT_JOYSTICKS,
+   DS_CONTEXT_PROTOCOLS,
+   DS_CONTEXT_MODULE_COUNT,
+} DS_ContextModule;
+
+/* Module functions */
+extern void Contexts_Init(void);
+extern void Contexts_Close(void);
+extern void Contexts_Lock(void);
+extern void Contexts_Unlock(void);
+extern void Contexts_ForEach(void (*func)(void));
+extern void Contexts_MarkReady(DS_Context *context);
+extern void Contexts_ForEachReady(void (*func)(void));
+extern void *Contexts_GetState(const DS_ContextModule module);
+extern void *Contexts_CreateState(const DS_ContextModule module, void *default_state, const size_t size);
+extern void Contexts_DestroyState(const DS_ContextModule module);
+
+/* Context management */
+extern DS_Context *DS_ContextNew(void);
+extern void DS_ContextFree(DS_Context *context);
+extern DS_Context *DS_DefaultContext(void);
+extern DS_Context *DS_CurrentContext(void);
+extern DS_Context *DS_SetCurrentContext(DS_Context *context);
+
+/* Context-taking variants of the most common functions */
+extern int DS_ContextPollEvent(DS_Context *context, DS_Event *event);
+extern int DS_ContextGetEventFd(DS_Context *context);
+extern void DS_ContextSetTransport(DS_Context *context, const DS_Transport *transport);
+extern void DS_ContextConfigureProtocol(DS_Context *context, const DS_Protocol *protocol);
+extern void DS_ContextSetTeamNumber(DS_Context *context, const int team);
+extern void DS_ContextSetRobotEnabled(DS_Context *context, const int enabled);
+extern void DS_ContextSetEmergencyStopped(DS_Context *context, const int stop);
+extern void DS_ContextSetAlliance(DS_Context *context, const DS_Alliance alliance);
+extern void DS_ContextSetPosition(DS_Context *context, const DS_Position position);
+extern void DS_ContextSetControlMode(DS_Context *context, const DS_ControlMode mode);
+extern void DS_ContextSetCustomFMSAddress(DS_Context *context, const char *address);
+extern void DS_ContextSetCustomRobotAddress(DS_Context *context, const char *address);
+extern int DS_ContextGetRobotCode(DS_Context *context);
+extern int DS_ContextGetRobotEnabled(DS_Context *context);
+extern float DS_ContextGetRobotVoltage(DS_Context *context);
+extern int DS_ContextGetFMSCommunications(DS_Context *context);
+extern int DS_ContextGetRobotCommunications(DS_Context *context);
+extern DS_LinkStats DS_ContextGetLinkStats(DS_Context *context, const DS_Link link);
+extern void DS_ContextJoysticksAdd(DS_Context *context, const int axes, const int hats, const int buttons);
+extern void DS_ContextSetJoystickHat(DS_Context *context, int joystick, int hat, int angle);
+extern void DS_ContextSetJoystickAxis(DS_Context *context, int joystick, int axis, float value);
+extern void DS_ContextSetJoystickButton(DS_Context *context, int joystick, int button, int pressed);
+extern void DS_ContextSetJoystickState(DS_Context *context, int joystick, const float *axes, uint64_t buttons,
+                                       const int16_t *hats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
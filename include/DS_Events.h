@@ -30,6 +30,7 @@ extern "C" {
 
 #include <stdint.h>
 #include "DS_Types.h"
+#include "DS_LinkStats.h"
 
 /**
  * \brief The types of events that can be delivered.
@@ -55,6 +56,7 @@ typedef enum
    DS_ROBOT_STATION_CHANGED = 0x16,
    DS_ROBOT_ESTOP_CHANGED = 0x17,
    DS_STATUS_STRING_CHANGED = 0x18,
+   DS_LINK_STATS_CHANGED = 0x19,
 } DS_EventType;
 
 /**
@@ -111,6 +113,16 @@ typedef struct
    char *message;
 } DS_NetConsoleEvent;
 
+/**
+ * \brief Link statistics event fields
+ */
+typedef struct
+{
+   DS_EventType type;
+   DS_Link link;
+   DS_LinkStats stats;
+} DS_LinkEvent;
+
 /**
  * \brief General event structure
  */
@@ -120,6 +132,7 @@ typedef union
    DS_FMSEvent fms;
    DS_RobotEvent robot;
    DS_RadioEvent radio;
+   DS_LinkEvent link;
    DS_JoystickEvent joystick;
    DS_NetConsoleEvent netconsole;
 } DS_Event;
@@ -128,6 +141,9 @@ extern void Events_Init(void);
 extern void Events_Close(void);
 extern void DS_AddEvent(DS_Event *event);
 extern int DS_PollEvent(DS_Event *event);
+extern int DS_WaitEvent(DS_Event *event, const int timeout);
+extern int DS_GetEventFd(void);
+extern unsigned int DS_DroppedEvents(void);
 
 #ifdef __cplusplus
 }
@@ -28,6 +28,56 @@
 extern "C" {
 #endif
 
+#include <stdlib.h>
+#include <stdint.h>
+
+/*
+ * Maximum number of axes, hats and buttons of a joystick
+ */
+#define DS_MAX_JOYSTICK_AXES 32
+#define DS_MAX_JOYSTICK_HATS 8
+#define DS_MAX_JOYSTICK_BUTTONS 64
+
+/**
+ * Values of a joystick, read at once with \c DS_GetJoystickState()
+ */
+typedef struct
+{
+   int num_axes; /**< The number of axes of the joystick */
+   int num_hats; /**< The number of hats of the joystick */
+   int num_buttons; /**< The number of buttons of the joystick */
+   unsigned int generation; /**< Generation of the values (see DS_GetJoystickGeneration()) */
+   float axes[DS_MAX_JOYSTICK_AXES]; /**< The axis values */
+   int16_t hats[DS_MAX_JOYSTICK_HATS]; /**< The hat angles */
+   uint64_t buttons; /**< The button states, button \c n is bit \c n */
+} DS_JoystickState;
+
+/*
+ * Maximum number of joysticks and bytes held by a DS_JoystickCache
+ */
+#define DS_JOYSTICK_CACHE_COUNT 8
+#define DS_JOYSTICK_CACHE_SIZE 256
+
+/**
+ * Writes the data of the given \a joystick into the \a out buffer, and
+ * returns the number of written bytes (or \c 0 if \a cap is too small)
+ */
+typedef size_t (*DS_JoystickEncoder)(const int joystick, uint8_t *out, const size_t cap);
+
+/**
+ * Joystick data encoded by a protocol, used to only encode the joysticks
+ * that changed since the last packet (see \c DS_JoystickCacheEncode())
+ */
+typedef struct
+{
+   int valid; /**< Set once the cache holds encoded data */
+   int enabled; /**< Enabled state of the robot when the data was encoded */
+   unsigned int generations[DS_JOYSTICK_CACHE_COUNT]; /**< Generation of each encoded joystick */
+   uint16_t offsets[DS_JOYSTICK_CACHE_COUNT]; /**< Position of each joystick in \a data */
+   uint16_t lengths[DS_JOYSTICK_CACHE_COUNT]; /**< Encoded length of each joystick */
+   uint8_t data[DS_JOYSTICK_CACHE_SIZE]; /**< Encoded joystick data */
+} DS_JoystickCache;
+
 extern void Joysticks_Init(void);
 extern void Joysticks_Close(void);
 
@@ -39,12 +89,18 @@ extern int DS_GetJoystickNumButtons(int joystick);
 extern int DS_GetJoystickHat(int joystick, int hat);
 extern float DS_GetJoystickAxis(int joystick, int axis);
 extern int DS_GetJoystickButton(int joystick, int button);
+extern unsigned int DS_GetJoystickGeneration(int joystick);
+extern int DS_GetJoystickState(int joystick, DS_JoystickState *snapshot);
 
 extern void DS_JoysticksReset(void);
 extern void DS_JoysticksAdd(const int axes, const int hats, const int buttons);
 extern void DS_SetJoystickHat(int joystick, int hat, int angle);
 extern void DS_SetJoystickAxis(int joystick, int axis, float value);
 extern void DS_SetJoystickButton(int joystick, int button, int pressed);
+extern void DS_SetJoystickState(int joystick, const float *axes, uint64_t buttons, const int16_t *hats);
+
+extern size_t DS_JoystickCacheEncode(DS_JoystickCache *cache, DS_JoystickEncoder encoder, uint8_t *out,
+                                     const size_t cap);
 
 #ifdef __cplusplus
 }
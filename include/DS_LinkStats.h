@@ -0,0 +1,106 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_LINK_STATS_H
+#define _LIB_DS_LINK_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "DS_Types.h"
+
+/*
+ * Number of packets tracked by each link monitor (power of two) and time
+ * after which a packet that has not been echoed is considered to be lost
+ */
+#define DS_LINK_WINDOW 128
+#define DS_LINK_LOSS_TIMEOUT 1000
+
+/*
+ * Maximum time (in milliseconds) between the moment we send a packet and the
+ * moment in which the kernel reports that it was sent
+ */
+#define DS_LINK_SEND_DELAY 10
+
+/**
+ * Statistics of a network link, calculated over the last \c DS_LINK_WINDOW
+ * packets (or measured since the communications were established)
+ */
+typedef struct
+{
+   unsigned int sent_packets; /**< Packets sent since the link was reset */
+   unsigned int received_packets; /**< Packets received since the link was reset */
+   unsigned long sent_bytes; /**< Bytes sent since the protocol was loaded */
+   unsigned long received_bytes; /**< Bytes received since the protocol was loaded */
+   unsigned int samples; /**< Number of round-trip times in the window */
+   float rtt_min; /**< Lowest round-trip time, in milliseconds */
+   float rtt_avg; /**< Average round-trip time, in milliseconds */
+   float rtt_p99; /**< 99th percentile of the round-trip time, in milliseconds */
+   float jitter; /**< Inter-arrival jitter, in milliseconds */
+   float rx_delay; /**< Average time between the reception and the processing of a packet, in milliseconds */
+   float loss; /**< Percentage of the packets in the window that were not echoed */
+   unsigned int reordered; /**< Packets in the window that were echoed out of order */
+} DS_LinkStats;
+
+/**
+ * A packet tracked by a link monitor
+ */
+typedef struct
+{
+   uint64_t sent; /**< Time at which the packet was sent (nanoseconds) */
+   uint32_t rtt; /**< Round-trip time of the packet (microseconds) */
+   uint16_t seq; /**< Sequence number of the packet */
+   uint8_t state; /**< Sent, echoed or reordered */
+   uint8_t kernel_time; /**< 1 if \a sent was reported by the kernel */
+} DS_LinkSlot;
+
+/**
+ * Matches the sequence numbers echoed by a remote host with the times at
+ * which the packets were sent, and measures the spacing of received packets
+ */
+typedef struct
+{
+   int has_echo; /**< Set once a packet has been echoed */
+   int has_arrival; /**< Set once a packet has been received */
+   uint16_t last_echo; /**< Highest echoed sequence number */
+   uint64_t last_arrival; /**< Time at which the last packet was received */
+   uint64_t last_spacing; /**< Time between the last two received packets */
+   double jitter; /**< Smoothed inter-arrival jitter (nanoseconds) */
+   double rx_delay; /**< Smoothed processing delay of received packets (nanoseconds) */
+   DS_LinkSlot slots[DS_LINK_WINDOW]; /**< Tracked packets */
+} DS_LinkMonitor;
+
+extern void DS_LinkMonitorReset(DS_LinkMonitor *monitor);
+extern void DS_LinkMonitorSent(DS_LinkMonitor *monitor, const unsigned int seq, const uint64_t time);
+extern void DS_LinkMonitorSentTime(DS_LinkMonitor *monitor, const uint64_t time);
+extern void DS_LinkMonitorEchoed(DS_LinkMonitor *monitor, const unsigned int seq, const uint64_t time);
+extern void DS_LinkMonitorReceived(DS_LinkMonitor *monitor, const uint64_t time, const uint64_t now);
+extern void DS_LinkMonitorStats(const DS_LinkMonitor *monitor, const uint64_t time, DS_LinkStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
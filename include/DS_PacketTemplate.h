@@ -0,0 +1,63 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _LIB_DS_PACKET_TEMPLATE_H
+#define _LIB_DS_PACKET_TEMPLATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * A prebuilt packet with a fixed layout, in which only one region (e.g. the
+ * packet index, the control bytes and the joystick values) changes between
+ * packets. The CRC32 of the constant bytes is calculated once, so that the
+ * CRC32 of each packet only needs to read the bytes that changed.
+ *
+ * The template does not own the \a frame, which must remain valid (and
+ * unchanged) while the template is used.
+ */
+typedef struct
+{
+   const uint8_t *frame; /**< Constant bytes of the packet */
+   size_t len; /**< Length of the packet */
+   size_t dynamic_pos; /**< First byte written by the protocol on every packet */
+   size_t dynamic_len; /**< Number of bytes written by the protocol on every packet */
+   uint32_t prefix_crc; /**< CRC32 of the constant bytes before the dynamic region */
+   uint32_t suffix_crc; /**< CRC32 of the constant bytes after the dynamic region */
+   uint32_t suffix_op; /**< Operator that appends the suffix (see DS_CRC32CombineGen()) */
+} DS_PacketTemplate;
+
+extern void DS_TemplateInit(DS_PacketTemplate *tpl, const uint8_t *frame, const size_t len, const size_t dynamic_pos,
+                            const size_t dynamic_len);
+extern size_t DS_TemplateCopy(const DS_PacketTemplate *tpl, uint8_t *out, const size_t cap);
+extern uint32_t DS_TemplateCRC32(const DS_PacketTemplate *tpl, const uint8_t *packet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
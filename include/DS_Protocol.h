@@ -30,7 +30,27 @@ extern "C" {
 
 #include "DS_Socket.h"
 #include "DS_String.h"
+#include "DS_ByteSpan.h"
+#include "DS_LinkStats.h"
 
+/*
+ * Size of the buffers given to the packet encoder functions
+ */
+#define DS_PACKET_BUFFER_SIZE 2048
+
+/*
+ * Size of the private data block of a protocol (see DS_ProtocolData())
+ */
+#define DS_PROTOCOL_DATA_SIZE 512
+
+/*
+ * The encode_* functions are optional (they may be NULL), they write the
+ * packet into the given buffer (without allocating memory) and return its
+ * length. When set, they are used instead of the create_* functions.
+ *
+ * The read_* functions receive a view over the socket buffer, which is only
+ * valid until the function returns.
+ */
 typedef struct _protocol
 {
    DS_String name;
@@ -42,9 +62,12 @@ typedef struct _protocol
    DS_String (*create_radio_packet)(void);
    DS_String (*create_robot_packet)(void);
 
-   int (*read_fms_packet)(const DS_String *);
-   int (*read_radio_packet)(const DS_String *);
-   int (*read_robot_packet)(const DS_String *);
+   size_t (*encode_fms_packet)(uint8_t *, const size_t);
+   size_t (*encode_robot_packet)(uint8_t *, const size_t);
+
+   int (*read_fms_packet)(const DS_ByteSpan *);
+   int (*read_radio_packet)(const DS_ByteSpan *);
+   int (*read_robot_packet)(const DS_ByteSpan *);
 
    void (*reset_fms)(void);
    void (*reset_radio)(void);
@@ -71,7 +94,11 @@ typedef struct _protocol
 
 extern void Protocols_Init();
 extern void Protocols_Close();
+extern void Protocols_InitContext();
+extern void Protocols_CloseContext();
+extern void *DS_ProtocolData();
 extern void DS_ConfigureProtocol(const DS_Protocol *ptr);
+extern void DS_SetTransport(const DS_Transport *transport);
 
 extern unsigned long DS_SentFMSBytes();
 extern unsigned long DS_SentRadioBytes();
@@ -89,12 +116,23 @@ extern int DS_ReceivedFMSPackets();
 extern int DS_ReceivedRadioPackets();
 extern int DS_ReceivedRobotPackets();
 
+extern int DS_DroppedFMSPackets();
+extern int DS_DroppedRadioPackets();
+extern int DS_DroppedRobotPackets();
+extern int DS_DroppedNetConsolePackets();
+
 extern void DS_ResetFMSPackets();
 extern void DS_ResetRadioPackets();
 extern void DS_ResetRobotPackets();
 
 extern DS_Protocol *DS_CurrentProtocol();
 
+extern DS_LinkStats DS_GetLinkStats(const DS_Link link);
+extern void DS_LinkPacketEncoded(const DS_Link link, const unsigned int seq);
+extern void DS_LinkPacketSent(const DS_Link link, const unsigned int seq);
+extern void DS_LinkPacketEchoed(const DS_Link link, const unsigned int seq);
+extern uint64_t DS_PacketTimestamp();
+
 #ifdef __cplusplus
 }
 #endif
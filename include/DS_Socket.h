@@ -30,8 +30,52 @@ extern "C" {
 
 #include <pthread.h>
 
+#if defined _WIN32
+#   include <winsock2.h>
+#   include <ws2tcpip.h>
+#else
+#   include <sys/types.h>
+#   include <sys/socket.h>
+#endif
+
 #include "DS_Types.h"
 #include "DS_String.h"
+#include "DS_ByteSpan.h"
+
+/*
+ * Number of datagrams that can be queued by each socket (power of two)
+ * and maximum size of each queued datagram
+ */
+#define DS_SOCKET_RING_SIZE 16
+#define DS_SOCKET_DATAGRAM_SIZE 2048
+
+/**
+ * Holds a received datagram until it is read by the protocol event loop
+ */
+typedef struct
+{
+   size_t size; /**< Number of bytes in \a data */
+   uint64_t timestamp; /**< Time at which the datagram was received (see \c DS_GetMonotonicTime()) */
+   char data[DS_SOCKET_DATAGRAM_SIZE]; /**< Received data */
+} DS_SocketDatagram;
+
+struct _socket;
+
+/**
+ * Functions used to move the data of a socket. By default, sockets use the
+ * network (see \c DS_NetworkTransport()), but they can also exchange data
+ * with other sockets of the same process (see \c DS_LoopbackTransport()).
+ */
+typedef struct _transport
+{
+   const char *name; /**< Name of the transport (local address of loopback sockets) */
+   int (*open)(struct _socket *ptr); /**< Returns 1 if the socket can be polled now */
+   void (*close)(struct _socket *ptr); /**< Releases the resources of the socket */
+   int (*fd)(const struct _socket *ptr); /**< Returns the descriptor to poll (or -1) */
+   int (*recv)(struct _socket *ptr); /**< Moves the pending data to the receive ring */
+   int (*send)(const struct _socket *ptr, const void *data, const size_t len); /**< Sends a datagram */
+   void (*set_address)(struct _socket *ptr, const char *address); /**< Changes the remote address */
+} DS_Transport;
 
 /**
  * Holds all the private (erm, dirty) variables that the sockets module needs
@@ -43,17 +87,31 @@ typedef struct
    int sock_out; /**< Output socket file descriptor */
    int client_init; /**< 1 if client is working, 0 if not */
    int server_init; /**< 1 if server is working, 0 if not */
-   size_t buffer_size; /**< Holds the number of received bytes */
-   char buffer[4096]; /**< Holds the received data buffer */
+   int thread_valid; /**< 1 if \a thread must be joined when closing */
+   pthread_t thread; /**< Thread that creates (and may read) the socket */
    char in_service[12]; /**< Holds the input port number as a string */
    char out_service[12]; /**< Holds the output port number as a string */
+   int resolve_queued; /**< 1 if the socket is waiting for the resolver */
+   void *resolve_next; /**< Next socket in the resolver queue */
+   int peer_valid; /**< 1 if \a peer_addr holds a resolved address */
+   socklen_t peer_addr_len; /**< Length of the resolved remote address */
+   struct sockaddr_storage peer_addr; /**< Cached remote address (guarded by the resolver lock) */
+   int peer_connected; /**< 1 if \a sock_out is connected to \a peer_addr */
+   unsigned int unreachable; /**< Set when the remote host reports that it cannot be reached */
+   int timestamping; /**< 1 if the kernel reports the time at which datagrams are sent */
+   unsigned int tx_pending; /**< Sent datagrams whose timestamp has not been read */
+   void *transport_data; /**< Private data of the transport of the socket */
+   unsigned int ring_head; /**< Number of datagrams written to \a ring */
+   unsigned int ring_tail; /**< Number of datagrams read from \a ring */
+   unsigned int dropped; /**< Datagrams discarded because \a ring was full */
+   DS_SocketDatagram ring[DS_SOCKET_RING_SIZE]; /**< Received datagrams */
 } DS_SocketInfo;
 
 /**
  * Holds all the 'public' variables of a socket, these variables can be used
  * both the the networking module and the rest of the application.
  */
-typedef struct
+typedef struct _socket
 {
    int in_port; /**< Input port number */
    int out_port; /**< Output port number */
@@ -61,15 +119,24 @@ typedef struct
    int broadcast; /**< 1 if socket shall send or receive broadcasts */
    char address[512]; /**< Address of remote host */
    DS_SocketType type; /**< Type of socket (UDP/TCP) */
+   const DS_Transport *transport; /**< Transport of the socket (\c NULL for the network) */
+   void *owner; /**< Context that reads the socket (set by the protocols module) */
    DS_SocketInfo info; /**< Ugly data about the socket */
 } DS_Socket;
 
 /* For socket initialization */
 extern DS_Socket *DS_SocketEmpty(void);
 
+/* Transports */
+extern const DS_Transport *DS_NetworkTransport(void);
+extern const DS_Transport *DS_LoopbackTransport(const char *name);
+extern int DS_SocketPush(DS_Socket *ptr, const void *data, const size_t len, const uint64_t timestamp);
+
 /* Module functions */
 extern void Sockets_Init(void);
 extern void Sockets_Close(void);
+extern int Sockets_PollFd(void);
+extern int Sockets_Dispatch(void (*func)(DS_Socket *ptr));
 
 /* Socket initializer and destructor functions */
 extern void DS_SocketOpen(DS_Socket *ptr);
@@ -77,7 +144,16 @@ extern void DS_SocketClose(DS_Socket *ptr);
 
 /* I/O functions */
 extern DS_String DS_SocketRead(DS_Socket *ptr);
+extern int DS_SocketPeek(const DS_Socket *ptr, DS_ByteSpan *span);
+extern void DS_SocketRelease(DS_Socket *ptr);
+extern int DS_SocketPending(const DS_Socket *ptr);
+extern int DS_SocketWait(const DS_Socket *ptr, const int timeout);
+extern unsigned int DS_SocketDropped(const DS_Socket *ptr);
+extern int DS_SocketUnreachable(DS_Socket *ptr);
+extern uint64_t DS_SocketTimestamp(const DS_Socket *ptr);
+extern int DS_SocketSendTimestamp(DS_Socket *ptr, uint64_t *time);
 extern int DS_SocketSend(const DS_Socket *ptr, const DS_String *data);
+extern int DS_SocketSendBytes(const DS_Socket *ptr, const void *data, const size_t len);
 extern void DS_SocketChangeAddress(DS_Socket *ptr, const char *address);
 
 #ifdef __cplusplus
@@ -41,6 +41,7 @@ typedef struct
 {
    char *buf; /**< String data buffer */
    size_t len; /**< Length of the string */
+   size_t capacity; /**< Number of bytes allocated for \a buf */
 } DS_String;
 
 /*
@@ -55,7 +56,9 @@ extern int DS_StrCompare(const DS_String *a, const DS_String *b);
  */
 extern int DS_StrRmBuf(DS_String *string);
 extern int DS_StrResize(DS_String *string, size_t size);
+extern int DS_StrReserve(DS_String *string, size_t capacity);
 extern int DS_StrAppend(DS_String *string, const uint8_t byte);
+extern int DS_StrAppendBytes(DS_String *string, const void *bytes, size_t len);
 extern int DS_StrJoin(DS_String *first, const DS_String *second);
 extern int DS_StrJoinCStr(DS_String *string, const char *cstring);
 extern int DS_StrSetChar(DS_String *string, const int pos, const char byte);
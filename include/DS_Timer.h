@@ -28,6 +28,7 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
 #include <pthread.h>
 
 /**
@@ -39,16 +40,25 @@ typedef struct _timer
    int expired; /**< Set to \c 1 if \a elapsed is greater than \a time */
    int enabled; /**< Enabled state of the timer */
    int elapsed; /**< Number of milliseconds elapsed since last reset */
-   int precision; /**< The update interval (in milliseconds) */
+   int precision; /**< Unused, kept for compatibility */
    int initialized; /**< Set to \c 1 if the timer has been initialized */
+   int heap_index; /**< Position in the scheduler queue, \c -1 if idle */
+   uint64_t deadline; /**< Monotonic time (in nanoseconds) of expiration */
+   void *owner; /**< Context that polls the timer (\c NULL for application timers) */
 } DS_Timer;
 
 extern void Timers_Init(void);
 extern void Timers_Close(void);
+extern void Timers_StartScheduler(void);
+extern uint64_t DS_GetMonotonicTime(void);
 extern void DS_Sleep(const int millisecs);
 extern void DS_TimerStop(DS_Timer *timer);
 extern void DS_TimerStart(DS_Timer *timer);
 extern void DS_TimerReset(DS_Timer *timer);
+extern int DS_TimerPoll(DS_Timer *timer);
+extern uint64_t DS_TimerDeadline(DS_Timer *timer);
+extern uint64_t DS_TimerNextDeadline(void);
+extern int DS_TimerExpireNext(void **owner);
 extern void DS_TimerInit(DS_Timer *timer, const int time, const int precision);
 
 #ifdef __cplusplus
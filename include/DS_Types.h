@@ -48,6 +48,13 @@ typedef enum
    DS_POSITION_3,
 } DS_Position;
 
+typedef enum
+{
+   DS_LINK_FMS,
+   DS_LINK_RADIO,
+   DS_LINK_ROBOT,
+} DS_Link;
+
 typedef enum
 {
    DS_SOCKET_UDP,
@@ -47,6 +47,23 @@ extern "C" {
       p = NULL;                                                                                                        \
    }
 
+/*
+ * Atomic operations on \c unsigned \c int values, used by the lock-free
+ * structures shared between the library threads
+ */
+#if defined _MSC_VER
+#   include <intrin.h>
+#   define DS_AtomicLoad(p) (*(volatile unsigned int *)(p))
+#   define DS_AtomicStore(p, v) (*(volatile unsigned int *)(p) = (v))
+#   define DS_AtomicAdd(p, v) ((unsigned int)_InterlockedExchangeAdd((volatile long *)(p), (long)(v)))
+#   define DS_AtomicCAS(p, e, v) (_InterlockedCompareExchange((volatile long *)(p), (long)(v), (long)(e)) == (long)(e))
+#else
+#   define DS_AtomicLoad(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#   define DS_AtomicStore(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#   define DS_AtomicAdd(p, v) __atomic_fetch_add((p), (v), __ATOMIC_ACQ_REL)
+#   define DS_AtomicCAS(p, e, v) __sync_bool_compare_and_swap((p), (e), (v))
+#endif
+
 /*
  * Icon types for message boxes
  */
@@ -61,6 +78,10 @@ typedef enum
  * Misc functions
  */
 extern uint32_t DS_CRC32(const void *buf, size_t size);
+extern uint32_t DS_CRC32Update(const uint32_t crc, const void *buf, size_t size);
+extern uint32_t DS_CRC32CombineGen(size_t size);
+extern uint32_t DS_CRC32CombineOp(const uint32_t crc1, const uint32_t crc2, const uint32_t op);
+extern uint32_t DS_CRC32Combine(const uint32_t crc1, const uint32_t crc2, size_t size2);
 extern uint8_t DS_FloatToByte(const float val, const float max);
 extern DS_String DS_GetStaticIP(const int net, const int team, const int host);
 extern void DS_ShowMessageBox(const DS_String *caption, const DS_String *message, const DS_IconType icon);
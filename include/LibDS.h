@@ -33,6 +33,7 @@ extern "C" {
 #include "DS_Utils.h"
 #include "DS_Events.h"
 #include "DS_Client.h"
+#include "DS_Context.h"
 #include "DS_Socket.h"
 #include "DS_Protocol.h"
 #include "DS_Joysticks.h"
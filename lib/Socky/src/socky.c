@@ -339,6 +339,51 @@ struct addrinfo *get_address_info(const char *host, const char *service, int soc
    return info;
 }
 
+/**
+ * Resolves the given \a host and \a service and copies the first obtained
+ * address into \a addr. This allows callers to perform the (potentially
+ * slow) name lookup once and re-use the result for every datagram.
+ *
+ * \param host the host name
+ * \param service the service name or port string
+ * \param socktype the socket type
+ * \param family the address family
+ * \param addr the structure in which to write the resolved address
+ * \param addr_len set to the length of the resolved address
+ *
+ * \returns 0 on success, -1 on failure
+ */
+int resolve_address(const char *host, const char *service, const int socktype, const int family,
+                    struct sockaddr_storage *addr, socklen_t *addr_len)
+{
+   /* Check arguments */
+   if (addr == NULL || addr_len == NULL)
+      return -1;
+
+   /* Get address info */
+   struct addrinfo *info = get_address_info(host, service, socktype, family);
+
+   /* Invalid address info */
+   if (info == NULL)
+      return -1;
+
+   /* Address does not fit in the given structure */
+   if (info->ai_addrlen > sizeof(struct sockaddr_storage))
+   {
+      freeaddrinfo(info);
+      return -1;
+   }
+
+   /* Copy the first address */
+   memset(addr, 0, sizeof(struct sockaddr_storage));
+   memcpy(addr, info->ai_addr, info->ai_addrlen);
+   *addr_len = (socklen_t)info->ai_addrlen;
+
+   /* Free address information */
+   freeaddrinfo(info);
+   return 0;
+}
+
 /**
  * Creates a new UDP client socket using the given \a family and \a flags
  *
@@ -593,14 +638,36 @@ int udp_sendto(const int sfd, const char *buf, const int buf_len, const char *ho
    return bytes;
 }
 
+/**
+ * Sends a datagram to the given (already resolved) address, this avoids
+ * calling \c getaddrinfo() for every packet
+ *
+ * \param sfd the socket descriptor
+ * \param buf the data buffer to send
+ * \param buf_len the length of the data buffer
+ * \param addr the remote address, obtained with \c resolve_address()
+ * \param addr_len the length of the remote address
+ * \param flags any additional flags that you may need to use
+ */
+int udp_sendto_addr(const int sfd, const char *buf, const int buf_len, const struct sockaddr *addr,
+                    const socklen_t addr_len, const int flags)
+{
+   /* Check if socket, buffer and address are valid */
+   if (!valid_sfd(sfd) || buf == NULL || buf_len <= 0 || addr == NULL)
+      return -1;
+
+   /* Send datagram */
+   return sendto(sfd, buf, buf_len, flags, addr, addr_len);
+}
+
 /**
  * Re-implements the \c recvfrom function
  *
  * \param sfd the socket file descriptor
  * \param buf the data buffer in which to write the data into
  * \param buf_len the length of the data buffer
- * \param host the remote host from which to receive data
- * \param service the local service/port from which to receive data
+ * \param host unused, kept for compatibility
+ * \param service unused, kept for compatibility
  * \param flags any additional flags that you may need to use
  */
 int udp_recvfrom(const int sfd, char *buf, const int buf_len, const char *host, const char *service, const int flags)
@@ -609,21 +676,12 @@ int udp_recvfrom(const int sfd, char *buf, const int buf_len, const char *host,
    if (!valid_sfd(sfd) || buf_len <= 0)
       return -1;
 
-   /* Get address info */
-   struct addrinfo *info = get_address_info(host, service, SOCKY_UDP, SOCKY_ANY);
-
-   /* Invalid address info */
-   if (info == NULL)
-      return -1;
+   /* The sender address is written by recvfrom(), no need to resolve it */
+   (void)host;
+   (void)service;
+   struct sockaddr_storage addr;
+   socklen_t addr_len = sizeof(addr);
 
-      /* Receive remote data */
-#if defined _WIN32
-   int bytes = recvfrom(sfd, buf, buf_len, flags, info->ai_addr, (int *)&info->ai_addrlen);
-#else
-   int bytes = recvfrom(sfd, buf, buf_len, flags, info->ai_addr, &info->ai_addrlen);
-#endif
-
-   /* Return the number of bytes received */
-   freeaddrinfo(info);
-   return bytes;
+   /* Receive remote data */
+   return recvfrom(sfd, buf, buf_len, flags, (struct sockaddr *)&addr, &addr_len);
 }
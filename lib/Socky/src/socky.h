@@ -64,6 +64,8 @@ extern int sockets_exit(void);
 extern int sockets_init(const int exit_on_fail);
 extern int set_socket_block(const int sfd, const int block);
 extern struct addrinfo *get_address_info(const char *host, const char *service, int socktype, int family);
+extern int resolve_address(const char *host, const char *service, const int socktype, const int family,
+                           struct sockaddr_storage *addr, socklen_t *addr_len);
 
 /* Socket initialization functions */
 extern int create_client_udp(const int family, const int flags);
@@ -84,6 +86,10 @@ extern int tcp_accept(const int sfd, char *host, const int host_len, char *servi
 extern int udp_sendto(const int sfd, const char *buf, const int buf_len, const char *host, const char *service,
                       const int flags);
 
+/* Sends a datagram to an already resolved address */
+extern int udp_sendto_addr(const int sfd, const char *buf, const int buf_len, const struct sockaddr *addr,
+                           const socklen_t addr_len, const int flags);
+
 /* Re-implementation of recvfrom */
 extern int udp_recvfrom(const int sfd, char *buf, const int buf_len, const char *host, const char *service,
                         const int flags);
@@ -24,6 +24,7 @@
 #include "DS_Array.h"
 #include "DS_Utils.h"
 
+#include <string.h>
 #include <assert.h>
 
 /**
@@ -67,11 +68,14 @@ void DS_ArrayInsert(DS_Array *array, void *element)
    assert(array);
    assert(array->data);
 
-   /* Resize array if required */
+   /* Resize array if required (the new slots are cleared, since the array
+    * frees all of its slots when it is de-allocated) */
    if (array->used == array->size)
    {
-      array->size *= 2;
-      array->data = realloc(array->data, array->size);
+      size_t size = array->size ? array->size * 2 : 1;
+      array->data = realloc(array->data, size * sizeof(void *));
+      memset(array->data + array->size, 0, (size - array->size) * sizeof(void *));
+      array->size = size;
    }
 
    /* Insert element */
@@ -24,6 +24,7 @@
 #include "DS_Utils.h"
 #include "DS_Client.h"
 #include "DS_Config.h"
+#include "DS_Context.h"
 #include "DS_String.h"
 #include "DS_Protocol.h"
 
@@ -31,23 +32,42 @@
 #include <string.h>
 #include <assert.h>
 
+/**
+ * Holds the strings of the client module
+ */
+typedef struct
+{
+   DS_String status_string;
+   DS_String custom_fms_address;
+   DS_String custom_radio_address;
+   DS_String custom_robot_address;
+} ClientState;
+
 /*
- * Set the strings
+ * State of the default context
  */
-static DS_String status_string;
-static DS_String custom_fms_address;
-static DS_String custom_radio_address;
-static DS_String custom_robot_address;
+static ClientState default_state;
+
+/**
+ * Returns the client state of the current context
+ */
+static ClientState *state(void)
+{
+   ClientState *ptr = (ClientState *)Contexts_GetState(DS_CONTEXT_CLIENT);
+   return ptr ? ptr : &default_state;
+}
 
 /**
  * Allocates memory for the members of the client module
  */
 void Client_Init(void)
 {
-   status_string = DS_StrNew("Loading...");
-   custom_fms_address = DS_StrNew(DS_FallBackAddress);
-   custom_radio_address = DS_StrNew(DS_FallBackAddress);
-   custom_robot_address = DS_StrNew(DS_FallBackAddress);
+   ClientState *ptr = (ClientState *)Contexts_CreateState(DS_CONTEXT_CLIENT, &default_state, sizeof(ClientState));
+
+   ptr->status_string = DS_StrNew("Loading...");
+   ptr->custom_fms_address = DS_StrNew(DS_FallBackAddress);
+   ptr->custom_radio_address = DS_StrNew(DS_FallBackAddress);
+   ptr->custom_robot_address = DS_StrNew(DS_FallBackAddress);
 
    DS_SetGameData("");
 }
@@ -57,10 +77,14 @@ void Client_Init(void)
  */
 void Client_Close(void)
 {
-   DS_StrRmBuf(&status_string);
-   DS_StrRmBuf(&custom_fms_address);
-   DS_StrRmBuf(&custom_radio_address);
-   DS_StrRmBuf(&custom_robot_address);
+   ClientState *ptr = state();
+
+   DS_StrRmBuf(&ptr->status_string);
+   DS_StrRmBuf(&ptr->custom_fms_address);
+   DS_StrRmBuf(&ptr->custom_radio_address);
+   DS_StrRmBuf(&ptr->custom_robot_address);
+
+   Contexts_DestroyState(DS_CONTEXT_CLIENT);
 }
 
 /**
@@ -70,7 +94,7 @@ void Client_Close(void)
  */
 char *DS_GetCustomFMSAddress(void)
 {
-   return DS_StrToChar(&custom_fms_address);
+   return DS_StrToChar(&state()->custom_fms_address);
 }
 
 /**
@@ -80,7 +104,7 @@ char *DS_GetCustomFMSAddress(void)
  */
 char *DS_GetCustomRadioAddress(void)
 {
-   return DS_StrToChar(&custom_radio_address);
+   return DS_StrToChar(&state()->custom_radio_address);
 }
 
 /**
@@ -90,7 +114,7 @@ char *DS_GetCustomRadioAddress(void)
  */
 char *DS_GetCustomRobotAddress(void)
 {
-   return DS_StrToChar(&custom_robot_address);
+   return DS_StrToChar(&state()->custom_robot_address);
 }
 
 /**
@@ -152,7 +176,7 @@ char *DS_GetDefaultRobotAddress(void)
  */
 char *DS_GetAppliedFMSAddress(void)
 {
-   if (DS_StrEmpty(&custom_fms_address))
+   if (DS_StrEmpty(&state()->custom_fms_address))
       return DS_GetDefaultFMSAddress();
    else
       return DS_GetCustomFMSAddress();
@@ -166,7 +190,7 @@ char *DS_GetAppliedFMSAddress(void)
  */
 char *DS_GetAppliedRadioAddress(void)
 {
-   if (DS_StrEmpty(&custom_radio_address))
+   if (DS_StrEmpty(&state()->custom_radio_address))
       return DS_GetDefaultRadioAddress();
    else
       return DS_GetCustomRadioAddress();
@@ -180,7 +204,7 @@ char *DS_GetAppliedRadioAddress(void)
  */
 char *DS_GetAppliedRobotAddress(void)
 {
-   if (DS_StrEmpty(&custom_robot_address))
+   if (DS_StrEmpty(&state()->custom_robot_address))
       return DS_GetDefaultRobotAddress();
    else
       return DS_GetCustomRobotAddress();
@@ -435,6 +459,9 @@ void DS_SetRobotEnabled(const int enabled)
 
 /**
  * Changes the emergency stop state of the robot
+ *
+ * \note Once the robot is e-stopped, the e-stop is only released by this
+ *       function or when the communications with the robot are lost
  */
 void DS_SetEmergencyStopped(const int stop)
 {
@@ -474,15 +501,15 @@ void DS_SetCustomFMSAddress(const char *address)
 
    if (strlen(address) > 0)
    {
-      DS_StrRmBuf(&custom_fms_address);
-      custom_fms_address = DS_StrNew(address);
+      DS_StrRmBuf(&state()->custom_fms_address);
+      state()->custom_fms_address = DS_StrNew(address);
       CFG_ReconfigureAddresses(RECONFIGURE_FMS);
    }
 
    else
    {
-      DS_StrRmBuf(&custom_fms_address);
-      custom_fms_address = DS_StrNewLen(0);
+      DS_StrRmBuf(&state()->custom_fms_address);
+      state()->custom_fms_address = DS_StrNewLen(0);
       CFG_ReconfigureAddresses(RECONFIGURE_FMS);
    }
 }
@@ -496,15 +523,15 @@ void DS_SetCustomRadioAddress(const char *address)
 
    if (strlen(address) > 0)
    {
-      DS_StrRmBuf(&custom_radio_address);
-      custom_radio_address = DS_StrNew(address);
+      DS_StrRmBuf(&state()->custom_radio_address);
+      state()->custom_radio_address = DS_StrNew(address);
       CFG_ReconfigureAddresses(RECONFIGURE_RADIO);
    }
 
    else
    {
-      DS_StrRmBuf(&custom_radio_address);
-      custom_radio_address = DS_StrNewLen(0);
+      DS_StrRmBuf(&state()->custom_radio_address);
+      state()->custom_radio_address = DS_StrNewLen(0);
       CFG_ReconfigureAddresses(RECONFIGURE_RADIO);
    }
 }
@@ -518,15 +545,15 @@ void DS_SetCustomRobotAddress(const char *address)
 
    if (strlen(address) > 0)
    {
-      DS_StrRmBuf(&custom_robot_address);
-      custom_robot_address = DS_StrNew(address);
+      DS_StrRmBuf(&state()->custom_robot_address);
+      state()->custom_robot_address = DS_StrNew(address);
       CFG_ReconfigureAddresses(RECONFIGURE_ROBOT);
    }
 
    else
    {
-      DS_StrRmBuf(&custom_robot_address);
-      custom_robot_address = DS_StrNewLen(0);
+      DS_StrRmBuf(&state()->custom_robot_address);
+      state()->custom_robot_address = DS_StrNewLen(0);
       CFG_ReconfigureAddresses(RECONFIGURE_ROBOT);
    }
 }
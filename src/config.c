@@ -25,31 +25,59 @@
 #include "DS_Client.h"
 #include "DS_Events.h"
 #include "DS_Config.h"
+#include "DS_Context.h"
 #include "DS_Protocol.h"
 
 #include <math.h>
 #include <string.h>
 #include <assert.h>
 
+/**
+ * Holds the state(s) of the LibDS and its modules
+ */
+typedef struct
+{
+   int team;
+   int cpu_usage;
+   int ram_usage;
+   int disk_usage;
+   int robot_code;
+   DS_String game_data;
+   int robot_enabled;
+   int can_utilization;
+   float robot_voltage;
+   int emergency_stopped;
+   int fms_communications;
+   int radio_communications;
+   int robot_communications;
+   DS_Position robot_position;
+   DS_Alliance robot_alliance;
+   DS_ControlMode control_mode;
+} ConfigState;
+
+/*
+ * Initial values of the configuration
+ */
+#define INITIAL_STATE                                                                                                  \
+   {                                                                                                                   \
+      0, -1, -1, -1, -1, { NULL, 0, 0 }, -1, -1, -1, -1, -1, -1, -1, DS_POSITION_1, DS_ALLIANCE_RED,                   \
+          DS_CONTROL_TELEOPERATED                                                                                      \
+   }
+
 /*
- * These variables hold the state(s) of the LibDS and its modules
- */
-static int team = 0;
-static int cpu_usage = -1;
-static int ram_usage = -1;
-static int disk_usage = -1;
-static int robot_code = -1;
-static DS_String game_data;
-static int robot_enabled = -1;
-static int can_utilization = -1;
-static float robot_voltage = -1;
-static int emergency_stopped = -1;
-static int fms_communications = -1;
-static int radio_communications = -1;
-static int robot_communications = -1;
-static DS_Position robot_position = DS_POSITION_1;
-static DS_Alliance robot_alliance = DS_ALLIANCE_RED;
-static DS_ControlMode control_mode = DS_CONTROL_TELEOPERATED;
+ * State of the default context and initial state of the other contexts
+ */
+static ConfigState default_state = INITIAL_STATE;
+static const ConfigState initial_state = INITIAL_STATE;
+
+/**
+ * Returns the configuration of the current context
+ */
+static ConfigState *state(void)
+{
+   ConfigState *ptr = (ConfigState *)Contexts_GetState(DS_CONTEXT_CONFIG);
+   return ptr ? ptr : &default_state;
+}
 
 /**
  * Ensures that the given \a input number is either \c 0 or \c 1
@@ -100,6 +128,26 @@ static void create_robot_event(const DS_EventType type)
    DS_AddEvent(&event);
 }
 
+/**
+ * Initializes the configuration of the current context. The default context
+ * keeps the values that were set before the library was initialized.
+ */
+void CFG_Init(void)
+{
+   ConfigState *ptr = (ConfigState *)Contexts_CreateState(DS_CONTEXT_CONFIG, &default_state, sizeof(ConfigState));
+   if (ptr != &default_state)
+      *ptr = initial_state;
+}
+
+/**
+ * Releases the configuration of the current context
+ */
+void CFG_Close(void)
+{
+   DS_StrRmBuf(&state()->game_data);
+   Contexts_DestroyState(DS_CONTEXT_CONFIG);
+}
+
 /**
  * Notifies the user about something through the NetConsole
  */
@@ -174,7 +222,7 @@ void CFG_ReconfigureAddresses(const int flags)
  */
 int CFG_GetTeamNumber(void)
 {
-   return DS_Max(team, 0);
+   return DS_Max(state()->team, 0);
 }
 
 /**
@@ -182,7 +230,7 @@ int CFG_GetTeamNumber(void)
  */
 int CFG_GetRobotCode(void)
 {
-   return robot_code == 1;
+   return state()->robot_code == 1;
 }
 
 /**
@@ -190,7 +238,7 @@ int CFG_GetRobotCode(void)
  */
 int CFG_GetRobotEnabled(void)
 {
-   return robot_enabled == 1;
+   return state()->robot_enabled == 1;
 }
 
 /**
@@ -198,7 +246,7 @@ int CFG_GetRobotEnabled(void)
  */
 int CFG_GetRobotCPUUsage(void)
 {
-   return DS_Max(cpu_usage, 0);
+   return DS_Max(state()->cpu_usage, 0);
 }
 
 /**
@@ -206,7 +254,7 @@ int CFG_GetRobotCPUUsage(void)
  */
 int CFG_GetRobotRAMUsage(void)
 {
-   return DS_Max(ram_usage, 0);
+   return DS_Max(state()->ram_usage, 0);
 }
 
 /**
@@ -214,7 +262,7 @@ int CFG_GetRobotRAMUsage(void)
  */
 int CFG_GetCANUtilization(void)
 {
-   return DS_Max(can_utilization, 0);
+   return DS_Max(state()->can_utilization, 0);
 }
 
 /**
@@ -222,7 +270,7 @@ int CFG_GetCANUtilization(void)
  */
 int CFG_GetRobotDiskUsage(void)
 {
-   return DS_Max(disk_usage, 0);
+   return DS_Max(state()->disk_usage, 0);
 }
 
 /**
@@ -230,7 +278,7 @@ int CFG_GetRobotDiskUsage(void)
  */
 float CFG_GetRobotVoltage(void)
 {
-   return DS_Max(robot_voltage, 0);
+   return DS_Max(state()->robot_voltage, 0);
 }
 
 /**
@@ -238,7 +286,7 @@ float CFG_GetRobotVoltage(void)
  */
 DS_String *CFG_GetGameData(void)
 {
-   return &game_data;
+   return &state()->game_data;
 }
 
 /**
@@ -248,7 +296,7 @@ DS_String *CFG_GetGameData(void)
  */
 DS_Alliance CFG_GetAlliance(void)
 {
-   return robot_alliance;
+   return state()->robot_alliance;
 }
 
 /**
@@ -259,7 +307,7 @@ DS_Alliance CFG_GetAlliance(void)
  */
 DS_Position CFG_GetPosition(void)
 {
-   return robot_position;
+   return state()->robot_position;
 }
 
 /**
@@ -267,7 +315,7 @@ DS_Position CFG_GetPosition(void)
  */
 int CFG_GetEmergencyStopped(void)
 {
-   return emergency_stopped == 1;
+   return state()->emergency_stopped == 1;
 }
 
 /**
@@ -276,7 +324,7 @@ int CFG_GetEmergencyStopped(void)
  */
 int CFG_GetFMSCommunications(void)
 {
-   return fms_communications == 1;
+   return state()->fms_communications == 1;
 }
 
 /**
@@ -285,7 +333,7 @@ int CFG_GetFMSCommunications(void)
  */
 int CFG_GetRadioCommunications(void)
 {
-   return radio_communications == 1;
+   return state()->radio_communications == 1;
 }
 
 /**
@@ -294,7 +342,7 @@ int CFG_GetRadioCommunications(void)
  */
 int CFG_GetRobotCommunications(void)
 {
-   return robot_communications == 1;
+   return state()->robot_communications == 1;
 }
 
 /**
@@ -305,7 +353,7 @@ int CFG_GetRobotCommunications(void)
  */
 DS_ControlMode CFG_GetControlMode(void)
 {
-   return control_mode;
+   return state()->control_mode;
 }
 
 /**
@@ -313,9 +361,9 @@ DS_ControlMode CFG_GetControlMode(void)
  */
 void CFG_SetRobotCode(const int code)
 {
-   if (robot_code != to_boolean(code))
+   if (state()->robot_code != to_boolean(code))
    {
-      robot_code = to_boolean(code);
+      state()->robot_code = to_boolean(code);
       create_robot_event(DS_ROBOT_CODE_CHANGED);
       create_robot_event(DS_STATUS_STRING_CHANGED);
    }
@@ -330,8 +378,8 @@ void CFG_SetGameData(const char *data)
    assert(data);
 
    /* Update game data */
-   DS_StrRmBuf(&game_data);
-   game_data = DS_StrNew(data);
+   DS_StrRmBuf(&state()->game_data);
+   state()->game_data = DS_StrNew(data);
 }
 
 /**
@@ -339,9 +387,9 @@ void CFG_SetGameData(const char *data)
  */
 void CFG_SetTeamNumber(const int number)
 {
-   if (team != number)
+   if (state()->team != number)
    {
-      team = number;
+      state()->team = number;
       CFG_ReconfigureAddresses(RECONFIGURE_ALL);
    }
 }
@@ -351,9 +399,9 @@ void CFG_SetTeamNumber(const int number)
  */
 void CFG_SetRobotEnabled(const int enabled)
 {
-   if (robot_enabled != to_boolean(enabled))
+   if (state()->robot_enabled != to_boolean(enabled))
    {
-      robot_enabled = to_boolean(enabled) && !CFG_GetEmergencyStopped();
+      state()->robot_enabled = to_boolean(enabled) && !CFG_GetEmergencyStopped();
       create_robot_event(DS_ROBOT_ENABLED_CHANGED);
       create_robot_event(DS_STATUS_STRING_CHANGED);
    }
@@ -365,9 +413,9 @@ void CFG_SetRobotEnabled(const int enabled)
  */
 void CFG_SetRobotCPUUsage(const int percent)
 {
-   if (cpu_usage != percent)
+   if (state()->cpu_usage != percent)
    {
-      cpu_usage = respect_range(percent, 0, 100);
+      state()->cpu_usage = respect_range(percent, 0, 100);
       create_robot_event(DS_ROBOT_CPU_INFO_CHANGED);
    }
 }
@@ -378,9 +426,9 @@ void CFG_SetRobotCPUUsage(const int percent)
  */
 void CFG_SetRobotRAMUsage(const int percent)
 {
-   if (ram_usage != percent)
+   if (state()->ram_usage != percent)
    {
-      ram_usage = respect_range(percent, 0, 100);
+      state()->ram_usage = respect_range(percent, 0, 100);
       create_robot_event(DS_ROBOT_RAM_INFO_CHANGED);
    }
 }
@@ -391,9 +439,9 @@ void CFG_SetRobotRAMUsage(const int percent)
  */
 void CFG_SetRobotDiskUsage(const int percent)
 {
-   if (disk_usage != percent)
+   if (state()->disk_usage != percent)
    {
-      disk_usage = respect_range(percent, 0, 100);
+      state()->disk_usage = respect_range(percent, 0, 100);
       create_robot_event(DS_ROBOT_DISK_INFO_CHANGED);
    }
 }
@@ -403,9 +451,9 @@ void CFG_SetRobotDiskUsage(const int percent)
  */
 void CFG_SetRobotVoltage(const float voltage)
 {
-   if (robot_voltage != voltage)
+   if (state()->robot_voltage != voltage)
    {
-      robot_voltage = roundf(voltage * 100) / 100;
+      state()->robot_voltage = roundf(voltage * 100) / 100;
       create_robot_event(DS_ROBOT_VOLTAGE_CHANGED);
    }
 }
@@ -415,9 +463,9 @@ void CFG_SetRobotVoltage(const float voltage)
  */
 void CFG_SetEmergencyStopped(const int stopped)
 {
-   if (emergency_stopped != to_boolean(stopped))
+   if (state()->emergency_stopped != to_boolean(stopped))
    {
-      emergency_stopped = to_boolean(stopped);
+      state()->emergency_stopped = to_boolean(stopped);
       create_robot_event(DS_ROBOT_ESTOP_CHANGED);
       create_robot_event(DS_STATUS_STRING_CHANGED);
    }
@@ -428,9 +476,9 @@ void CFG_SetEmergencyStopped(const int stopped)
  */
 void CFG_SetAlliance(const DS_Alliance alliance)
 {
-   if (robot_alliance != alliance)
+   if (state()->robot_alliance != alliance)
    {
-      robot_alliance = alliance;
+      state()->robot_alliance = alliance;
       create_robot_event(DS_ROBOT_STATION_CHANGED);
    }
 }
@@ -440,9 +488,9 @@ void CFG_SetAlliance(const DS_Alliance alliance)
  */
 void CFG_SetPosition(const DS_Position position)
 {
-   if (robot_position != position)
+   if (state()->robot_position != position)
    {
-      robot_position = position;
+      state()->robot_position = position;
       create_robot_event(DS_ROBOT_STATION_CHANGED);
    }
 }
@@ -452,9 +500,9 @@ void CFG_SetPosition(const DS_Position position)
  */
 void CFG_SetCANUtilization(const int utilization)
 {
-   if (can_utilization != utilization)
+   if (state()->can_utilization != utilization)
    {
-      can_utilization = utilization;
+      state()->can_utilization = utilization;
       create_robot_event(DS_ROBOT_CAN_UTIL_CHANGED);
    }
 }
@@ -464,9 +512,9 @@ void CFG_SetCANUtilization(const int utilization)
  */
 void CFG_SetControlMode(const DS_ControlMode mode)
 {
-   if (control_mode != mode)
+   if (state()->control_mode != mode)
    {
-      control_mode = mode;
+      state()->control_mode = mode;
       create_robot_event(DS_ROBOT_MODE_CHANGED);
       create_robot_event(DS_STATUS_STRING_CHANGED);
    }
@@ -477,13 +525,13 @@ void CFG_SetControlMode(const DS_ControlMode mode)
  */
 void CFG_SetFMSCommunications(const int communications)
 {
-   if (fms_communications != to_boolean(communications))
+   if (state()->fms_communications != to_boolean(communications))
    {
-      fms_communications = to_boolean(communications);
+      state()->fms_communications = to_boolean(communications);
 
       DS_Event event;
       event.fms.type = DS_FMS_COMMS_CHANGED;
-      event.fms.connected = fms_communications;
+      event.fms.connected = state()->fms_communications;
       DS_AddEvent(&event);
 
       DS_ResetFMSPackets();
@@ -495,13 +543,13 @@ void CFG_SetFMSCommunications(const int communications)
  */
 void CFG_SetRadioCommunications(const int communications)
 {
-   if (radio_communications != to_boolean(communications))
+   if (state()->radio_communications != to_boolean(communications))
    {
-      radio_communications = to_boolean(communications);
+      state()->radio_communications = to_boolean(communications);
 
       DS_Event event;
       event.radio.type = DS_RADIO_COMMS_CHANGED;
-      event.radio.connected = fms_communications;
+      event.radio.connected = state()->fms_communications;
       DS_AddEvent(&event);
 
       DS_ResetRadioPackets();
@@ -513,9 +561,9 @@ void CFG_SetRadioCommunications(const int communications)
  */
 void CFG_SetRobotCommunications(const int communications)
 {
-   if (robot_communications != to_boolean(communications))
+   if (state()->robot_communications != to_boolean(communications))
    {
-      robot_communications = to_boolean(communications);
+      state()->robot_communications = to_boolean(communications);
       create_robot_event(DS_ROBOT_COMMS_CHANGED);
       create_robot_event(DS_STATUS_STRING_CHANGED);
 
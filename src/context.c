@@ -0,0 +1,537 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Utils.h"
+#include "DS_Client.h"
+#include "DS_Config.h"
+#include "DS_Context.h"
+#include "DS_Joysticks.h"
+
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+/*
+ * Storage class used to keep a separate current context in every thread
+ */
+#if defined _MSC_VER
+#   define THREAD_LOCAL __declspec(thread)
+#else
+#   define THREAD_LOCAL __thread
+#endif
+
+/*
+ * Runs the given \a call with \a context as the current context
+ */
+#define WITH_CONTEXT(context, call)                                                                                    \
+   {                                                                                                                   \
+      DS_Context *previous = DS_SetCurrentContext(context);                                                           \
+      call;                                                                                                            \
+      DS_SetCurrentContext(previous);                                                                                  \
+   }
+
+/**
+ * Holds the state of every module for a driver station instance
+ */
+struct _context
+{
+   void *states[DS_CONTEXT_MODULE_COUNT]; /**< Module states */
+   struct _context *next; /**< Next context in the registry */
+   struct _context *next_ready; /**< Next context in the ready list */
+   int ready; /**< Set to \c 1 while the context is in the ready list */
+};
+
+/*
+ * The default context, its modules use their own static state
+ */
+static DS_Context default_context;
+
+/*
+ * The current context of the calling thread (\c NULL for the default one)
+ */
+static THREAD_LOCAL DS_Context *current_context = NULL;
+
+/*
+ * Registry of the contexts serviced by the protocol event loop
+ */
+static DS_Context *contexts = &default_context;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Contexts that have pending work for the event loop (guarded by the lock)
+ */
+static DS_Context *ready_contexts = NULL;
+
+/**
+ * Initializes the modules of the current context
+ */
+static void init_modules()
+{
+   CFG_Init();
+   Client_Init();
+   Events_Init();
+   Joysticks_Init();
+   Protocols_InitContext();
+}
+
+/**
+ * Closes the modules of the current context and releases their state
+ */
+static void close_modules()
+{
+   Protocols_CloseContext();
+   Joysticks_Close();
+   Events_Close();
+   Client_Close();
+   CFG_Close();
+}
+
+/**
+ * Initializes the modules of the default context
+ */
+void Contexts_Init(void)
+{
+   WITH_CONTEXT(&default_context, init_modules());
+}
+
+/**
+ * Closes the modules of the default context, contexts created with
+ * \c DS_ContextNew() must be deleted with \c DS_ContextFree()
+ */
+void Contexts_Close(void)
+{
+   WITH_CONTEXT(&default_context, close_modules());
+}
+
+/**
+ * Locks the context registry, while the lock is held, no context can be
+ * deleted and no protocol can be (re)configured
+ */
+void Contexts_Lock(void)
+{
+   pthread_mutex_lock(&lock);
+}
+
+/**
+ * Unlocks the context registry
+ */
+void Contexts_Unlock(void)
+{
+   pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Calls \a func once for every registered context, with the context set as
+ * the current context of the calling thread.
+ *
+ * \note The caller must hold the registry lock (see \c Contexts_Lock())
+ */
+void Contexts_ForEach(void (*func)(void))
+{
+   assert(func);
+
+   DS_Context *context;
+   DS_Context *previous = current_context;
+   for (context = contexts; context; context = context->next)
+   {
+      current_context = context;
+      func();
+   }
+
+   current_context = previous;
+}
+
+/**
+ * Adds the given \a context to the list of contexts that are serviced by
+ * the next call to \c Contexts_ForEachReady() (e.g. because one of its
+ * sockets received data or one of its timers expired).
+ *
+ * \note The caller must hold the registry lock, and must service the ready
+ *       contexts before releasing it
+ */
+void Contexts_MarkReady(DS_Context *context)
+{
+   assert(context);
+
+   if (context->ready)
+      return;
+
+   context->ready = 1;
+   context->next_ready = ready_contexts;
+   ready_contexts = context;
+}
+
+/**
+ * Calls \a func once for every context marked with \c Contexts_MarkReady(),
+ * with the context set as the current context of the calling thread. The
+ * ready list is empty when this function returns.
+ *
+ * \note The caller must hold the registry lock (see \c Contexts_Lock())
+ */
+void Contexts_ForEachReady(void (*func)(void))
+{
+   assert(func);
+
+   DS_Context *previous = current_context;
+   while (ready_contexts)
+   {
+      DS_Context *context = ready_contexts;
+      ready_contexts = context->next_ready;
+      context->next_ready = NULL;
+      context->ready = 0;
+
+      current_context = context;
+      func();
+   }
+
+   current_context = previous;
+}
+
+/**
+ * Returns the state of the given \a module for the current context, or
+ * \c NULL if the module has not been initialized for it
+ */
+void *Contexts_GetState(const DS_ContextModule module)
+{
+   return DS_CurrentContext()->states[module];
+}
+
+/**
+ * Assigns the state of the given \a module for the current context. The
+ * default context uses the static \a default_state of the module, other
+ * contexts get a zero-initialized block of \a size bytes.
+ *
+ * \returns the state that the module must initialize
+ */
+void *Contexts_CreateState(const DS_ContextModule module, void *default_state, const size_t size)
+{
+   assert(default_state);
+
+   DS_Context *context = DS_CurrentContext();
+   if (context == &default_context)
+      context->states[module] = default_state;
+   else
+      context->states[module] = calloc(1, size);
+
+   assert(context->states[module]);
+   return context->states[module];
+}
+
+/**
+ * Releases the state of the given \a module for the current context
+ */
+void Contexts_DestroyState(const DS_ContextModule module)
+{
+   DS_Context *context = DS_CurrentContext();
+   if (context != &default_context)
+      DS_FREE(context->states[module]);
+
+   context->states[module] = NULL;
+}
+
+/**
+ * Creates a new driver station context and registers it to the protocol
+ * event loop. The new context has no protocol, configure one with
+ * \c DS_ContextConfigureProtocol() to start communicating with a robot.
+ *
+ * \note \c DS_Init() must be called before creating any context
+ */
+DS_Context *DS_ContextNew(void)
+{
+   DS_Context *context = (DS_Context *)calloc(1, sizeof(DS_Context));
+   assert(context);
+
+   /* Initialize the modules */
+   WITH_CONTEXT(context, init_modules());
+
+   /* Register the context */
+   Contexts_Lock();
+   context->next = contexts;
+   contexts = context;
+   Contexts_Unlock();
+
+   return context;
+}
+
+/**
+ * Closes the protocol of the given \a context, releases its resources and
+ * deletes it. The default context cannot be deleted.
+ */
+void DS_ContextFree(DS_Context *context)
+{
+   /* Check arguments */
+   assert(context);
+   assert(context != &default_context);
+
+   /* Unregister the context, so that the event loop stops using it */
+   Contexts_Lock();
+   DS_Context **ptr = &contexts;
+   while (*ptr && *ptr != context)
+      ptr = &(*ptr)->next;
+   if (*ptr)
+      *ptr = context->next;
+   Contexts_Unlock();
+
+   /* Close the modules and delete the context */
+   WITH_CONTEXT(context, close_modules());
+   free(context);
+
+   /* The calling thread must not keep using the deleted context */
+   if (current_context == context)
+      current_context = NULL;
+}
+
+/**
+ * Returns the default context, used by threads that have not selected
+ * another context with \c DS_SetCurrentContext()
+ */
+DS_Context *DS_DefaultContext(void)
+{
+   return &default_context;
+}
+
+/**
+ * Returns the current context of the calling thread
+ */
+DS_Context *DS_CurrentContext(void)
+{
+   if (current_context)
+      return current_context;
+
+   return &default_context;
+}
+
+/**
+ * Makes the given \a context the current context of the calling thread, the
+ * rest of the LibDS API (called from this thread) will operate on it.
+ * Passing \c NULL selects the default context.
+ *
+ * \returns the previous context of the calling thread
+ */
+DS_Context *DS_SetCurrentContext(DS_Context *context)
+{
+   DS_Context *previous = DS_CurrentContext();
+   current_context = (context == &default_context) ? NULL : context;
+   return previous;
+}
+
+/**
+ * Context-taking variant of \c DS_PollEvent()
+ */
+int DS_ContextPollEvent(DS_Context *context, DS_Event *event)
+{
+   int result;
+   WITH_CONTEXT(context, result = DS_PollEvent(event));
+   return result;
+}
+
+/**
+ * Context-taking variant of \c DS_GetEventFd()
+ */
+int DS_ContextGetEventFd(DS_Context *context)
+{
+   int result;
+   WITH_CONTEXT(context, result = DS_GetEventFd());
+   return result;
+}
+
+/**
+ * Context-taking variant of \c DS_SetTransport()
+ */
+void DS_ContextSetTransport(DS_Context *context, const DS_Transport *transport)
+{
+   WITH_CONTEXT(context, DS_SetTransport(transport));
+}
+
+/**
+ * Context-taking variant of \c DS_ConfigureProtocol()
+ */
+void DS_ContextConfigureProtocol(DS_Context *context, const DS_Protocol *protocol)
+{
+   WITH_CONTEXT(context, DS_ConfigureProtocol(protocol));
+}
+
+/**
+ * Context-taking variant of \c DS_SetTeamNumber()
+ */
+void DS_ContextSetTeamNumber(DS_Context *context, const int team)
+{
+   WITH_CONTEXT(context, DS_SetTeamNumber(team));
+}
+
+/**
+ * Context-taking variant of \c DS_SetRobotEnabled()
+ */
+void DS_ContextSetRobotEnabled(DS_Context *context, const int enabled)
+{
+   WITH_CONTEXT(context, DS_SetRobotEnabled(enabled));
+}
+
+/**
+ * Context-taking variant of \c DS_SetEmergencyStopped()
+ */
+void DS_ContextSetEmergencyStopped(DS_Context *context, const int stop)
+{
+   WITH_CONTEXT(context, DS_SetEmergencyStopped(stop));
+}
+
+/**
+ * Context-taking variant of \c DS_SetAlliance()
+ */
+void DS_ContextSetAlliance(DS_Context *context, const DS_Alliance alliance)
+{
+   WITH_CONTEXT(context, DS_SetAlliance(alliance));
+}
+
+/**
+ * Context-taking variant of \c DS_SetPosition()
+ */
+void DS_ContextSetPosition(DS_Context *context, const DS_Position position)
+{
+   WITH_CONTEXT(context, DS_SetPosition(position));
+}
+
+/**
+ * Context-taking variant of \c DS_SetControlMode()
+ */
+void DS_ContextSetControlMode(DS_Context *context, const DS_ControlMode mode)
+{
+   WITH_CONTEXT(context, DS_SetControlMode(mode));
+}
+
+/**
+ * Context-taking variant of \c DS_SetCustomFMSAddress()
+ */
+void DS_ContextSetCustomFMSAddress(DS_Context *context, const char *address)
+{
+   WITH_CONTEXT(context, DS_SetCustomFMSAddress(address));
+}
+
+/**
+ * Context-taking variant of \c DS_SetCustomRobotAddress()
+ */
+void DS_ContextSetCustomRobotAddress(DS_Context *context, const char *address)
+{
+   WITH_CONTEXT(context, DS_SetCustomRobotAddress(address));
+}
+
+/**
+ * Context-taking variant of \c DS_GetRobotCode()
+ */
+int DS_ContextGetRobotCode(DS_Context *context)
+{
+   int result;
+   WITH_CONTEXT(context, result = DS_GetRobotCode());
+   return result;
+}
+
+/**
+ * Context-taking variant of \c DS_GetRobotEnabled()
+ */
+int DS_ContextGetRobotEnabled(DS_Context *context)
+{
+   int result;
+   WITH_CONTEXT(context, result = DS_GetRobotEnabled());
+   return result;
+}
+
+/**
+ * Context-taking variant of \c DS_GetRobotVoltage()
+ */
+float DS_ContextGetRobotVoltage(DS_Context *context)
+{
+   float result;
+   WITH_CONTEXT(context, result = DS_GetRobotVoltage());
+   return result;
+}
+
+/**
+ * Context-taking variant of \c DS_GetFMSCommunications()
+ */
+int DS_ContextGetFMSCommunications(DS_Context *context)
+{
+   int result;
+   WITH_CONTEXT(context, result = DS_GetFMSCommunications());
+   return result;
+}
+
+/**
+ * Context-taking variant of \c DS_GetRobotCommunications()
+ */
+int DS_ContextGetRobotCommunications(DS_Context *context)
+{
+   int result;
+   WITH_CONTEXT(context, result = DS_GetRobotCommunications());
+   return result;
+}
+
+/**
+ * Context-taking variant of \c DS_GetLinkStats()
+ */
+DS_LinkStats DS_ContextGetLinkStats(DS_Context *context, const DS_Link link)
+{
+   DS_LinkStats result;
+   WITH_CONTEXT(context, result = DS_GetLinkStats(link));
+   return result;
+}
+
+/**
+ * Context-taking variant of \c DS_JoysticksAdd()
+ */
+void DS_ContextJoysticksAdd(DS_Context *context, const int axes, const int hats, const int buttons)
+{
+   WITH_CONTEXT(context, DS_JoysticksAdd(axes, hats, buttons));
+}
+
+/**
+ * Context-taking variant of \c DS_SetJoystickHat()
+ */
+void DS_ContextSetJoystickHat(DS_Context *context, int joystick, int hat, int angle)
+{
+   WITH_CONTEXT(context, DS_SetJoystickHat(joystick, hat, angle));
+}
+
+/**
+ * Context-taking variant of \c DS_SetJoystickAxis()
+ */
+void DS_ContextSetJoystickAxis(DS_Context *context, int joystick, int axis, float value)
+{
+   WITH_CONTEXT(context, DS_SetJoystickAxis(joystick, axis, value));
+}
+
+/**
+ * Context-taking variant of \c DS_SetJoystickButton()
+ */
+void DS_ContextSetJoystickButton(DS_Context *context, int joystick, int button, int pressed)
+{
+   WITH_CONTEXT(context, DS_SetJoystickButton(joystick, button, pressed));
+}
+
+/**
+ * Context-taking variant of \c DS_SetJoystickState()
+ */
+void DS_ContextSetJoystickState(DS_Context *context, int joystick, const float *axes, uint64_t buttons,
+                                const int16_t *hats)
+{
+   WITH_CONTEXT(context, DS_SetJoystickState(joystick, axes, buttons, hats));
+}
@@ -43,8 +43,24 @@
 #include "DS_Utils.h"
 
 #include <assert.h>
+#include <pthread.h>
 
-static uint32_t crc32_tab[]
+/*
+ * The carry-less multiplication kernel is only built for x86-64 with GCC
+ * or Clang (which can enable the instructions for a single function)
+ */
+#if defined __x86_64__ && (defined __GNUC__ || defined __clang__)
+#   define USE_PCLMUL 1
+#   include <cpuid.h>
+#   include <immintrin.h>
+#endif
+
+/**
+ * Updates the (pre-inverted) CRC register \a crc with \a size bytes of \a p
+ */
+typedef uint32_t (*CRC32Kernel)(uint32_t crc, const uint8_t *p, size_t size);
+
+static const uint32_t crc32_tab[]
     = { 0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3, 0x0edb8832,
         0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
         0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7, 0x136c9856, 0x646ba8c0, 0xfd62f97a,
@@ -75,17 +91,348 @@ static uint32_t crc32_tab[]
         0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
         0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d };
 
+/*
+ * Tables of the slicing-by-8 algorithm: crc32_slices[k][n] is the CRC of
+ * byte n followed by k zero bytes (crc32_slices[0] is crc32_tab)
+ */
+static uint32_t crc32_slices[8][256];
+
+/*
+ * Kernel selected by init_crc32() for the CPU
+ */
+static CRC32Kernel crc32_kernel = NULL;
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Reversed CRC32 polynomial and the powers x^(2^n) modulo the polynomial,
+ * used to combine the CRC32 of two blocks of data
+ */
+#define CRC32_POLY 0xEDB88320UL
+static uint32_t crc32_x2n[32];
+
+/**
+ * Reads a little-endian 32-bit word from \a p
+ */
+static uint32_t read_le32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Updates the CRC register one byte at a time (the original algorithm)
+ */
+static uint32_t crc32_bytewise(uint32_t crc, const uint8_t *p, size_t size)
+{
+   while (size--)
+      crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+
+   return crc;
+}
+
+/**
+ * Updates the CRC register eight bytes at a time, using one table lookup
+ * for each byte instead of a chain of eight dependent lookups
+ */
+static uint32_t crc32_slicing_by_8(uint32_t crc, const uint8_t *p, size_t size)
+{
+   while (size >= 8)
+   {
+      uint32_t lo = crc ^ read_le32(p);
+      uint32_t hi = read_le32(p + 4);
+
+      crc = crc32_slices[7][lo & 0xFF] ^ crc32_slices[6][(lo >> 8) & 0xFF] ^ crc32_slices[5][(lo >> 16) & 0xFF]
+            ^ crc32_slices[4][lo >> 24] ^ crc32_slices[3][hi & 0xFF] ^ crc32_slices[2][(hi >> 8) & 0xFF]
+            ^ crc32_slices[1][(hi >> 16) & 0xFF] ^ crc32_slices[0][hi >> 24];
+
+      p += 8;
+      size -= 8;
+   }
+
+   return crc32_bytewise(crc, p, size);
+}
+
+/**
+ * Returns \a a * \a b modulo the CRC32 polynomial (both are polynomials
+ * with reflected bits), \a a must not be zero
+ */
+static uint32_t multiply_mod_poly(uint32_t a, uint32_t b)
+{
+   uint32_t m = 1UL << 31;
+   uint32_t p = 0;
+
+   for (;;)
+   {
+      if (a & m)
+      {
+         p ^= b;
+         if ((a & (m - 1)) == 0)
+            break;
+      }
+
+      m >>= 1;
+      b = (b & 1) ? (b >> 1) ^ CRC32_POLY : b >> 1;
+   }
+
+   return p;
+}
+
+/**
+ * Returns x^(\a n * 2^\a k) modulo the CRC32 polynomial
+ */
+static uint32_t x2n_mod_poly(size_t n, unsigned int k)
+{
+   uint32_t p = 1UL << 31;
+
+   while (n)
+   {
+      if (n & 1)
+         p = multiply_mod_poly(crc32_x2n[k & 31], p);
+
+      n >>= 1;
+      ++k;
+   }
+
+   return p;
+}
+
+#if defined USE_PCLMUL
+/**
+ * Updates the CRC register by folding blocks of 64 bytes with carry-less
+ * multiplications and reducing the result with the Barrett method, see
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+ * (Intel, 2009). The constants are those of the bit-reflected polynomial.
+ *
+ * The \a size must be a multiple of 16 and at least 64 bytes.
+ */
+__attribute__((target("pclmul,sse4.1"))) static uint32_t crc32_fold(uint32_t crc, const uint8_t *p, size_t size)
+{
+   const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+   const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+   const __m128i k5k0 = _mm_set_epi64x(0x0000000000LL, 0x0163cd6124LL);
+   const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+   const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+
+   __m128i x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+   __m128i x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+   __m128i x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+   __m128i x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+   __m128i x5, x6, x7, x8;
+
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+   p += 64;
+   size -= 64;
+
+   /* Fold four blocks of 16 bytes in parallel */
+   while (size >= 64)
+   {
+      x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+      x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(p + 0x00)));
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(p + 0x10)));
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(p + 0x20)));
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(p + 0x30)));
+
+      p += 64;
+      size -= 64;
+   }
+
+   /* Fold the four blocks into one */
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+   x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+   /* Fold the remaining blocks of 16 bytes */
+   while (size >= 16)
+   {
+      x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)p)), x5);
+
+      p += 16;
+      size -= 16;
+   }
+
+   /* Fold 128 bits to 64 bits */
+   x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+   x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_and_si128(x1, mask);
+   x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   /* Barrett reduction to 32 bits */
+   x2 = _mm_and_si128(x1, mask);
+   x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+   x2 = _mm_and_si128(x2, mask);
+   x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+/**
+ * Updates the CRC register with the carry-less multiplication kernel, the
+ * bytes that do not fill a block of 16 bytes are handled by slicing-by-8
+ */
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t *p, size_t size)
+{
+   if (size >= 64)
+   {
+      size_t blocks = size & ~(size_t)15;
+      crc = crc32_fold(crc, p, blocks);
+      p += blocks;
+      size -= blocks;
+   }
+
+   return crc32_slicing_by_8(crc, p, size);
+}
+
+/**
+ * Returns \c 1 if the CPU supports the PCLMULQDQ and SSE4.1 instructions
+ */
+static int cpu_has_pclmul(void)
+{
+   unsigned int eax, ebx, ecx, edx;
+   if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+      return 0;
+
+   return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+#endif
+
+/**
+ * Returns \c 1 if the given \a kernel gives the same results as the
+ * original (byte at a time) algorithm, for every length up to 300 bytes and
+ * for every alignment of the data
+ */
+static int kernel_matches_table(CRC32Kernel kernel)
+{
+   size_t i, size;
+   uint8_t data[320];
+   for (i = 0; i < sizeof(data); ++i)
+      data[i] = (uint8_t)((i * 151) ^ (i >> 3));
+
+   for (i = 0; i < 16; ++i)
+   {
+      for (size = 0; size <= 300; ++size)
+      {
+         uint32_t crc = (uint32_t)(size * 2654435761U);
+         if (kernel(crc, data + i, size) != crc32_bytewise(crc, data + i, size))
+            return 0;
+      }
+   }
+
+   return 1;
+}
+
+/**
+ * Generates the slicing-by-8 tables and selects the fastest kernel that
+ * the CPU supports (and that gives the same results as the original table)
+ */
+static void init_crc32(void)
+{
+   int i, k;
+   for (i = 0; i < 256; ++i)
+      crc32_slices[0][i] = crc32_tab[i];
+
+   for (k = 1; k < 8; ++k)
+   {
+      for (i = 0; i < 256; ++i)
+      {
+         uint32_t prev = crc32_slices[k - 1][i];
+         crc32_slices[k][i] = (prev >> 8) ^ crc32_tab[prev & 0xFF];
+      }
+   }
+
+   uint32_t p = 1UL << 30;
+   crc32_x2n[0] = p;
+   for (i = 1; i < 32; ++i)
+      crc32_x2n[i] = p = multiply_mod_poly(p, p);
+
+   crc32_kernel = &crc32_bytewise;
+   if (kernel_matches_table(&crc32_slicing_by_8))
+      crc32_kernel = &crc32_slicing_by_8;
+
+#if defined USE_PCLMUL
+   if (cpu_has_pclmul() && kernel_matches_table(&crc32_pclmul))
+      crc32_kernel = &crc32_pclmul;
+#endif
+}
+
+/**
+ * Continues the CRC32 \a crc of the previous data with \a size bytes of
+ * \a buf, and returns the CRC32 of all the data. The first call must use
+ * a \a crc of \c 0, so that calculating the CRC32 of a buffer in several
+ * chunks gives the same result as \c DS_CRC32() of the whole buffer:
+ *
+ * \code
+ * uint32_t crc = DS_CRC32Update(0, header, header_size);
+ * crc = DS_CRC32Update(crc, payload, payload_size);
+ * \endcode
+ */
+uint32_t DS_CRC32Update(const uint32_t crc, const void *buf, size_t size)
+{
+   assert(buf || size == 0);
+
+   pthread_once(&crc32_once, &init_crc32);
+   return crc32_kernel(crc ^ 0xFFFFFFFFUL, (const uint8_t *)buf, size) ^ 0xFFFFFFFFUL;
+}
+
+/**
+ * Returns the CRC32 (as used by zlib and Ethernet) of \a size bytes of \a buf
+ */
 uint32_t DS_CRC32(const void *buf, size_t size)
 {
    assert(buf);
 
-   const uint8_t *p;
-   uint32_t crc = 0xFFFFFFFFUL;
+   return DS_CRC32Update(0, buf, size);
+}
 
-   p = buf;
+/**
+ * Returns the operator used by \c DS_CRC32CombineOp() to append the CRC32
+ * of \a size bytes. Computing the operator takes a few hundred operations,
+ * so callers that always append blocks of the same size should keep it.
+ */
+uint32_t DS_CRC32CombineGen(size_t size)
+{
+   pthread_once(&crc32_once, &init_crc32);
+   return x2n_mod_poly(size, 3);
+}
 
-   while (size--)
-      crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+/**
+ * Returns the CRC32 of the concatenation of two blocks, given the CRC32 of
+ * the first block (\a crc1), the CRC32 of the second block (\a crc2) and the
+ * operator returned by \c DS_CRC32CombineGen() for the size of the second
+ * block
+ */
+uint32_t DS_CRC32CombineOp(const uint32_t crc1, const uint32_t crc2, const uint32_t op)
+{
+   return multiply_mod_poly(op, crc1) ^ crc2;
+}
 
-   return crc ^ 0xFFFFFFFFUL;
+/**
+ * Returns the CRC32 of the concatenation of two blocks, given the CRC32 of
+ * the first block (\a crc1), the CRC32 of the second block (\a crc2) and the
+ * size of the second block
+ */
+uint32_t DS_CRC32Combine(const uint32_t crc1, const uint32_t crc2, size_t size2)
+{
+   return DS_CRC32CombineOp(crc1, crc2, DS_CRC32CombineGen(size2));
 }
@@ -21,60 +21,400 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-#include "DS_Queue.h"
+#include "DS_Utils.h"
+#include "DS_Timer.h"
 #include "DS_Events.h"
+#include "DS_Context.h"
 
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <pthread.h>
 
-static DS_Queue events;
+/*
+ * On Linux, an eventfd is used to notify event loops (and waiting threads)
+ * that new events are available. Other platforms use a condition variable,
+ * which can only be used by DS_WaitEvent()
+ */
+#if defined __linux__
+#   define USE_EVENTFD 1
+#   include <poll.h>
+#   include <errno.h>
+#   include <unistd.h>
+#   include <sys/eventfd.h>
+#else
+#   include <time.h>
+#endif
+
+/*
+ * Maximum number of pending events (must be a power of two). When the queue
+ * is full, new events are discarded and counted by \c DS_DroppedEvents()
+ */
+#define QUEUE_SIZE 1024
+#define QUEUE_MASK (QUEUE_SIZE - 1)
+
+/*
+ * Size of a CPU cache line, used to keep the producer and consumer indexes
+ * from sharing the same line
+ */
+#define CACHE_LINE_SIZE 64
 
 /**
- * Initializes the event queue with an initial support for 50 events
+ * Holds an event and the sequence number used to synchronize the producers
+ * with the consumer (see Dmitry Vyukov's bounded MPMC queue)
+ */
+typedef struct
+{
+   unsigned int sequence;
+   DS_Event event;
+} EventCell;
+
+/**
+ * Queue index, padded to fill an entire cache line
+ */
+typedef struct
+{
+   unsigned int value;
+   char padding[CACHE_LINE_SIZE - sizeof(unsigned int)];
+} PaddedIndex;
+
+/**
+ * The event queue, events can be added by any thread (e.g. the protocol
+ * thread and the application thread), but they must be polled by a single
+ * thread (usually the application's main thread).
+ *
+ * The notification primitives are used to wake up the thread that waits
+ * for events.
+ */
+typedef struct
+{
+   PaddedIndex enqueue_pos;
+   PaddedIndex dequeue_pos;
+   PaddedIndex dropped_events;
+   EventCell cells[QUEUE_SIZE];
+
+#if defined USE_EVENTFD
+   int event_fd;
+#else
+   unsigned int waiters;
+   pthread_cond_t wait_cond;
+   pthread_mutex_t wait_lock;
+#endif
+} EventQueue;
+
+/*
+ * Event queue of the default context
+ */
+#if defined USE_EVENTFD
+static EventQueue default_queue = { { 0 }, { 0 }, { 0 }, { { 0 } }, -1 };
+#else
+static EventQueue default_queue
+    = { { 0 }, { 0 }, { 0 }, { { 0 } }, 0, PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER };
+#endif
+
+/**
+ * Returns the event queue of the current context
+ */
+static EventQueue *queue(void)
+{
+   EventQueue *ptr = (EventQueue *)Contexts_GetState(DS_CONTEXT_EVENTS);
+   return ptr ? ptr : &default_queue;
+}
+
+/**
+ * Releases the memory owned by the given \a event (if any)
+ */
+static void free_event(DS_Event *event)
+{
+   if (event->type == DS_NETCONSOLE_NEW_MESSAGE)
+      DS_FREE(event->netconsole.message);
+}
+
+/**
+ * Notifies the waiting thread (or event loop) that a new event is available
+ */
+static void notify_consumer(EventQueue *ptr)
+{
+#if defined USE_EVENTFD
+   uint64_t value = 1;
+   if (ptr->event_fd >= 0 && write(ptr->event_fd, &value, sizeof(value)) < 0)
+      return;
+#else
+   /* Only take the lock if someone is actually waiting */
+   if (DS_AtomicAdd(&ptr->waiters, 0) > 0)
+   {
+      pthread_mutex_lock(&ptr->wait_lock);
+      pthread_cond_broadcast(&ptr->wait_cond);
+      pthread_mutex_unlock(&ptr->wait_lock);
+   }
+#endif
+}
+
+/**
+ * Clears the notification state once the queue has been emptied, so that
+ * the descriptor returned by \c DS_GetEventFd() stops being readable
+ */
+static void clear_notifications(EventQueue *ptr)
+{
+#if defined USE_EVENTFD
+   uint64_t value;
+   if (ptr->event_fd >= 0 && read(ptr->event_fd, &value, sizeof(value)) < 0)
+      return;
+#else
+   (void)ptr;
+#endif
+}
+
+/**
+ * Initializes the event queue of the current context with support for
+ * \c QUEUE_SIZE pending events
  */
 void Events_Init(void)
 {
-   DS_QueueInit(&events, 50, sizeof(DS_Event));
+   EventQueue *ptr = (EventQueue *)Contexts_CreateState(DS_CONTEXT_EVENTS, &default_queue, sizeof(EventQueue));
+
+   int i;
+   for (i = 0; i < QUEUE_SIZE; ++i)
+      DS_AtomicStore(&ptr->cells[i].sequence, (unsigned int)i);
+
+   DS_AtomicStore(&ptr->enqueue_pos.value, 0);
+   DS_AtomicStore(&ptr->dequeue_pos.value, 0);
+   DS_AtomicStore(&ptr->dropped_events.value, 0);
+
+#if defined USE_EVENTFD
+   ptr->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+   ptr->waiters = 0;
+   pthread_cond_init(&ptr->wait_cond, NULL);
+   pthread_mutex_init(&ptr->wait_lock, NULL);
+#endif
 }
 
 /**
- * De-allocates the event queue (that's all)
+ * Discards the pending events of the current context and releases the
+ * memory owned by them
  */
 void Events_Close(void)
 {
-   DS_QueueFree(&events);
+   DS_Event event;
+   while (DS_PollEvent(&event))
+      free_event(&event);
+
+   EventQueue *ptr = queue();
+
+#if defined USE_EVENTFD
+   if (ptr->event_fd >= 0)
+      close(ptr->event_fd);
+
+   ptr->event_fd = -1;
+#else
+   pthread_cond_destroy(&ptr->wait_cond);
+   pthread_mutex_destroy(&ptr->wait_lock);
+#endif
+
+   Contexts_DestroyState(DS_CONTEXT_EVENTS);
 }
 
 /**
- * Adds the given \a event to the event queue
+ * Adds the given \a event to the event queue, this function is thread-safe
+ * and never blocks.
+ *
+ * If the queue is full (e.g. the application does not poll its events), the
+ * given \a event is discarded, the memory owned by it is released and the
+ * value returned by \c DS_DroppedEvents() is increased.
  *
  * \param event the event to register in the event queue
  */
 void DS_AddEvent(DS_Event *event)
 {
    assert(event);
-   DS_QueuePush(&events, (void *)event);
+
+   EventCell *cell;
+   EventQueue *ptr = queue();
+   unsigned int pos = DS_AtomicLoad(&ptr->enqueue_pos.value);
+
+   /* Reserve a cell */
+   while (1)
+   {
+      cell = &ptr->cells[pos & QUEUE_MASK];
+      int diff = (int)(DS_AtomicLoad(&cell->sequence) - pos);
+
+      /* Cell is free, try to claim it */
+      if (diff == 0)
+      {
+         if (DS_AtomicCAS(&ptr->enqueue_pos.value, pos, pos + 1))
+            break;
+      }
+
+      /* Queue is full, discard the event */
+      else if (diff < 0)
+      {
+         DS_AtomicAdd(&ptr->dropped_events.value, 1);
+         free_event(event);
+         return;
+      }
+
+      /* Another thread claimed the cell, try again */
+      pos = DS_AtomicLoad(&ptr->enqueue_pos.value);
+   }
+
+   /* Write the event and publish it to the consumer */
+   memcpy(&cell->event, event, sizeof(DS_Event));
+   DS_AtomicStore(&cell->sequence, pos + 1);
+
+   /* Wake up the consumer */
+   notify_consumer(ptr);
 }
 
 /**
  * Polls for currently pending events and copies the first event in the queue
  * to the given \a event object.
  *
+ * \note This function must always be called from the same thread
+ *
  * \returns 1 if there are any pending events, or 0 if there are none available.
  *
  * \param event we write the obtained event data here
  */
 int DS_PollEvent(DS_Event *event)
 {
-   DS_Event *front = (DS_Event *)DS_QueueGetFirst(&events);
+   assert(event);
 
-   if (front)
+   EventQueue *ptr = queue();
+   unsigned int pos = ptr->dequeue_pos.value;
+   EventCell *cell = &ptr->cells[pos & QUEUE_MASK];
+
+   /* No event has been published in this cell */
+   if ((int)(DS_AtomicLoad(&cell->sequence) - (pos + 1)) < 0)
    {
-      DS_QueuePop(&events);
-      memcpy(event, front, sizeof(DS_Event));
+      /* Queue is empty, reset the notifications and check again (in case
+       * an event was published before we cleared its notification) */
+      clear_notifications(ptr);
+      if ((int)(DS_AtomicLoad(&cell->sequence) - (pos + 1)) < 0)
+         return 0;
+   }
+
+   /* Copy the event and release the cell to the producers */
+   memcpy(event, &cell->event, sizeof(DS_Event));
+   DS_AtomicStore(&cell->sequence, pos + QUEUE_SIZE);
+   DS_AtomicStore(&ptr->dequeue_pos.value, pos + 1);
+
+   return 1;
+}
+
+/**
+ * Waits until an event is available (or until \a timeout milliseconds have
+ * passed) and copies the first event in the queue to the given \a event.
+ *
+ * A negative \a timeout waits indefinitely, a \a timeout of \c 0 behaves
+ * like \c DS_PollEvent().
+ *
+ * \note This function must be called from the same thread as \c DS_PollEvent()
+ *
+ * \returns 1 if an event was obtained, or 0 if the timeout expired
+ */
+int DS_WaitEvent(DS_Event *event, const int timeout)
+{
+   assert(event);
+
+   /* Event is already available (or we shall not wait) */
+   if (DS_PollEvent(event))
       return 1;
+   if (timeout == 0)
+      return 0;
+
+   EventQueue *ptr = queue();
+
+#if defined USE_EVENTFD
+   if (ptr->event_fd < 0)
+      return 0;
+
+   /* Calculate the deadline */
+   uint64_t deadline = DS_GetMonotonicTime() + ((uint64_t)DS_Max(timeout, 0) * 1000000ULL);
+
+   /* Wait for the eventfd to become readable */
+   while (1)
+   {
+      int wait = -1;
+      if (timeout > 0)
+      {
+         uint64_t now = DS_GetMonotonicTime();
+         if (now >= deadline)
+            return 0;
+
+         wait = (int)((deadline - now + 999999ULL) / 1000000ULL);
+      }
+
+      struct pollfd pfd;
+      pfd.fd = ptr->event_fd;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, wait) < 0 && errno != EINTR)
+         return 0;
+
+      if (DS_PollEvent(event))
+         return 1;
+   }
+#else
+   /* Calculate the absolute deadline */
+   struct timespec deadline;
+#   if defined _WIN32
+   timespec_get(&deadline, TIME_UTC);
+#   else
+   clock_gettime(CLOCK_REALTIME, &deadline);
+#   endif
+   deadline.tv_sec += timeout / 1000;
+   deadline.tv_nsec += (long)(timeout % 1000) * 1000000L;
+   if (deadline.tv_nsec >= 1000000000L)
+   {
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+   }
+
+   /* Register as a waiter, so that producers signal the condition */
+   int error = 0;
+   int obtained = 0;
+   DS_AtomicAdd(&ptr->waiters, 1);
+   pthread_mutex_lock(&ptr->wait_lock);
+   while (!(obtained = DS_PollEvent(event)) && !error)
+   {
+      if (timeout < 0)
+         error = pthread_cond_wait(&ptr->wait_cond, &ptr->wait_lock);
+      else
+         error = pthread_cond_timedwait(&ptr->wait_cond, &ptr->wait_lock, &deadline);
    }
+   pthread_mutex_unlock(&ptr->wait_lock);
+   DS_AtomicAdd(&ptr->waiters, (unsigned int)-1);
+
+   return obtained;
+#endif
+}
 
-   return 0;
+/**
+ * Returns a file descriptor that becomes readable when new events are added
+ * to the queue, so that applications can integrate the LibDS events in their
+ * own event loops (e.g. with \c poll(), \c epoll or a \c QSocketNotifier).
+ *
+ * Once the descriptor is readable, call \c DS_PollEvent() until it returns
+ * \c 0, which also resets the readable state of the descriptor.
+ *
+ * \returns the descriptor, or \c -1 if the current platform does not
+ *          support it (use \c DS_WaitEvent() or \c DS_PollEvent() instead)
+ */
+int DS_GetEventFd(void)
+{
+#if defined USE_EVENTFD
+   return queue()->event_fd;
+#else
+   return -1;
+#endif
+}
+
+/**
+ * Returns the number of events that were discarded because the event queue
+ * was full when they were added
+ */
+unsigned int DS_DroppedEvents(void)
+{
+   return DS_AtomicLoad(&queue()->dropped_events.value);
 }
@@ -38,10 +38,8 @@ void DS_Init(void)
       init = 1;
 
       Timers_Init();
-      Client_Init();
-      Events_Init();
       Sockets_Init();
-      Joysticks_Init();
+      Contexts_Init();
       Protocols_Init();
    }
 }
@@ -61,10 +59,7 @@ void DS_Close(void)
       Timers_Close();
       Sockets_Close();
       Protocols_Close();
-      Joysticks_Close();
-
-      Events_Close();
-      Client_Close();
+      Contexts_Close();
    }
 }
 
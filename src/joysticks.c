@@ -21,30 +21,77 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-#include "DS_Array.h"
+#include "DS_Utils.h"
 #include "DS_Config.h"
 #include "DS_Events.h"
+#include "DS_Context.h"
 #include "DS_Joysticks.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+/*
+ * Number of joysticks, axes and hats that fit in a new joystick store
+ */
+#define INITIAL_JOYSTICKS 6
+#define INITIAL_AXES 32
+#define INITIAL_HATS 8
 
 /**
- * Represents a joystick and its information
+ * Describes a joystick, its values are stored in the blocks of the
+ * joystick store (see \c JoystickState)
  */
-typedef struct _joystick
+typedef struct
 {
-   int *hats; /**< An array with the hat angles */
-   float *axes; /**< An array with the axis values */
-   int *buttons; /**< An array with the button states */
    int num_axes; /**< The number of axes of the joystick */
    int num_hats; /**< The number of hats of the joystick */
    int num_buttons; /**< The number of buttons of the joystick */
+   int first_axis; /**< Position of the first axis in the axis block */
+   int first_hat; /**< Position of the first hat in the hat block */
+   unsigned int sequence; /**< Odd while the values of the joystick are being updated */
+   unsigned int generation; /**< Changes whenever a value of the joystick changes */
 } DS_Joystick;
 
 /**
- * Holds all the joysticks
+ * Holds the joysticks of a context. The values of all the joysticks are
+ * stored in contiguous blocks: one block with the axes of every joystick,
+ * one with their hats and one bitset with the buttons of each joystick.
+ *
+ * Registering or removing joysticks moves the blocks, so it is done with
+ * the \a lock held for writing. Every other function holds it for reading
+ * while it accesses the blocks.
  */
-static DS_Array array;
+typedef struct
+{
+   int count; /**< Number of registered joysticks */
+   int capacity; /**< Number of joysticks that fit in \a joysticks and \a buttons */
+   int axis_count; /**< Number of used values in \a axes */
+   int axis_capacity; /**< Number of values that fit in \a axes */
+   int hat_count; /**< Number of used values in \a hats */
+   int hat_capacity; /**< Number of values that fit in \a hats */
+   DS_Joystick *joysticks; /**< Description of each joystick */
+   uint64_t *buttons; /**< Button states of each joystick (one bit per button) */
+   float *axes; /**< Axis values of all the joysticks */
+   int16_t *hats; /**< Hat angles of all the joysticks */
+   unsigned int generation; /**< Last generation assigned to a joystick */
+   pthread_rwlock_t lock; /**< Held for writing while the blocks are moved */
+} JoystickState;
+
+/**
+ * Holds all the joysticks of the default context
+ */
+static JoystickState default_state = {0, 0, 0, 0, 0, 0, NULL, NULL, NULL, NULL, 0, PTHREAD_RWLOCK_INITIALIZER};
+
+/**
+ * Returns the joystick store of the current context
+ */
+static JoystickState *state(void)
+{
+   JoystickState *ptr = (JoystickState *)Contexts_GetState(DS_CONTEXT_JOYSTICKS);
+   return ptr ? ptr : &default_state;
+}
 
 /**
  * Registers a joystick event to the LibDS event system
@@ -58,43 +105,137 @@ static void register_event()
 }
 
 /**
- * Returns the joystick structure at the given index
+ * Returns the joystick structure at the given index of the store \a ptr
  * If the joystick does not exist, this function shall return \c NULL
+ *
+ * \note The caller must hold the lock of the store
  */
-static DS_Joystick *get_joystick(int joystick)
+static DS_Joystick *get_joystick(JoystickState *ptr, int joystick)
 {
-   if ((int)array.used > joystick)
-      return (DS_Joystick *)array.data[joystick];
+   if (joystick >= 0 && ptr->count > joystick)
+      return &ptr->joysticks[joystick];
 
    return NULL;
 }
 
 /**
- * Returns \c true if the given \a joystick exists and is valid
+ * Returns a mask with the bits of the given number of \a buttons
+ */
+static uint64_t button_mask(const int buttons)
+{
+   if (buttons >= 64)
+      return ~(uint64_t)0;
+
+   return ((uint64_t)1 << buttons) - 1;
+}
+
+/**
+ * Releases the blocks of the joystick store and leaves it empty
  */
-static int joystick_exists(int joystick)
+static void free_joysticks(JoystickState *ptr)
 {
-   if (DS_GetJoystickCount() > joystick)
-      return get_joystick(joystick) != NULL;
+   DS_FREE(ptr->joysticks);
+   DS_FREE(ptr->buttons);
+   DS_FREE(ptr->axes);
+   DS_FREE(ptr->hats);
+
+   ptr->count = 0;
+   ptr->capacity = 0;
+   ptr->axis_count = 0;
+   ptr->axis_capacity = 0;
+   ptr->hat_count = 0;
+   ptr->hat_capacity = 0;
+}
 
-   return 0;
+/**
+ * Returns the capacity needed to hold \a count elements in a block that
+ * currently holds \a capacity elements (which grows geometrically)
+ */
+static int grow_capacity(const int capacity, const int count, const int minimum)
+{
+   if (count <= capacity)
+      return capacity;
+
+   return DS_Max(DS_Max(capacity * 2, count), minimum);
 }
 
 /**
- * Initializes the joystick array, with an initial support for 6 joysticks
+ * Resizes the given \a block from \a capacity to \a new_capacity elements of
+ * \a size bytes, the new elements are zeroed
+ *
+ * \returns \c 0 if the memory could not be allocated
+ */
+static int reserve(void **block, const int capacity, const int new_capacity, const size_t size)
+{
+   if (new_capacity <= capacity)
+      return 1;
+
+   void *ptr = realloc(*block, (size_t)new_capacity * size);
+   if (!ptr)
+      return 0;
+
+   memset((uint8_t *)ptr + (size_t)capacity * size, 0, (size_t)(new_capacity - capacity) * size);
+   *block = ptr;
+   return 1;
+}
+
+/**
+ * Marks the given \a stick as being updated, waiting for any other thread
+ * that is updating it. Readers retry while the sequence number is odd.
+ */
+static void begin_update(DS_Joystick *stick)
+{
+   for (;;)
+   {
+      unsigned int sequence = DS_AtomicLoad(&stick->sequence);
+      if (!(sequence & 1) && DS_AtomicCAS(&stick->sequence, sequence, sequence + 1))
+         return;
+   }
+}
+
+/**
+ * Finishes the update of the given \a stick. If one of its values
+ * \a changed, a new generation is assigned to it, so that the protocols
+ * that cache the encoded joystick data encode it again.
+ */
+static void end_update(JoystickState *ptr, DS_Joystick *stick, const int changed)
+{
+   if (changed)
+      DS_AtomicStore(&stick->generation, DS_AtomicAdd(&ptr->generation, 1) + 1);
+
+   DS_AtomicStore(&stick->sequence, stick->sequence + 1);
+}
+
+/**
+ * Initializes the joystick store (its blocks are allocated when the first
+ * joystick is registered)
  */
 void Joysticks_Init(void)
 {
-   DS_ArrayInit(&array, 6);
+   JoystickState *ptr = (JoystickState *)Contexts_CreateState(DS_CONTEXT_JOYSTICKS, &default_state, sizeof(JoystickState));
+   if (ptr != &default_state)
+      pthread_rwlock_init(&ptr->lock, NULL);
+
+   pthread_rwlock_wrlock(&ptr->lock);
+   free_joysticks(ptr);
+   pthread_rwlock_unlock(&ptr->lock);
 }
 
 /**
- * De-allocates the joystick array data
+ * De-allocates the joystick store
  */
 void Joysticks_Close(void)
 {
-   DS_ArrayFree(&array);
+   JoystickState *ptr = state();
+   pthread_rwlock_wrlock(&ptr->lock);
+   free_joysticks(ptr);
+   pthread_rwlock_unlock(&ptr->lock);
+
    register_event();
+   if (ptr != &default_state)
+      pthread_rwlock_destroy(&ptr->lock);
+
+   Contexts_DestroyState(DS_CONTEXT_JOYSTICKS);
 }
 
 /**
@@ -102,7 +243,11 @@ void Joysticks_Close(void)
  */
 int DS_GetJoystickCount(void)
 {
-   return (int)array.used;
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+   int count = ptr->count;
+   pthread_rwlock_unlock(&ptr->lock);
+   return count;
 }
 
 /**
@@ -111,10 +256,12 @@ int DS_GetJoystickCount(void)
  */
 int DS_GetJoystickNumHats(int joystick)
 {
-   if (joystick_exists(joystick))
-      return get_joystick(joystick)->num_hats;
-
-   return 0;
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   int count = stick ? stick->num_hats : 0;
+   pthread_rwlock_unlock(&ptr->lock);
+   return count;
 }
 
 /**
@@ -123,10 +270,12 @@ int DS_GetJoystickNumHats(int joystick)
  */
 int DS_GetJoystickNumAxes(int joystick)
 {
-   if (joystick_exists(joystick))
-      return get_joystick(joystick)->num_axes;
-
-   return 0;
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   int count = stick ? stick->num_axes : 0;
+   pthread_rwlock_unlock(&ptr->lock);
+   return count;
 }
 
 /**
@@ -135,10 +284,12 @@ int DS_GetJoystickNumAxes(int joystick)
  */
 int DS_GetJoystickNumButtons(int joystick)
 {
-   if (joystick_exists(joystick))
-      return get_joystick(joystick)->num_buttons;
-
-   return 0;
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   int count = stick ? stick->num_buttons : 0;
+   pthread_rwlock_unlock(&ptr->lock);
+   return count;
 }
 
 /**
@@ -151,15 +302,16 @@ int DS_GetJoystickNumButtons(int joystick)
  */
 int DS_GetJoystickHat(int joystick, int hat)
 {
-   if (CFG_GetRobotEnabled() && joystick_exists(joystick))
-   {
-      DS_Joystick *stick = get_joystick(joystick);
+   int value = 0;
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
 
-      if (stick->num_hats > hat)
-         return stick->hats[hat];
-   }
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   if (stick && CFG_GetRobotEnabled() && hat >= 0 && stick->num_hats > hat)
+      value = ptr->hats[stick->first_hat + hat];
 
-   return 0;
+   pthread_rwlock_unlock(&ptr->lock);
+   return value;
 }
 
 /**
@@ -172,15 +324,16 @@ int DS_GetJoystickHat(int joystick, int hat)
  */
 float DS_GetJoystickAxis(int joystick, int axis)
 {
-   if (CFG_GetRobotEnabled() && joystick_exists(joystick))
-   {
-      DS_Joystick *stick = get_joystick(joystick);
+   float value = 0;
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
 
-      if (stick->num_axes > axis)
-         return stick->axes[axis];
-   }
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   if (stick && CFG_GetRobotEnabled() && axis >= 0 && stick->num_axes > axis)
+      value = ptr->axes[stick->first_axis + axis];
 
-   return 0;
+   pthread_rwlock_unlock(&ptr->lock);
+   return value;
 }
 
 /**
@@ -193,15 +346,93 @@ float DS_GetJoystickAxis(int joystick, int axis)
  */
 int DS_GetJoystickButton(int joystick, int button)
 {
-   if (CFG_GetRobotEnabled() && joystick_exists(joystick))
+   int pressed = 0;
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   if (stick && CFG_GetRobotEnabled() && button >= 0 && stick->num_buttons > button)
+      pressed = (int)((ptr->buttons[joystick] >> button) & 1);
+
+   pthread_rwlock_unlock(&ptr->lock);
+   return pressed;
+}
+
+/**
+ * Returns the generation of the given \a joystick, which changes whenever
+ * one of its values changes (and is different for every registered joystick).
+ * If the joystick does not exist, this function will return \c 0
+ */
+unsigned int DS_GetJoystickGeneration(int joystick)
+{
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   unsigned int generation = stick ? DS_AtomicLoad(&stick->generation) : 0;
+   pthread_rwlock_unlock(&ptr->lock);
+   return generation;
+}
+
+/**
+ * Copies every value of the given \a joystick into \a snapshot. The values
+ * are read together, so the snapshot never contains a partial update made
+ * by \c DS_SetJoystickState() in another thread.
+ *
+ * If the joystick does not exist, the snapshot is zeroed and this function
+ * returns \c 0.
+ *
+ * \note Regardless of protocol implementation, this function will report
+ *       neutral values if the robot is disabled. This is for additional
+ *       safety!
+ */
+int DS_GetJoystickState(int joystick, DS_JoystickState *snapshot)
+{
+   assert(snapshot);
+   memset(snapshot, 0, sizeof(DS_JoystickState));
+
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   if (!stick)
    {
-      DS_Joystick *stick = get_joystick(joystick);
+      pthread_rwlock_unlock(&ptr->lock);
+      return 0;
+   }
+
+   snapshot->num_axes = stick->num_axes;
+   snapshot->num_hats = stick->num_hats;
+   snapshot->num_buttons = stick->num_buttons;
 
-      if (stick->num_buttons > button)
-         return stick->buttons[button];
+   /* Report neutral values */
+   if (!CFG_GetRobotEnabled())
+   {
+      snapshot->generation = DS_AtomicLoad(&stick->generation);
+      pthread_rwlock_unlock(&ptr->lock);
+      return 1;
+   }
+
+   /* Read the values again if they were updated while we copied them */
+   for (;;)
+   {
+      unsigned int sequence = DS_AtomicLoad(&stick->sequence);
+      if (sequence & 1)
+         continue;
+
+      snapshot->generation = DS_AtomicLoad(&stick->generation);
+      snapshot->buttons = ptr->buttons[joystick];
+      if (stick->num_axes > 0)
+         memcpy(snapshot->axes, ptr->axes + stick->first_axis, (size_t)stick->num_axes * sizeof(float));
+      if (stick->num_hats > 0)
+         memcpy(snapshot->hats, ptr->hats + stick->first_hat, (size_t)stick->num_hats * sizeof(int16_t));
+
+      /* Adding zero orders the copy before the second read */
+      if (DS_AtomicAdd(&stick->sequence, 0) == sequence)
+         break;
    }
 
-   return 0;
+   pthread_rwlock_unlock(&ptr->lock);
+   return 1;
 }
 
 /**
@@ -209,8 +440,10 @@ int DS_GetJoystickButton(int joystick, int button)
  */
 void DS_JoysticksReset(void)
 {
-   DS_ArrayFree(&array);
-   DS_ArrayInit(&array, 6);
+   JoystickState *ptr = state();
+   pthread_rwlock_wrlock(&ptr->lock);
+   free_joysticks(ptr);
+   pthread_rwlock_unlock(&ptr->lock);
 
    register_event();
 }
@@ -219,6 +452,10 @@ void DS_JoysticksReset(void)
  * Registers a new joystick with the given number of \a axes, \a hats and
  * \a buttons. All joystick values are set to a neutral state to ensure
  * safe operation of the robot.
+ *
+ * The number of axes, hats and buttons is limited to
+ * \c DS_MAX_JOYSTICK_AXES, \c DS_MAX_JOYSTICK_HATS and
+ * \c DS_MAX_JOYSTICK_BUTTONS.
  */
 void DS_JoysticksAdd(const int axes, const int hats, const int buttons)
 {
@@ -229,21 +466,49 @@ void DS_JoysticksAdd(const int axes, const int hats, const int buttons)
       return;
    }
 
-   /* Allocate memory for a new joystick */
-   DS_Joystick *joystick = (DS_Joystick *)calloc(1, sizeof(DS_Joystick));
-
-   /* Set joystick properties */
-   joystick->num_axes = axes;
-   joystick->num_hats = hats;
-   joystick->num_buttons = buttons;
+   /* Joystick is too big */
+   if (axes > DS_MAX_JOYSTICK_AXES || hats > DS_MAX_JOYSTICK_HATS || buttons > DS_MAX_JOYSTICK_BUTTONS)
+      fprintf(stderr, "DS_JoystickAdd: Ignoring the extra axes, hats or buttons of joystick!\n");
+
+   /* Make room for the new joystick and its values */
+   JoystickState *ptr = state();
+   pthread_rwlock_wrlock(&ptr->lock);
+   int num_axes = DS_Min(DS_Max(axes, 0), DS_MAX_JOYSTICK_AXES);
+   int num_hats = DS_Min(DS_Max(hats, 0), DS_MAX_JOYSTICK_HATS);
+   int num_buttons = DS_Min(DS_Max(buttons, 0), DS_MAX_JOYSTICK_BUTTONS);
+   int capacity = grow_capacity(ptr->capacity, ptr->count + 1, INITIAL_JOYSTICKS);
+   int axis_capacity = grow_capacity(ptr->axis_capacity, ptr->axis_count + num_axes, INITIAL_AXES);
+   int hat_capacity = grow_capacity(ptr->hat_capacity, ptr->hat_count + num_hats, INITIAL_HATS);
+   if (!reserve((void **)&ptr->joysticks, ptr->capacity, capacity, sizeof(DS_Joystick))
+       || !reserve((void **)&ptr->buttons, ptr->capacity, capacity, sizeof(uint64_t))
+       || !reserve((void **)&ptr->axes, ptr->axis_capacity, axis_capacity, sizeof(float))
+       || !reserve((void **)&ptr->hats, ptr->hat_capacity, hat_capacity, sizeof(int16_t)))
+   {
+      pthread_rwlock_unlock(&ptr->lock);
+      fprintf(stderr, "DS_JoystickAdd: Cannot allocate memory for joystick!\n");
+      return;
+   }
 
-   /* Set joystick value arrays */
-   joystick->hats = calloc(hats, sizeof(int));
-   joystick->axes = calloc(axes, sizeof(float));
-   joystick->buttons = calloc(buttons, sizeof(int));
+   ptr->capacity = capacity;
+   ptr->axis_capacity = axis_capacity;
+   ptr->hat_capacity = hat_capacity;
 
-   /* Register the new joystick in the joystick list */
-   DS_ArrayInsert(&array, (void *)joystick);
+   /* Set joystick properties */
+   DS_Joystick *joystick = &ptr->joysticks[ptr->count];
+   memset(joystick, 0, sizeof(DS_Joystick));
+   joystick->num_axes = num_axes;
+   joystick->num_hats = num_hats;
+   joystick->num_buttons = num_buttons;
+   joystick->first_axis = ptr->axis_count;
+   joystick->first_hat = ptr->hat_count;
+   joystick->generation = DS_AtomicAdd(&ptr->generation, 1) + 1;
+
+   /* Register the new joystick with neutral values */
+   ptr->buttons[ptr->count] = 0;
+   ptr->axis_count += num_axes;
+   ptr->hat_count += num_hats;
+   ++ptr->count;
+   pthread_rwlock_unlock(&ptr->lock);
 
    /* Emit the joystick count changed event */
    register_event();
@@ -254,13 +519,21 @@ void DS_JoysticksAdd(const int axes, const int hats, const int buttons)
  */
 void DS_SetJoystickHat(int joystick, int hat, int angle)
 {
-   if (joystick_exists(joystick))
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   if (stick && hat >= 0 && stick->num_hats > hat)
    {
-      DS_Joystick *stick = get_joystick(joystick);
+      int16_t *value = &ptr->hats[stick->first_hat + hat];
 
-      if (stick->num_hats > hat)
-         stick->hats[hat] = angle;
+      begin_update(stick);
+      int changed = (*value != (int16_t)angle);
+      *value = (int16_t)angle;
+      end_update(ptr, stick, changed);
    }
+
+   pthread_rwlock_unlock(&ptr->lock);
 }
 
 /**
@@ -268,13 +541,21 @@ void DS_SetJoystickHat(int joystick, int hat, int angle)
  */
 void DS_SetJoystickAxis(int joystick, int axis, float value)
 {
-   if (joystick_exists(joystick))
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   if (stick && axis >= 0 && stick->num_axes > axis)
    {
-      DS_Joystick *stick = get_joystick(joystick);
+      float *current = &ptr->axes[stick->first_axis + axis];
 
-      if (stick->num_axes > axis)
-         stick->axes[axis] = value;
+      begin_update(stick);
+      int changed = (*current != value);
+      *current = value;
+      end_update(ptr, stick, changed);
    }
+
+   pthread_rwlock_unlock(&ptr->lock);
 }
 
 /**
@@ -282,11 +563,174 @@ void DS_SetJoystickAxis(int joystick, int axis, float value)
  */
 void DS_SetJoystickButton(int joystick, int button, int pressed)
 {
-   if (joystick_exists(joystick))
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   if (stick && button >= 0 && stick->num_buttons > button)
+   {
+      uint64_t *buttons = &ptr->buttons[joystick];
+      uint64_t bit = (uint64_t)1 << button;
+
+      begin_update(stick);
+      uint64_t value = (pressed > 0) ? (*buttons | bit) : (*buttons & ~bit);
+      int changed = (*buttons != value);
+      *buttons = value;
+      end_update(ptr, stick, changed);
+   }
+
+   pthread_rwlock_unlock(&ptr->lock);
+}
+
+/**
+ * Updates every value of the given \a joystick in a single step, so that
+ * the protocol never sends a partially updated joystick.
+ *
+ * \param joystick the joystick to update
+ * \param axes the values of the axes of the joystick (\c NULL to keep them)
+ * \param buttons the states of the buttons, button \c n is bit \c n
+ * \param hats the angles of the hats of the joystick (\c NULL to keep them)
+ */
+void DS_SetJoystickState(int joystick, const float *axes, uint64_t buttons, const int16_t *hats)
+{
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+
+   DS_Joystick *stick = get_joystick(ptr, joystick);
+   if (!stick)
    {
-      DS_Joystick *stick = get_joystick(joystick);
+      pthread_rwlock_unlock(&ptr->lock);
+      return;
+   }
+
+   float *axis_block = ptr->axes + stick->first_axis;
+   int16_t *hat_block = ptr->hats + stick->first_hat;
+   size_t axis_size = (size_t)stick->num_axes * sizeof(float);
+   size_t hat_size = (size_t)stick->num_hats * sizeof(int16_t);
 
-      if (stick->num_buttons > button)
-         stick->buttons[button] = (pressed > 0) ? 1 : 0;
+   buttons &= button_mask(stick->num_buttons);
+
+   begin_update(stick);
+
+   /* Check if any value changed */
+   int changed = (ptr->buttons[joystick] != buttons);
+   if (axes && axis_size && !changed)
+      changed = (memcmp(axis_block, axes, axis_size) != 0);
+   if (hats && hat_size && !changed)
+      changed = (memcmp(hat_block, hats, hat_size) != 0);
+
+   /* Update the values */
+   if (changed)
+   {
+      ptr->buttons[joystick] = buttons;
+
+      if (axes && axis_size)
+         memcpy(axis_block, axes, axis_size);
+      if (hats && hat_size)
+         memcpy(hat_block, hats, hat_size);
    }
+
+   end_update(ptr, stick, changed);
+   pthread_rwlock_unlock(&ptr->lock);
+}
+
+/**
+ * Encodes the attached joysticks one after another with the given
+ * \a encoder, stopping at the first joystick that does not fit in \a cap
+ */
+static size_t encode_joysticks(DS_JoystickEncoder encoder, uint8_t *out, const size_t cap)
+{
+   int i;
+   size_t len = 0;
+
+   for (i = 0; i < DS_GetJoystickCount(); ++i)
+   {
+      size_t written = encoder(i, out + len, cap - len);
+      if (!written)
+         break;
+
+      len += written;
+   }
+
+   return len;
+}
+
+/**
+ * Writes the encoded data of every attached joystick into the given \a out
+ * buffer (see \c encode_joysticks()), re-encoding only the joysticks whose
+ * generation changed since the last call. The whole block is re-encoded
+ * when the robot is enabled or disabled, because the joystick values are
+ * only reported while the robot is enabled.
+ *
+ * The \a cache must be zeroed before its first use, and must always be
+ * used with the same \a encoder.
+ *
+ * \param cache the encoded joystick data of the previous call
+ * \param encoder writes the data of one joystick, returns \c 0 if it
+ *        does not fit in the given buffer
+ * \param out the output buffer
+ * \param cap the size of the output buffer
+ *
+ * \returns the number of written bytes
+ */
+size_t DS_JoystickCacheEncode(DS_JoystickCache *cache, DS_JoystickEncoder encoder, uint8_t *out, const size_t cap)
+{
+   assert(cache);
+   assert(encoder);
+   assert(out);
+
+   int i;
+   size_t len = 0;
+   int enabled = CFG_GetRobotEnabled();
+   unsigned int generations[DS_JOYSTICK_CACHE_COUNT];
+
+   /* Read the generations of all the joysticks at once */
+   JoystickState *ptr = state();
+   pthread_rwlock_rdlock(&ptr->lock);
+   int count = ptr->count;
+   for (i = 0; i < count && i < DS_JOYSTICK_CACHE_COUNT; ++i)
+      generations[i] = DS_AtomicLoad(&ptr->joysticks[i].generation);
+   pthread_rwlock_unlock(&ptr->lock);
+
+   /* Too many joysticks to cache */
+   if (count > DS_JOYSTICK_CACHE_COUNT)
+      return encode_joysticks(encoder, out, cap);
+
+   /* Encode every joystick again */
+   if (!cache->valid || cache->enabled != enabled)
+      memset(cache->generations, 0, sizeof(cache->generations));
+
+   cache->valid = 1;
+   cache->enabled = enabled;
+
+   for (i = 0; i < count; ++i)
+   {
+      /* Joystick has not changed (and has not been moved) */
+      unsigned int generation = generations[i];
+      if (generation && cache->generations[i] == generation && cache->offsets[i] == len)
+      {
+         len += cache->lengths[i];
+         continue;
+      }
+
+      /* Joystick does not fit in the cache, encode everything directly */
+      size_t written = encoder(i, cache->data + len, sizeof(cache->data) - len);
+      if (!written)
+      {
+         cache->valid = 0;
+         return encode_joysticks(encoder, out, cap);
+      }
+
+      cache->offsets[i] = (uint16_t)len;
+      cache->lengths[i] = (uint16_t)written;
+      cache->generations[i] = generation;
+      len += written;
+   }
+
+   /* Let encode_joysticks() decide which joysticks fit in the buffer */
+   if (len > cap)
+      return encode_joysticks(encoder, out, cap);
+
+   memcpy(out, cache->data, len);
+   return len;
 }
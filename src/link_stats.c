@@ -0,0 +1,258 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_LinkStats.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/*
+ * States of a tracked packet
+ */
+#define SLOT_EMPTY 0
+#define SLOT_SENT 1
+#define SLOT_ECHOED 2
+#define SLOT_REORDERED 3
+
+/*
+ * Nanoseconds per millisecond
+ */
+#define NSEC_PER_MSEC 1000000.0
+
+/**
+ * Compares two round-trip times (used to sort them)
+ */
+static int compare_rtt(const void *a, const void *b)
+{
+   uint32_t x = *(const uint32_t *)a;
+   uint32_t y = *(const uint32_t *)b;
+   return (x > y) - (x < y);
+}
+
+/**
+ * Clears the packets and measurements of the given \a monitor
+ */
+void DS_LinkMonitorReset(DS_LinkMonitor *monitor)
+{
+   assert(monitor);
+   memset(monitor, 0, sizeof(DS_LinkMonitor));
+}
+
+/**
+ * Registers that the packet with the given sequence number has been sent at
+ * the given \a time. Only the lower 16 bits of \a seq are used, because that
+ * is what the FRC protocols send (and echo back).
+ *
+ * \param monitor the link monitor
+ * \param seq the sequence number of the packet
+ * \param time the current monotonic time (see \c DS_GetMonotonicTime())
+ */
+void DS_LinkMonitorSent(DS_LinkMonitor *monitor, const unsigned int seq, const uint64_t time)
+{
+   assert(monitor);
+
+   DS_LinkSlot *slot = &monitor->slots[seq & (DS_LINK_WINDOW - 1)];
+   slot->rtt = 0;
+   slot->sent = time;
+   slot->kernel_time = 0;
+   slot->seq = (uint16_t)seq;
+   slot->state = SLOT_SENT;
+}
+
+/**
+ * Replaces the send time of a packet with the time at which the kernel
+ * actually sent it, so that the round-trip time does not include the time
+ * spent by our process (the echo time is also taken by the kernel).
+ *
+ * The kernel reports the send times in order, so the packet is the latest one
+ * that was sent (by us) before the given \a time, up to
+ * \c DS_LINK_SEND_DELAY milliseconds earlier.
+ *
+ * \param monitor the link monitor
+ * \param time the send time reported by the kernel
+ */
+void DS_LinkMonitorSentTime(DS_LinkMonitor *monitor, const uint64_t time)
+{
+   assert(monitor);
+
+   /* Find the packet */
+   int i;
+   DS_LinkSlot *slot = NULL;
+   uint64_t max_delay = (uint64_t)DS_LINK_SEND_DELAY * 1000000;
+   for (i = 0; i < DS_LINK_WINDOW; ++i)
+   {
+      DS_LinkSlot *candidate = &monitor->slots[i];
+      if (candidate->state == SLOT_EMPTY || candidate->kernel_time || candidate->sent > time)
+         continue;
+
+      if (time - candidate->sent <= max_delay && (!slot || candidate->sent > slot->sent))
+         slot = candidate;
+   }
+
+   /* Packet is not tracked */
+   if (!slot)
+      return;
+
+   /* Packet was already echoed, correct its round-trip time */
+   uint32_t delay = (uint32_t)((time - slot->sent) / 1000);
+   if (slot->state != SLOT_SENT)
+      slot->rtt = slot->rtt > delay ? slot->rtt - delay : 0;
+
+   slot->sent = time;
+   slot->kernel_time = 1;
+}
+
+/**
+ * Registers that the remote host echoed the given sequence number at the
+ * given \a time. Echoes of packets that are no longer tracked (or that were
+ * already echoed) are ignored.
+ *
+ * \param monitor the link monitor
+ * \param seq the echoed sequence number
+ * \param time the current monotonic time (see \c DS_GetMonotonicTime())
+ */
+void DS_LinkMonitorEchoed(DS_LinkMonitor *monitor, const unsigned int seq, const uint64_t time)
+{
+   assert(monitor);
+
+   /* Packet is not tracked, or it was already echoed */
+   DS_LinkSlot *slot = &monitor->slots[seq & (DS_LINK_WINDOW - 1)];
+   if (slot->state != SLOT_SENT || slot->seq != (uint16_t)seq || time < slot->sent)
+      return;
+
+   /* Get the round-trip time */
+   slot->rtt = (uint32_t)((time - slot->sent) / 1000);
+   slot->state = SLOT_ECHOED;
+
+   /* Echo arrived after a newer packet was echoed */
+   if (monitor->has_echo && (int16_t)(slot->seq - monitor->last_echo) < 0)
+      slot->state = SLOT_REORDERED;
+   else
+      monitor->last_echo = slot->seq;
+
+   monitor->has_echo = 1;
+}
+
+/**
+ * Registers that a packet has been received at the given \a time, and
+ * updates the inter-arrival jitter, which is the smoothed difference between
+ * the spacing of consecutive packets (estimated like in RFC 3550).
+ *
+ * \param monitor the link monitor
+ * \param time the time at which the packet was received (by the kernel)
+ * \param now the time at which the packet is being processed
+ */
+void DS_LinkMonitorReceived(DS_LinkMonitor *monitor, const uint64_t time, const uint64_t now)
+{
+   assert(monitor);
+
+   /* Update the time spent by packets in our queues */
+   if (now >= time)
+      monitor->rx_delay += ((double)(now - time) - monitor->rx_delay) / 16.0;
+
+   if (monitor->has_arrival && time >= monitor->last_arrival)
+   {
+      uint64_t spacing = time - monitor->last_arrival;
+
+      if (monitor->last_spacing > 0)
+      {
+         double delta = (double)spacing - (double)monitor->last_spacing;
+         if (delta < 0)
+            delta = -delta;
+
+         monitor->jitter += (delta - monitor->jitter) / 16.0;
+      }
+
+      monitor->last_spacing = spacing;
+   }
+
+   monitor->has_arrival = 1;
+   monitor->last_arrival = time;
+}
+
+/**
+ * Calculates the round-trip, loss and reordering statistics of the packets
+ * tracked by the given \a monitor. Packets sent less than
+ * \c DS_LINK_LOSS_TIMEOUT milliseconds ago are not counted as lost yet.
+ *
+ * The packet and byte counters of \a stats are not modified.
+ *
+ * \param monitor the link monitor
+ * \param time the current monotonic time (see \c DS_GetMonotonicTime())
+ * \param stats the structure in which to write the statistics
+ */
+void DS_LinkMonitorStats(const DS_LinkMonitor *monitor, const uint64_t time, DS_LinkStats *stats)
+{
+   assert(monitor);
+   assert(stats);
+
+   int i;
+   uint64_t sum = 0;
+   unsigned int lost = 0;
+   unsigned int decided = 0;
+   uint32_t rtts[DS_LINK_WINDOW];
+   uint64_t timeout = (uint64_t)DS_LINK_LOSS_TIMEOUT * 1000000;
+
+   /* Collect the round-trip times and count the lost packets */
+   stats->samples = 0;
+   stats->reordered = 0;
+   for (i = 0; i < DS_LINK_WINDOW; ++i)
+   {
+      const DS_LinkSlot *slot = &monitor->slots[i];
+      if (slot->state == SLOT_EMPTY)
+         continue;
+
+      /* Only packets older than the timeout tell if a packet was lost */
+      if (time - slot->sent >= timeout)
+      {
+         ++decided;
+         lost += (slot->state == SLOT_SENT);
+      }
+
+      /* Get the round-trip time of echoed packets */
+      if (slot->state == SLOT_ECHOED || slot->state == SLOT_REORDERED)
+      {
+         sum += slot->rtt;
+         rtts[stats->samples++] = slot->rtt;
+         stats->reordered += (slot->state == SLOT_REORDERED);
+      }
+   }
+
+   /* Get the percentiles */
+   stats->rtt_min = 0;
+   stats->rtt_avg = 0;
+   stats->rtt_p99 = 0;
+   if (stats->samples > 0)
+   {
+      qsort(rtts, stats->samples, sizeof(uint32_t), &compare_rtt);
+      stats->rtt_min = rtts[0] / 1000.0f;
+      stats->rtt_avg = (float)((double)sum / stats->samples / 1000.0);
+      stats->rtt_p99 = rtts[((stats->samples * 99) + 99) / 100 - 1] / 1000.0f;
+   }
+
+   /* Get the loss and jitter */
+   stats->loss = decided > 0 ? (lost * 100.0f) / decided : 0;
+   stats->jitter = (float)(monitor->jitter / NSEC_PER_MSEC);
+   stats->rx_delay = (float)(monitor->rx_delay / NSEC_PER_MSEC);
+}
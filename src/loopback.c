@@ -0,0 +1,328 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Utils.h"
+#include "DS_Timer.h"
+#include "DS_Socket.h"
+
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#if defined __linux__
+#   define USE_EVENTFD 1
+#   include <unistd.h>
+#   include <sys/eventfd.h>
+#endif
+
+/*
+ * Number of buckets of the table of bound loopback sockets
+ */
+#define BUCKET_COUNT 256
+
+/**
+ * Loopback socket bound to the name of its transport and its input port
+ */
+typedef struct _endpoint
+{
+   int event_fd; /**< Becomes readable when data is pushed to the socket */
+   unsigned int signaled; /**< Set while the event fd is signaled and not yet read */
+   pthread_mutex_t send_mutex; /**< Serializes the senders (DS_SocketPush() has a single producer) */
+   DS_Socket *socket; /**< The bound socket */
+   struct _endpoint *next; /**< Next endpoint in the same bucket */
+} Endpoint;
+
+/**
+ * Loopback transport with its name (i.e. the local address of its sockets)
+ */
+typedef struct _named_transport
+{
+   DS_Transport transport;
+   struct _named_transport *next;
+   char name[sizeof(((DS_Socket *)0)->address)];
+} NamedTransport;
+
+/*
+ * Bound endpoints, the senders hold a read lock while they copy their data
+ * to the receive ring of the destination socket, so that the destination
+ * cannot be closed meanwhile
+ */
+static Endpoint *buckets[BUCKET_COUNT];
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*
+ * Loopback transports created so far (they are never deleted)
+ */
+static NamedTransport *transports = NULL;
+static pthread_mutex_t transports_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Returns the bucket of the given address and port
+ */
+static unsigned int bucket(const char *address, const int port)
+{
+   unsigned int hash = 2166136261u;
+   while (*address)
+      hash = (hash ^ (uint8_t)*address++) * 16777619u;
+
+   hash = (hash ^ (unsigned int)port) * 16777619u;
+   return hash & (BUCKET_COUNT - 1);
+}
+
+/**
+ * Returns the endpoint bound to the given address and port
+ *
+ * \note The caller must hold the lock
+ */
+static Endpoint *find_endpoint(const char *address, const int port)
+{
+   Endpoint *ep;
+   for (ep = buckets[bucket(address, port)]; ep; ep = ep->next)
+   {
+      if (ep->socket->in_port == port && strcmp(ep->socket->transport->name, address) == 0)
+         return ep;
+   }
+
+   return NULL;
+}
+
+/**
+ * Binds the given socket to the name of its transport and its input port
+ *
+ * \returns \c 1 if the socket can be polled, \c 0 if the address is in use
+ */
+static int loopback_open(DS_Socket *ptr)
+{
+   Endpoint *ep = (Endpoint *)calloc(1, sizeof(Endpoint));
+   ep->socket = ptr;
+   ep->event_fd = -1;
+   pthread_mutex_init(&ep->send_mutex, NULL);
+#if defined USE_EVENTFD
+   ep->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+
+   /* Bind the socket (unless another socket uses the same address) */
+   pthread_rwlock_wrlock(&lock);
+   int available = (find_endpoint(ptr->transport->name, ptr->in_port) == NULL);
+   if (available)
+   {
+      unsigned int index = bucket(ptr->transport->name, ptr->in_port);
+      ep->next = buckets[index];
+      buckets[index] = ep;
+   }
+   pthread_rwlock_unlock(&lock);
+
+   /* Address is in use */
+   if (!available)
+   {
+#if defined USE_EVENTFD
+      if (ep->event_fd >= 0)
+         close(ep->event_fd);
+#endif
+      pthread_mutex_destroy(&ep->send_mutex);
+      DS_FREE(ep);
+      return 0;
+   }
+
+   /* Update initialized states */
+   ptr->info.transport_data = ep;
+   ptr->info.server_init = 1;
+   ptr->info.client_init = 1;
+   return 1;
+}
+
+/**
+ * Unbinds the given socket, after this function returns, no other socket
+ * can push data to it
+ */
+static void loopback_close(DS_Socket *ptr)
+{
+   Endpoint *ep = (Endpoint *)ptr->info.transport_data;
+   if (!ep)
+      return;
+
+   /* Unlink the endpoint */
+   pthread_rwlock_wrlock(&lock);
+   Endpoint **node = &buckets[bucket(ptr->transport->name, ptr->in_port)];
+   while (*node && *node != ep)
+      node = &(*node)->next;
+   if (*node)
+      *node = ep->next;
+   pthread_rwlock_unlock(&lock);
+
+   /* Release the endpoint (closing the event fd removes it from epoll) */
+#if defined USE_EVENTFD
+   if (ep->event_fd >= 0)
+      close(ep->event_fd);
+#endif
+   pthread_mutex_destroy(&ep->send_mutex);
+   DS_FREE(ep);
+   ptr->info.transport_data = NULL;
+}
+
+/**
+ * Returns the event descriptor of the given socket, which becomes readable
+ * when data is pushed to the receive ring after the last call to
+ * \c loopback_recv()
+ */
+static int loopback_fd(const DS_Socket *ptr)
+{
+   Endpoint *ep = (Endpoint *)ptr->info.transport_data;
+   return ep ? ep->event_fd : -1;
+}
+
+/**
+ * Clears the event descriptor of the given socket (the data is already in
+ * the receive ring). The caller must then read every pending datagram: the
+ * flag is cleared before the ring is read, so a datagram pushed after the
+ * ring was found empty always signals the event descriptor again.
+ *
+ * \returns the number of pending datagrams
+ */
+static int loopback_recv(DS_Socket *ptr)
+{
+#if defined USE_EVENTFD
+   uint64_t value;
+   Endpoint *ep = (Endpoint *)ptr->info.transport_data;
+   if (ep && ep->event_fd >= 0)
+   {
+      /* Full barrier, the ring is read after the flag is cleared */
+      DS_AtomicCAS(&ep->signaled, 1, 0);
+
+      if (read(ep->event_fd, &value, sizeof(value)) < 0)
+         value = 0;
+   }
+#endif
+
+   return DS_SocketPending(ptr);
+}
+
+/**
+ * Copies the datagram to the receive ring of the socket bound to the remote
+ * address and output port of the given socket. The event descriptor of the
+ * destination is only signaled if it was not already signaled since the
+ * reader last cleared it, so a burst of data needs a single system call.
+ *
+ * The senders to the same destination are serialized by a mutex, and the
+ * endpoint table is guarded by a read/write lock, so the transport is not
+ * lock-free (it only avoids the kernel network stack).
+ *
+ * \returns the number of bytes sent, or \c -1 if no socket is bound to the
+ *          remote address (or if its ring is full)
+ */
+static int loopback_send(const DS_Socket *ptr, const void *data, const size_t len)
+{
+   pthread_rwlock_rdlock(&lock);
+
+   /* Nobody listens on the remote address, same as an ICMP port unreachable */
+   Endpoint *peer = find_endpoint(ptr->address, ptr->out_port);
+   if (!peer)
+   {
+      pthread_rwlock_unlock(&lock);
+      DS_AtomicStore((unsigned int *)&ptr->info.unreachable, 1);
+      return -1;
+   }
+
+   /* Push the datagram (one sender at a time) */
+   pthread_mutex_lock(&peer->send_mutex);
+   int pending = DS_SocketPush(peer->socket, data, len, DS_GetMonotonicTime());
+   pthread_mutex_unlock(&peer->send_mutex);
+
+   /* Wake up the reader, the flag is checked after the datagram is published */
+#if defined USE_EVENTFD
+   if (pending >= 0 && peer->event_fd >= 0 && DS_AtomicCAS(&peer->signaled, 0, 1))
+   {
+      uint64_t one = 1;
+      if (write(peer->event_fd, &one, sizeof(one)) < 0)
+      {
+         DS_AtomicStore(&peer->signaled, 0);
+         pending = -1;
+      }
+   }
+#endif
+
+   pthread_rwlock_unlock(&lock);
+   return pending < 0 ? -1 : (int)len;
+}
+
+/**
+ * Replaces the remote address of the given socket, the socket stays bound
+ */
+static void loopback_set_address(DS_Socket *ptr, const char *address)
+{
+   pthread_rwlock_wrlock(&lock);
+   memset(ptr->address, 0, sizeof(ptr->address));
+   strncpy(ptr->address, address, sizeof(ptr->address) - 1);
+   pthread_rwlock_unlock(&lock);
+}
+
+/**
+ * Returns a transport that exchanges data with the sockets of this process,
+ * without using the network or any system call (except to wake up the event
+ * loop when a socket receives data).
+ *
+ * A loopback socket is bound to the \a name of its transport and to its input
+ * port, and it sends its data to the socket that is bound to its remote
+ * address and output port. For example, a driver station that uses
+ * \c DS_LoopbackTransport("ds") and a robot address of \c "robot" can talk to
+ * a simulated robot that uses \c DS_LoopbackTransport("robot") and the
+ * \c "ds" address, with the usual port numbers.
+ *
+ * \note Each socket must receive data from a single thread at a time
+ *
+ * \param name the local address of the sockets that use the transport
+ */
+const DS_Transport *DS_LoopbackTransport(const char *name)
+{
+   assert(name);
+
+   pthread_mutex_lock(&transports_mutex);
+
+   /* Re-use the transport with the same name */
+   NamedTransport *ptr;
+   for (ptr = transports; ptr; ptr = ptr->next)
+   {
+      if (strcmp(ptr->name, name) == 0)
+         break;
+   }
+
+   /* Create a new transport */
+   if (!ptr)
+   {
+      ptr = (NamedTransport *)calloc(1, sizeof(NamedTransport));
+      strncpy(ptr->name, name, sizeof(ptr->name) - 1);
+      ptr->transport.name = ptr->name;
+      ptr->transport.open = &loopback_open;
+      ptr->transport.close = &loopback_close;
+      ptr->transport.fd = &loopback_fd;
+      ptr->transport.recv = &loopback_recv;
+      ptr->transport.send = &loopback_send;
+      ptr->transport.set_address = &loopback_set_address;
+      ptr->next = transports;
+      transports = ptr;
+   }
+
+   pthread_mutex_unlock(&transports_mutex);
+   return &ptr->transport;
+}
@@ -0,0 +1,90 @@
+/*
+ * The Driver Station Library (LibDS)
+ * Copyright (c) 2015-2017 Alex Spataru <alex_spataru@outlook>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "DS_Utils.h"
+#include "DS_PacketTemplate.h"
+
+#include <string.h>
+#include <assert.h>
+
+/**
+ * Registers the constant \a frame of a packet of \a len bytes, of which only
+ * the \a dynamic_len bytes starting at \a dynamic_pos are written by the
+ * protocol when sending a packet. Every other byte of the sent packets
+ * must be equal to the same byte of \a frame.
+ *
+ * \param tpl the template to initialize
+ * \param frame the constant bytes of the packet (not copied)
+ * \param len the length of the packet
+ * \param dynamic_pos the first byte that changes between packets
+ * \param dynamic_len the number of bytes that change between packets
+ */
+void DS_TemplateInit(DS_PacketTemplate *tpl, const uint8_t *frame, const size_t len, const size_t dynamic_pos,
+                     const size_t dynamic_len)
+{
+   assert(tpl);
+   assert(frame);
+   assert(dynamic_pos + dynamic_len <= len);
+
+   size_t suffix_pos = dynamic_pos + dynamic_len;
+
+   tpl->len = len;
+   tpl->frame = frame;
+   tpl->dynamic_pos = dynamic_pos;
+   tpl->dynamic_len = dynamic_len;
+   tpl->prefix_crc = DS_CRC32Update(0, frame, dynamic_pos);
+   tpl->suffix_crc = DS_CRC32Update(0, frame + suffix_pos, len - suffix_pos);
+   tpl->suffix_op = DS_CRC32CombineGen(len - suffix_pos);
+}
+
+/**
+ * Copies the constant frame of the template into the given \a out buffer,
+ * the protocol must then write the dynamic region of the packet
+ *
+ * \returns the length of the packet, or \c 0 if \a cap is too small
+ */
+size_t DS_TemplateCopy(const DS_PacketTemplate *tpl, uint8_t *out, const size_t cap)
+{
+   assert(tpl);
+   assert(out);
+
+   if (cap < tpl->len)
+      return 0;
+
+   memcpy(out, tpl->frame, tpl->len);
+   return tpl->len;
+}
+
+/**
+ * Returns the CRC32 of the given \a packet (which must be \c tpl->len bytes
+ * long and follow the template). Only the dynamic region of the packet is
+ * read, the constant bytes are accounted for with their precomputed CRC32.
+ */
+uint32_t DS_TemplateCRC32(const DS_PacketTemplate *tpl, const uint8_t *packet)
+{
+   assert(tpl);
+   assert(packet);
+
+   uint32_t crc = DS_CRC32Update(tpl->prefix_crc, packet + tpl->dynamic_pos, tpl->dynamic_len);
+   return DS_CRC32CombineOp(crc, tpl->suffix_crc, tpl->suffix_op);
+}
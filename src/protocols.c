@@ -26,6 +26,7 @@
 #include "DS_Client.h"
 #include "DS_Config.h"
 #include "DS_Events.h"
+#include "DS_Context.h"
 #include "DS_Socket.h"
 #include "DS_Protocol.h"
 
@@ -35,28 +36,68 @@
 #include <string.h>
 #include <pthread.h>
 
+#if defined __linux__
+#   define USE_REACTOR 1
+#   include <unistd.h>
+#   include <sys/epoll.h>
+#   include <sys/timerfd.h>
+#endif
+
 #define SEND_PRECISION 1 /* Update the sender timers every millisecond */
 #define RECV_PRECISION 50 /* Update the watchdogs every 50 milliseconds */
+#define STATS_INTERVAL 1000 /* Report the link statistics every second */
 
-/*
- * Protocol data
- */
-static DS_Protocol protocol;
-static int enable_operations = 0;
-
-/*
- * Define the sender watchdogs (when one expires, we send a packet)
+/**
+ * Holds the protocol, the timers and the packet counters of a context
  */
-static DS_Timer fms_send_timer;
-static DS_Timer radio_send_timer;
-static DS_Timer robot_send_timer;
+typedef struct
+{
+   DS_Protocol protocol; /**< The current protocol */
+   int enable_operations; /**< Set to \c 1 when a protocol is loaded */
+
+   DS_Timer fms_send_timer; /**< When it expires, we send a packet */
+   DS_Timer radio_send_timer; /**< When it expires, we send a packet */
+   DS_Timer robot_send_timer; /**< When it expires, we send a packet */
+
+   DS_Timer fms_recv_timer; /**< When it expires, comms are lost */
+   DS_Timer radio_recv_timer; /**< When it expires, comms are lost */
+   DS_Timer robot_recv_timer; /**< When it expires, comms are lost */
+
+   int fms_read; /**< Used to feed the FMS watchdog */
+   int radio_read; /**< Used to feed the radio watchdog */
+   int robot_read; /**< Used to feed the robot watchdog */
+
+   DS_String netcs_data; /**< Holds the received NetConsole data */
+
+   int sent_fms_packets;
+   int sent_radio_packets;
+   int sent_robot_packets;
+   int received_fms_packets;
+   int received_radio_packets;
+   int received_robot_packets;
+
+   unsigned long sent_fms_bytes;
+   unsigned long recv_fms_bytes;
+   unsigned long sent_radio_bytes;
+   unsigned long recv_radio_bytes;
+   unsigned long sent_robot_bytes;
+   unsigned long recv_robot_bytes;
+
+   DS_Timer stats_timer; /**< When it expires, link statistics are reported */
+   DS_LinkMonitor links[3]; /**< Link monitors (indexed by \c DS_Link) */
+   unsigned int encoded_seq[3]; /**< Sequence number of the packet being sent (indexed by \c DS_Link) */
+   uint64_t encoded_time[3]; /**< Time at which \a encoded_seq was written */
+   int seq_encoded[3]; /**< Set to \c 1 if the protocol wrote \a encoded_seq in the packet */
+   uint64_t rx_time; /**< Receive time of the packet being interpreted */
+   const DS_Transport *transport; /**< Transport of the sockets (\c NULL for the network) */
+
+   uint64_t data[DS_PROTOCOL_DATA_SIZE / sizeof(uint64_t)]; /**< See \c DS_ProtocolData() */
+} ProtocolState;
 
 /*
- * Define the receiver watchdogs (when one expires, comms are lost)
+ * Protocol state of the default context
  */
-static DS_Timer fms_recv_timer;
-static DS_Timer radio_recv_timer;
-static DS_Timer robot_recv_timer;
+static ProtocolState default_state;
 
 /*
  * If set to anything else than 0, then the event loop will be allowed to run
@@ -64,57 +105,80 @@ static DS_Timer robot_recv_timer;
 static int running = 0;
 
 /*
- * Protocol read success booleans (used to feed the watchdogs)
+ * Buffers in which the FMS and robot packets are encoded (only used by the
+ * event loop thread, so that sending a packet does not allocate memory)
  */
-static int fms_read = 0;
-static int radio_read = 0;
-static int robot_read = 0;
+static uint8_t fms_buffer[DS_PACKET_BUFFER_SIZE];
+static uint8_t robot_buffer[DS_PACKET_BUFFER_SIZE];
 
 /*
- * Holds the received data
+ * The thread ID for the protocol event loop
  */
-static DS_String fms_data;
-static DS_String radio_data;
-static DS_String robot_data;
-static DS_String netcs_data;
+static pthread_t event_thread;
 
 /*
- * Holds the sent/received packets
+ * On Linux, the event loop waits on an epoll set that contains the sockets
+ * poll descriptor and a timerfd armed to the nearest timer deadline, so that
+ * packets are parsed as soon as they arrive and sent exactly on schedule
  */
-static int sent_fms_packets = 0;
-static int sent_radio_packets = 0;
-static int sent_robot_packets = 0;
-static int received_fms_packets = 0;
-static int received_radio_packets = 0;
-static int received_robot_packets = 0;
+#if defined USE_REACTOR
+static int reactor_fd = -1;
+static int timer_fd = -1;
+#endif
 
-/*
- * Sent/received bytes
+/**
+ * Returns the protocol state of the current context
  */
-static unsigned long sent_fms_bytes = 0;
-static unsigned long recv_fms_bytes = 0;
-static unsigned long sent_radio_bytes = 0;
-static unsigned long recv_radio_bytes = 0;
-static unsigned long sent_robot_bytes = 0;
-static unsigned long recv_robot_bytes = 0;
+static ProtocolState *state(void)
+{
+   ProtocolState *ptr = (ProtocolState *)Contexts_GetState(DS_CONTEXT_PROTOCOLS);
+   return ptr ? ptr : &default_state;
+}
 
-/*
- * The thread ID for the protocol event loop
+/**
+ * Registers the packet that has just been sent over the given \a link in its
+ * link monitor, if the protocol wrote a sequence number in it. Packets that
+ * could not be sent are not registered, so that they are not counted as lost.
+ *
+ * The send time is the time at which the packet was encoded, which precedes
+ * the time reported by the kernel (see \c DS_LinkMonitorSentTime()).
  */
-static pthread_t event_thread;
+static void register_sent_packet(const DS_Link link, const int bytes)
+{
+   ProtocolState *ptr = state();
+   if (ptr->seq_encoded[link] && bytes > 0)
+      DS_LinkMonitorSent(&ptr->links[link], ptr->encoded_seq[link], ptr->encoded_time[link]);
+
+   ptr->seq_encoded[link] = 0;
+}
 
 /**
- * Sends a new packet to the FMS, the generated data is immediatly deleted
- * once the packet has been sent
+ * Sends a new packet to the FMS. If the protocol provides a packet encoder,
+ * the packet is written in a pre-allocated buffer, otherwise the generated
+ * data is immediatly deleted once the packet has been sent
  */
 static void send_fms_data()
 {
-   if (enable_operations)
+   if (state()->enable_operations)
    {
-      ++sent_fms_packets;
-      DS_String data = protocol.create_fms_packet();
-      sent_fms_bytes += DS_Max(DS_SocketSend(&protocol.fms_socket, &data), 0);
-      DS_StrRmBuf(&data);
+      int bytes;
+      ++state()->sent_fms_packets;
+
+      if (state()->protocol.encode_fms_packet)
+      {
+         size_t len = state()->protocol.encode_fms_packet(fms_buffer, sizeof(fms_buffer));
+         bytes = DS_SocketSendBytes(&state()->protocol.fms_socket, fms_buffer, len);
+      }
+
+      else
+      {
+         DS_String data = state()->protocol.create_fms_packet();
+         bytes = DS_SocketSend(&state()->protocol.fms_socket, &data);
+         DS_StrRmBuf(&data);
+      }
+
+      register_sent_packet(DS_LINK_FMS, bytes);
+      state()->sent_fms_bytes += DS_Max(bytes, 0);
    }
 }
 
@@ -124,27 +188,43 @@ static void send_fms_data()
  */
 static void send_radio_data()
 {
-   if (enable_operations)
+   if (state()->enable_operations)
    {
-      ++sent_radio_packets;
-      DS_String data = protocol.create_radio_packet();
-      sent_radio_bytes += DS_Max(DS_SocketSend(&protocol.radio_socket, &data), 0);
+      ++state()->sent_radio_packets;
+      DS_String data = state()->protocol.create_radio_packet();
+      int bytes = DS_SocketSend(&state()->protocol.radio_socket, &data);
+      state()->sent_radio_bytes += DS_Max(bytes, 0);
       DS_StrRmBuf(&data);
    }
 }
 
 /**
- * Sends a new packet to the robot, the generated data is immediatly deleted
- * once the packet has been sent
+ * Sends a new packet to the robot. If the protocol provides a packet encoder,
+ * the packet is written in a pre-allocated buffer, otherwise the generated
+ * data is immediatly deleted once the packet has been sent
  */
 static void send_robot_data()
 {
-   if (enable_operations)
+   if (state()->enable_operations)
    {
-      ++sent_robot_packets;
-      DS_String data = protocol.create_robot_packet();
-      sent_robot_bytes += DS_Max(DS_SocketSend(&protocol.robot_socket, &data), 0);
-      DS_StrRmBuf(&data);
+      int bytes;
+      ++state()->sent_robot_packets;
+
+      if (state()->protocol.encode_robot_packet)
+      {
+         size_t len = state()->protocol.encode_robot_packet(robot_buffer, sizeof(robot_buffer));
+         bytes = DS_SocketSendBytes(&state()->protocol.robot_socket, robot_buffer, len);
+      }
+
+      else
+      {
+         DS_String data = state()->protocol.create_robot_packet();
+         bytes = DS_SocketSend(&state()->protocol.robot_socket, &data);
+         DS_StrRmBuf(&data);
+      }
+
+      register_sent_packet(DS_LINK_ROBOT, bytes);
+      state()->sent_robot_bytes += DS_Max(bytes, 0);
    }
 }
 
@@ -155,96 +235,199 @@ static void send_robot_data()
 static void send_data()
 {
    /* Protocol is NULL, abort */
-   if (!enable_operations)
+   if (!state()->enable_operations)
       return;
 
    /* Send FMS packet */
-   if (fms_send_timer.expired)
+   if (DS_TimerPoll(&state()->fms_send_timer))
    {
       send_fms_data();
-      DS_TimerReset(&fms_send_timer);
+      DS_TimerReset(&state()->fms_send_timer);
    }
 
    /* Send radio packet */
-   if (radio_send_timer.expired)
+   if (DS_TimerPoll(&state()->radio_send_timer))
    {
       send_radio_data();
-      DS_TimerReset(&radio_send_timer);
+      DS_TimerReset(&state()->radio_send_timer);
    }
 
    /* Send robot packet */
-   if (robot_send_timer.expired)
+   if (DS_TimerPoll(&state()->robot_send_timer))
    {
       send_robot_data();
-      DS_TimerReset(&robot_send_timer);
+      DS_TimerReset(&state()->robot_send_timer);
    }
 }
 
 /**
- * Clears the strings that hold the incoming data packets
+ * Clears the string that holds the incoming NetConsole messages
  */
 static void clear_recv_data()
 {
-   DS_StrRmBuf(&fms_data);
-   DS_StrRmBuf(&radio_data);
-   DS_StrRmBuf(&robot_data);
-   DS_StrRmBuf(&netcs_data);
+   DS_StrRmBuf(&state()->netcs_data);
+}
+
+/**
+ * Interprets every pending FMS packet (directly from the socket buffer)
+ */
+static void recv_fms_data()
+{
+   DS_ByteSpan data;
+   while (DS_SocketPeek(&state()->protocol.fms_socket, &data))
+   {
+      state()->recv_fms_bytes += data.n;
+      ++state()->received_fms_packets;
+      state()->rx_time = DS_SocketTimestamp(&state()->protocol.fms_socket);
+      state()->fms_read = state()->protocol.read_fms_packet(&data);
+      DS_SocketRelease(&state()->protocol.fms_socket);
+      if (state()->fms_read)
+         DS_LinkMonitorReceived(&state()->links[DS_LINK_FMS], state()->rx_time, DS_GetMonotonicTime());
+      CFG_SetFMSCommunications(state()->fms_read);
+   }
+}
+
+/**
+ * Interprets every pending radio packet (directly from the socket buffer)
+ */
+static void recv_radio_data()
+{
+   DS_ByteSpan data;
+   while (DS_SocketPeek(&state()->protocol.radio_socket, &data))
+   {
+      state()->recv_radio_bytes += data.n;
+      ++state()->received_radio_packets;
+      state()->rx_time = DS_SocketTimestamp(&state()->protocol.radio_socket);
+      state()->radio_read = state()->protocol.read_radio_packet(&data);
+      DS_SocketRelease(&state()->protocol.radio_socket);
+      if (state()->radio_read)
+         DS_LinkMonitorReceived(&state()->links[DS_LINK_RADIO], state()->rx_time, DS_GetMonotonicTime());
+      CFG_SetRadioCommunications(state()->radio_read);
+   }
+}
+
+/**
+ * Interprets every pending robot packet (directly from the socket buffer)
+ */
+static void recv_robot_data()
+{
+   DS_ByteSpan data;
+   while (DS_SocketPeek(&state()->protocol.robot_socket, &data))
+   {
+      state()->recv_robot_bytes += data.n;
+      ++state()->received_robot_packets;
+      state()->rx_time = DS_SocketTimestamp(&state()->protocol.robot_socket);
+      state()->robot_read = state()->protocol.read_robot_packet(&data);
+      DS_SocketRelease(&state()->protocol.robot_socket);
+      if (state()->robot_read)
+         DS_LinkMonitorReceived(&state()->links[DS_LINK_ROBOT], state()->rx_time, DS_GetMonotonicTime());
+      CFG_SetRobotCommunications(state()->robot_read);
+   }
+}
+
+/**
+ * Adds every pending NetConsole message to the event system
+ */
+static void recv_netconsole_data()
+{
+   while (1)
+   {
+      DS_StrRmBuf(&state()->netcs_data);
+      state()->netcs_data = DS_SocketRead(&state()->protocol.netconsole_socket);
+      if (DS_StrLen(&state()->netcs_data) <= 0)
+         break;
+
+      CFG_AddNetConsoleMessage(&state()->netcs_data);
+   }
+}
+
+/**
+ * Applies the send times reported by the kernel for the given \a socket to
+ * the monitor of the given \a link
+ */
+static void read_send_times(DS_Socket *socket, const DS_Link link)
+{
+   uint64_t time;
+   while (DS_SocketSendTimestamp(socket, &time))
+      DS_LinkMonitorSentTime(&state()->links[link], time);
 }
 
 /**
  * Reads the received data using the functions provided by the current protocol.
  * If there is no protocol running, then this function will do nothing.
+ *
+ * Every queued packet is processed (in the order in which it was received),
+ * so that bursts of data are not lost between two iterations of the loop.
  */
 static void recv_data()
 {
    /* Protocol is NULL, abort */
-   if (!enable_operations)
+   if (!state()->enable_operations)
       return;
 
    /* Clear buffers (just to be sure) */
    clear_recv_data();
 
    /* Read data from sockets */
-   fms_data = DS_SocketRead(&protocol.fms_socket);
-   radio_data = DS_SocketRead(&protocol.radio_socket);
-   robot_data = DS_SocketRead(&protocol.robot_socket);
-   netcs_data = DS_SocketRead(&protocol.netconsole_socket);
-
-   /* Update received data indicators */
-   recv_fms_bytes += DS_StrLen(&fms_data);
-   recv_radio_bytes += DS_StrLen(&radio_data);
-   recv_robot_bytes += DS_StrLen(&robot_data);
-
-   /* Read FMS packet */
-   if (DS_StrLen(&fms_data) > 0)
-   {
-      ++received_fms_packets;
-      fms_read = protocol.read_fms_packet(&fms_data);
-      CFG_SetFMSCommunications(fms_read);
-   }
+   recv_fms_data();
+   recv_radio_data();
+   recv_robot_data();
+   recv_netconsole_data();
+   state()->rx_time = 0;
 
-   /* Read radio packet */
-   if (DS_StrLen(&radio_data) > 0)
-   {
-      ++received_radio_packets;
-      radio_read = protocol.read_radio_packet(&radio_data);
-      CFG_SetRadioCommunications(radio_read);
-   }
+   /* Get the times at which the kernel sent our packets */
+   read_send_times(&state()->protocol.fms_socket, DS_LINK_FMS);
+   read_send_times(&state()->protocol.radio_socket, DS_LINK_RADIO);
+   read_send_times(&state()->protocol.robot_socket, DS_LINK_ROBOT);
 
-   /* Read robot packet */
-   if (DS_StrLen(&robot_data) > 0)
+   /* Reset the data pointers */
+   clear_recv_data();
+}
+
+/**
+ * Returns the statistics of the given \a link of the current context
+ */
+static DS_LinkStats get_link_stats(const DS_Link link)
+{
+   ProtocolState *ptr = state();
+
+   DS_LinkStats stats;
+   memset(&stats, 0, sizeof(stats));
+   DS_LinkMonitorStats(&ptr->links[link], DS_GetMonotonicTime(), &stats);
+
+   switch (link)
    {
-      ++received_robot_packets;
-      robot_read = protocol.read_robot_packet(&robot_data);
-      CFG_SetRobotCommunications(robot_read);
+      case DS_LINK_FMS:
+         stats.sent_packets = ptr->sent_fms_packets;
+         stats.received_packets = ptr->received_fms_packets;
+         stats.sent_bytes = ptr->sent_fms_bytes;
+         stats.received_bytes = ptr->recv_fms_bytes;
+         break;
+      case DS_LINK_RADIO:
+         stats.sent_packets = ptr->sent_radio_packets;
+         stats.received_packets = ptr->received_radio_packets;
+         stats.sent_bytes = ptr->sent_radio_bytes;
+         stats.received_bytes = ptr->recv_radio_bytes;
+         break;
+      case DS_LINK_ROBOT:
+         stats.sent_packets = ptr->sent_robot_packets;
+         stats.received_packets = ptr->received_robot_packets;
+         stats.sent_bytes = ptr->sent_robot_bytes;
+         stats.received_bytes = ptr->recv_robot_bytes;
+         break;
    }
 
-   /* Add NetConsole message to event system */
-   if (netcs_data.len > 0)
-      CFG_AddNetConsoleMessage(&netcs_data);
+   return stats;
+}
 
-   /* Reset the data pointers */
-   clear_recv_data();
+/**
+ * Returns \c 1 if the remote host of the given \a socket reported that it
+ * cannot be reached while we were \a connected to it, in which case there
+ * is no need to wait for the watchdog to expire
+ */
+static int link_lost(DS_Socket *socket, const int connected)
+{
+   return DS_SocketUnreachable(socket) && connected;
 }
 
 /**
@@ -253,54 +436,286 @@ static void recv_data()
 static void update_watchdogs()
 {
    /* Feed the watchdogs if packets are read */
-   if (fms_read)
-      DS_TimerReset(&fms_recv_timer);
-   if (radio_read)
-      DS_TimerReset(&radio_recv_timer);
-   if (robot_read)
-      DS_TimerReset(&robot_recv_timer);
+   if (state()->fms_read)
+      DS_TimerReset(&state()->fms_recv_timer);
+   if (state()->radio_read)
+      DS_TimerReset(&state()->radio_recv_timer);
+   if (state()->robot_read)
+      DS_TimerReset(&state()->robot_recv_timer);
 
    /* Clear the read success values */
-   fms_read = 0;
-   radio_read = 0;
-   robot_read = 0;
+   state()->fms_read = 0;
+   state()->radio_read = 0;
+   state()->robot_read = 0;
 
-   /* Reset the FMS if the watchdog expires */
-   if (fms_recv_timer.expired)
+   /* Reset the FMS if the watchdog expires (or the FMS is unreachable) */
+   if (link_lost(&state()->protocol.fms_socket, CFG_GetFMSCommunications())
+       || DS_TimerPoll(&state()->fms_recv_timer))
    {
       CFG_FMSWatchdogExpired();
-      DS_TimerReset(&fms_recv_timer);
+      DS_TimerReset(&state()->fms_recv_timer);
    }
 
-   /* Reset the radio if the watchdog expires */
-   if (radio_recv_timer.expired)
+   /* Reset the radio if the watchdog expires (or the radio is unreachable) */
+   if (link_lost(&state()->protocol.radio_socket, CFG_GetRadioCommunications())
+       || DS_TimerPoll(&state()->radio_recv_timer))
    {
       CFG_RadioWatchdogExpired();
-      DS_TimerReset(&radio_recv_timer);
+      DS_TimerReset(&state()->radio_recv_timer);
    }
 
-   /* Reset the robot if the watchdog expires */
-   if (robot_recv_timer.expired)
+   /* Reset the robot if the watchdog expires (or the robot is unreachable) */
+   if (link_lost(&state()->protocol.robot_socket, CFG_GetRobotCommunications())
+       || DS_TimerPoll(&state()->robot_recv_timer))
    {
       CFG_RobotWatchdogExpired();
-      DS_TimerReset(&robot_recv_timer);
+      DS_TimerReset(&state()->robot_recv_timer);
+   }
+}
+
+/**
+ * Registers a link statistics event for every link that is connected
+ */
+static void report_link_stats()
+{
+   /* Timer has not expired yet */
+   if (!DS_TimerPoll(&state()->stats_timer))
+      return;
+
+   /* Get the connection states */
+   int i;
+   int connected[3];
+   connected[DS_LINK_FMS] = CFG_GetFMSCommunications();
+   connected[DS_LINK_RADIO] = CFG_GetRadioCommunications();
+   connected[DS_LINK_ROBOT] = CFG_GetRobotCommunications();
+
+   /* Report the statistics */
+   for (i = 0; i < 3; ++i)
+   {
+      if (connected[i])
+      {
+         DS_Event event;
+         event.link.type = DS_LINK_STATS_CHANGED;
+         event.link.link = (DS_Link)i;
+         event.link.stats = get_link_stats((DS_Link)i);
+         DS_AddEvent(&event);
+      }
+   }
+
+   DS_TimerReset(&state()->stats_timer);
+}
+
+/**
+ * Sends, reads and supervises the packets of the current context
+ */
+static void service_context()
+{
+   recv_data();
+   send_data();
+   update_watchdogs();
+   report_link_stats();
+}
+
+#if defined USE_REACTOR
+/**
+ * Arms the reactor timer so that it expires at the nearest deadline of the
+ * scheduled timers. If no timer is running, the reactor timer is disarmed
+ * and the event loop only wakes up when a packet is received.
+ *
+ * \note The caller must hold the context registry lock
+ */
+static void arm_reactor_timer()
+{
+   if (timer_fd < 0)
+      return;
+
+   /* Get the nearest deadline */
+   uint64_t next_deadline = DS_TimerNextDeadline();
+
+   /* Apply the deadline (a zeroed value disarms the timer) */
+   struct itimerspec spec;
+   memset(&spec, 0, sizeof(spec));
+   spec.it_value.tv_sec = (time_t)(next_deadline / 1000000000ULL);
+   spec.it_value.tv_nsec = (long)(next_deadline % 1000000000ULL);
+   timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/**
+ * Wakes up the event loop immediately (e.g. to let it exit, or to let it
+ * re-arm its timer after a protocol has been loaded)
+ */
+static void wake_reactor()
+{
+   if (timer_fd < 0)
+      return;
+
+   struct itimerspec spec;
+   memset(&spec, 0, sizeof(spec));
+   spec.it_value.tv_nsec = 1;
+   timerfd_settime(timer_fd, 0, &spec, NULL);
+}
+
+/**
+ * Creates the epoll set used by the event loop, which contains the sockets
+ * poll descriptor and the reactor timer.
+ *
+ * \returns \c 1 on success, \c 0 if we must fall back to the polling loop
+ */
+static int init_reactor()
+{
+   int sockets_fd = Sockets_PollFd();
+   if (sockets_fd < 0)
+      return 0;
+
+   /* Create the epoll set and the timer */
+   reactor_fd = epoll_create1(EPOLL_CLOEXEC);
+   timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+   /* Register the sockets and the timer */
+   int error = (reactor_fd < 0 || timer_fd < 0);
+   if (!error)
+   {
+      struct epoll_event event;
+      memset(&event, 0, sizeof(event));
+      event.events = EPOLLIN;
+
+      event.data.fd = sockets_fd;
+      error |= epoll_ctl(reactor_fd, EPOLL_CTL_ADD, sockets_fd, &event);
+
+      event.data.fd = timer_fd;
+      error |= epoll_ctl(reactor_fd, EPOLL_CTL_ADD, timer_fd, &event);
+   }
+
+   /* Something went wrong, close everything */
+   if (error)
+   {
+      if (reactor_fd >= 0)
+         close(reactor_fd);
+      if (timer_fd >= 0)
+         close(timer_fd);
+
+      timer_fd = -1;
+      reactor_fd = -1;
+      return 0;
+   }
+
+   return 1;
+}
+
+/**
+ * Closes the epoll set and the timer used by the event loop
+ */
+static void close_reactor()
+{
+   if (reactor_fd >= 0)
+      close(reactor_fd);
+   if (timer_fd >= 0)
+      close(timer_fd);
+
+   timer_fd = -1;
+   reactor_fd = -1;
+}
+
+/**
+ * Marks the context that owns the given \a socket as ready, so that the
+ * received data is processed in this iteration of the event loop
+ */
+static void mark_socket_ready(DS_Socket *socket)
+{
+   if (socket->owner)
+      Contexts_MarkReady((DS_Context *)socket->owner);
+}
+
+/**
+ * Expires the timers whose deadline has been reached and marks the contexts
+ * that own them as ready
+ */
+static void mark_timers_ready()
+{
+   void *owner;
+   while (DS_TimerExpireNext(&owner))
+   {
+      if (owner)
+         Contexts_MarkReady((DS_Context *)owner);
    }
 }
 
 /**
- * This function is executed periodically, the function does the following:
+ * Runs the event loop until \a running is set to \c 0, the thread only
+ * wakes up when a socket receives data or when a timer deadline is reached.
+ *
+ * Only the contexts that received data or that have an expired timer are
+ * serviced in each iteration, while holding the context registry lock (so
+ * that contexts cannot be deleted while we use them).
+ */
+static void run_reactor()
+{
+   int i;
+   uint64_t expirations;
+   struct epoll_event events[2];
+
+   while (running)
+   {
+      /* Sleep until the next packet or deadline */
+      Contexts_Lock();
+      arm_reactor_timer();
+      Contexts_Unlock();
+      if (!running)
+         break;
+
+      int count = epoll_wait(reactor_fd, events, 2, -1);
+
+      /* Handle timer expirations and check if sockets have data */
+      int dispatch = 0;
+      for (i = 0; i < count; ++i)
+      {
+         if (events[i].data.fd == timer_fd)
+         {
+            if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+               expirations = 0;
+         }
+
+         else
+            dispatch = 1;
+      }
+
+      /* Read the sockets and service the contexts that have work to do */
+      Contexts_Lock();
+      if (dispatch)
+         Sockets_Dispatch(&mark_socket_ready);
+      mark_timers_ready();
+      Contexts_ForEachReady(&service_context);
+      Contexts_Unlock();
+   }
+}
+#endif
+
+/**
+ * This function is executed periodically, the function does the following
+ * for every context:
  *    - Send data to the FMS, robot and radio
  *    - Read received data from the FMS, robot and radio
  *    - Feed/reset the watchdogs
  *    - Check if any of the watchdogs has expired
+ *
+ * On Linux, the work is driven by socket and timer events instead of
+ * being polled every 5 milliseconds.
  */
 static void *run_event_loop()
 {
+#if defined USE_REACTOR
+   if (reactor_fd >= 0)
+   {
+      run_reactor();
+      return NULL;
+   }
+#endif
+
    while (running)
    {
-      send_data();
-      recv_data();
-      update_watchdogs();
+      Contexts_Lock();
+      Contexts_ForEach(&service_context);
+      Contexts_Unlock();
       DS_Sleep(5);
    }
 
@@ -308,34 +723,43 @@ static void *run_event_loop()
 }
 
 /**
- * Returns a pointer to the current protocol
+ * Returns a pointer to the protocol of the current context
  */
 DS_Protocol *DS_CurrentProtocol()
 {
-   if (enable_operations)
-      return &protocol;
+   ProtocolState *ptr = state();
+   if (ptr->enable_operations)
+      return &ptr->protocol;
 
    return NULL;
 }
 
 /**
- * Initializes the protocol sender/receiver thread and the timers
+ * Returns a block of \c DS_PROTOCOL_DATA_SIZE bytes that the protocol of
+ * the current context may use to store its own state (e.g. packet counters
+ * and control flags). The block is zeroed every time a protocol is loaded.
  */
-void Protocols_Init()
+void *DS_ProtocolData()
 {
-   /* Initialize sender timers */
-   DS_TimerInit(&fms_send_timer, 0, SEND_PRECISION);
-   DS_TimerInit(&radio_send_timer, 0, SEND_PRECISION);
-   DS_TimerInit(&robot_send_timer, 0, SEND_PRECISION);
-
-   /* Initialize watchdog timers */
-   DS_TimerInit(&fms_recv_timer, 0, RECV_PRECISION);
-   DS_TimerInit(&radio_recv_timer, 0, RECV_PRECISION);
-   DS_TimerInit(&robot_recv_timer, 0, RECV_PRECISION);
+   return state()->data;
+}
 
+/**
+ * Initializes the protocol sender/receiver thread
+ */
+void Protocols_Init()
+{
    /* Allow the event loop to run */
    running = 1;
-   enable_operations = 0;
+
+   /* Create the event loop descriptors, the polling loop needs the timer
+    * scheduler to expire the timers between its iterations */
+#if defined USE_REACTOR
+   if (!init_reactor())
+      Timers_StartScheduler();
+#else
+   Timers_StartScheduler();
+#endif
 
    /* Configure the event thread */
    int error = pthread_create(&event_thread, NULL, &run_event_loop, NULL);
@@ -355,40 +779,64 @@ void Protocols_Init()
 }
 
 /**
- * De-allocates the current protocol and closes its sockets
+ * Stops the sender/receiver thread
+ */
+void Protocols_Close()
+{
+   running = 0;
+
+   /* Wake up the event loop */
+#if defined USE_REACTOR
+   wake_reactor();
+#endif
+
+   /* Wait for the event loop to exit */
+   pthread_join(event_thread, NULL);
+
+   /* Close the event loop descriptors */
+#if defined USE_REACTOR
+   close_reactor();
+#endif
+}
+
+/**
+ * De-allocates the protocol of the current context and closes its sockets
  */
 static void close_protocol()
 {
+   ProtocolState *ptr = state();
+
    /* Protocol is empty, abort */
-   if (!enable_operations)
+   if (!ptr->enable_operations)
       return;
 
    /* Disable protocol operations */
-   enable_operations = 0;
+   ptr->enable_operations = 0;
 
    /* Stop sender timers */
-   DS_TimerStop(&fms_send_timer);
-   DS_TimerStop(&radio_send_timer);
-   DS_TimerStop(&robot_send_timer);
+   DS_TimerStop(&ptr->fms_send_timer);
+   DS_TimerStop(&ptr->radio_send_timer);
+   DS_TimerStop(&ptr->robot_send_timer);
 
    /* Stop receiver timers */
-   DS_TimerStop(&fms_recv_timer);
-   DS_TimerStop(&radio_recv_timer);
-   DS_TimerStop(&robot_recv_timer);
+   DS_TimerStop(&ptr->fms_recv_timer);
+   DS_TimerStop(&ptr->radio_recv_timer);
+   DS_TimerStop(&ptr->robot_recv_timer);
+   DS_TimerStop(&ptr->stats_timer);
 
    /* Close the sockets */
-   DS_SocketClose(&protocol.fms_socket);
-   DS_SocketClose(&protocol.radio_socket);
-   DS_SocketClose(&protocol.robot_socket);
-   DS_SocketClose(&protocol.netconsole_socket);
+   DS_SocketClose(&ptr->protocol.fms_socket);
+   DS_SocketClose(&ptr->protocol.radio_socket);
+   DS_SocketClose(&ptr->protocol.robot_socket);
+   DS_SocketClose(&ptr->protocol.netconsole_socket);
 
    /* Reset sent/recv bytes */
-   sent_fms_bytes = 0;
-   recv_fms_bytes = 0;
-   sent_radio_bytes = 0;
-   recv_radio_bytes = 0;
-   sent_robot_bytes = 0;
-   recv_robot_bytes = 0;
+   ptr->sent_fms_bytes = 0;
+   ptr->recv_fms_bytes = 0;
+   ptr->sent_radio_bytes = 0;
+   ptr->recv_radio_bytes = 0;
+   ptr->sent_robot_bytes = 0;
+   ptr->recv_robot_bytes = 0;
 
    /* Reset sent/recv packets */
    DS_ResetFMSPackets();
@@ -396,7 +844,7 @@ static void close_protocol()
    DS_ResetRobotPackets();
 
    /* Create notification string */
-   char *name = DS_StrToChar(&protocol.name);
+   char *name = DS_StrToChar(&ptr->protocol.name);
    DS_String str = DS_StrFormat("Closed %s protocol", name);
    CFG_AddNotification(&str);
    DS_StrRmBuf(&str);
@@ -404,13 +852,49 @@ static void close_protocol()
 }
 
 /**
- * Stops the sender/receiver thread and deletes the allocated protocol
+ * Initializes the timers of the current context
  */
-void Protocols_Close()
+void Protocols_InitContext()
 {
-   running = 0;
+   ProtocolState *ptr = (ProtocolState *)Contexts_CreateState(DS_CONTEXT_PROTOCOLS, &default_state, sizeof(ProtocolState));
+
+   /* Initialize sender timers */
+   DS_TimerInit(&ptr->fms_send_timer, 0, SEND_PRECISION);
+   DS_TimerInit(&ptr->radio_send_timer, 0, SEND_PRECISION);
+   DS_TimerInit(&ptr->robot_send_timer, 0, SEND_PRECISION);
+
+   /* Initialize watchdog timers */
+   DS_TimerInit(&ptr->fms_recv_timer, 0, RECV_PRECISION);
+   DS_TimerInit(&ptr->radio_recv_timer, 0, RECV_PRECISION);
+   DS_TimerInit(&ptr->robot_recv_timer, 0, RECV_PRECISION);
+
+   /* Initialize link statistics timer */
+   DS_TimerInit(&ptr->stats_timer, STATS_INTERVAL, RECV_PRECISION);
+
+   /* Let the event loop find the context from its timers */
+   ptr->fms_send_timer.owner = DS_CurrentContext();
+   ptr->radio_send_timer.owner = DS_CurrentContext();
+   ptr->robot_send_timer.owner = DS_CurrentContext();
+   ptr->fms_recv_timer.owner = DS_CurrentContext();
+   ptr->radio_recv_timer.owner = DS_CurrentContext();
+   ptr->robot_recv_timer.owner = DS_CurrentContext();
+   ptr->stats_timer.owner = DS_CurrentContext();
+
+   /* Wait until a protocol is loaded */
+   ptr->enable_operations = 0;
+}
+
+/**
+ * De-allocates the protocol of the current context and releases its state
+ */
+void Protocols_CloseContext()
+{
+   Contexts_Lock();
    close_protocol();
+   Contexts_Unlock();
+
    clear_recv_data();
+   Contexts_DestroyState(DS_CONTEXT_PROTOCOLS);
 }
 
 /**
@@ -426,45 +910,72 @@ void DS_ConfigureProtocol(const DS_Protocol *ptr)
    /* Pointer is NULL, abort */
    assert(ptr != NULL);
 
+   /* Do not let the event loop use the protocol while we change it */
+   Contexts_Lock();
+
    /* Close previous protocol */
    close_protocol();
 
-   /* Re-assign the protocol */
-   protocol = *ptr;
+   /* Re-assign the protocol and reset its private data */
+   ProtocolState *state_ptr = state();
+   state_ptr->protocol = *ptr;
+   memset(state_ptr->data, 0, sizeof(state_ptr->data));
+
+   /* Use the transport selected for this context */
+   if (state_ptr->transport)
+   {
+      state_ptr->protocol.fms_socket.transport = state_ptr->transport;
+      state_ptr->protocol.radio_socket.transport = state_ptr->transport;
+      state_ptr->protocol.robot_socket.transport = state_ptr->transport;
+      state_ptr->protocol.netconsole_socket.transport = state_ptr->transport;
+   }
+
+   /* Let the event loop find the context from its sockets */
+   state_ptr->protocol.fms_socket.owner = DS_CurrentContext();
+   state_ptr->protocol.radio_socket.owner = DS_CurrentContext();
+   state_ptr->protocol.robot_socket.owner = DS_CurrentContext();
+   state_ptr->protocol.netconsole_socket.owner = DS_CurrentContext();
 
    /* Update sockets */
-   DS_SocketOpen(&protocol.fms_socket);
-   DS_SocketOpen(&protocol.radio_socket);
-   DS_SocketOpen(&protocol.robot_socket);
-   DS_SocketOpen(&protocol.netconsole_socket);
+   DS_SocketOpen(&state_ptr->protocol.fms_socket);
+   DS_SocketOpen(&state_ptr->protocol.radio_socket);
+   DS_SocketOpen(&state_ptr->protocol.robot_socket);
+   DS_SocketOpen(&state_ptr->protocol.netconsole_socket);
 
    /* Update sender timers */
-   fms_send_timer.time = protocol.fms_interval;
-   radio_send_timer.time = protocol.radio_interval;
-   robot_send_timer.time = protocol.robot_interval;
+   state_ptr->fms_send_timer.time = state_ptr->protocol.fms_interval;
+   state_ptr->radio_send_timer.time = state_ptr->protocol.radio_interval;
+   state_ptr->robot_send_timer.time = state_ptr->protocol.robot_interval;
 
    /* Update watchdogs */
-   fms_recv_timer.time = DS_Min(protocol.fms_interval * 50, 1000);
-   radio_recv_timer.time = DS_Min(protocol.radio_interval * 50, 1000);
-   robot_recv_timer.time = DS_Min(protocol.robot_interval * 50, 1000);
+   state_ptr->fms_recv_timer.time = DS_Min(state_ptr->protocol.fms_interval * 50, 1000);
+   state_ptr->radio_recv_timer.time = DS_Min(state_ptr->protocol.radio_interval * 50, 1000);
+   state_ptr->robot_recv_timer.time = DS_Min(state_ptr->protocol.robot_interval * 50, 1000);
 
    /* Start the timers */
-   DS_TimerStart(&fms_send_timer);
-   DS_TimerStart(&fms_recv_timer);
-   DS_TimerStart(&radio_send_timer);
-   DS_TimerStart(&radio_recv_timer);
-   DS_TimerStart(&robot_send_timer);
-   DS_TimerStart(&robot_recv_timer);
+   DS_TimerStart(&state_ptr->fms_send_timer);
+   DS_TimerStart(&state_ptr->fms_recv_timer);
+   DS_TimerStart(&state_ptr->radio_send_timer);
+   DS_TimerStart(&state_ptr->radio_recv_timer);
+   DS_TimerStart(&state_ptr->robot_send_timer);
+   DS_TimerStart(&state_ptr->robot_recv_timer);
+   DS_TimerStart(&state_ptr->stats_timer);
 
    /* Create notification string */
-   char *name = DS_StrToChar(&protocol.name);
+   char *name = DS_StrToChar(&state_ptr->protocol.name);
    DS_String str = DS_StrFormat("Loaded %s protocol", name);
    CFG_AddNotification(&str);
    DS_StrRmBuf(&str);
    DS_FREE(name);
 
    /* Restore protocol operations */
-   enable_operations = 1;
+   state_ptr->enable_operations = 1;
+   Contexts_Unlock();
+
+   /* Let the event loop re-arm its timer with the new deadlines */
+#if defined USE_REACTOR
+   wake_reactor();
+#endif
 }
 
 /**
@@ -476,7 +987,7 @@ void DS_ConfigureProtocol(const DS_Protocol *ptr)
  */
 unsigned long DS_SentFMSBytes()
 {
-   return sent_fms_bytes;
+   return state()->sent_fms_bytes;
 }
 
 /**
@@ -488,7 +999,7 @@ unsigned long DS_SentFMSBytes()
  */
 unsigned long DS_SentRadioBytes()
 {
-   return sent_radio_bytes;
+   return state()->sent_radio_bytes;
 }
 
 /**
@@ -500,7 +1011,7 @@ unsigned long DS_SentRadioBytes()
  */
 unsigned long DS_SentRobotBytes()
 {
-   return sent_robot_bytes;
+   return state()->sent_robot_bytes;
 }
 
 /**
@@ -512,7 +1023,7 @@ unsigned long DS_SentRobotBytes()
  */
 unsigned long DS_ReceivedFMSBytes()
 {
-   return recv_fms_bytes;
+   return state()->recv_fms_bytes;
 }
 
 /**
@@ -524,7 +1035,7 @@ unsigned long DS_ReceivedFMSBytes()
  */
 unsigned long DS_ReceivedRadioBytes()
 {
-   return recv_radio_bytes;
+   return state()->recv_radio_bytes;
 }
 
 /**
@@ -536,7 +1047,7 @@ unsigned long DS_ReceivedRadioBytes()
  */
 unsigned long DS_ReceivedRobotBytes()
 {
-   return recv_robot_bytes;
+   return state()->recv_robot_bytes;
 }
 
 /**
@@ -547,7 +1058,7 @@ unsigned long DS_ReceivedRobotBytes()
  */
 int DS_SentFMSPackets()
 {
-   return DS_Max(1, sent_fms_packets);
+   return DS_Max(1, state()->sent_fms_packets);
 }
 
 /**
@@ -558,7 +1069,7 @@ int DS_SentFMSPackets()
  */
 int DS_SentRadioPackets()
 {
-   return DS_Max(1, sent_radio_packets);
+   return DS_Max(1, state()->sent_radio_packets);
 }
 
 /**
@@ -569,7 +1080,7 @@ int DS_SentRadioPackets()
  */
 int DS_SentRobotPackets()
 {
-   return DS_Max(1, sent_robot_packets);
+   return DS_Max(1, state()->sent_robot_packets);
 }
 
 /**
@@ -580,7 +1091,7 @@ int DS_SentRobotPackets()
  */
 int DS_ReceivedFMSPackets()
 {
-   return received_fms_packets;
+   return state()->received_fms_packets;
 }
 
 /**
@@ -591,7 +1102,51 @@ int DS_ReceivedFMSPackets()
  */
 int DS_ReceivedRadioPackets()
 {
-   return received_radio_packets;
+   return state()->received_radio_packets;
+}
+
+/**
+ * Returns the number of FMS packets that were discarded because they
+ * arrived faster than they could be processed.
+ *
+ * This value is reset when the protocol is changed.
+ */
+int DS_DroppedFMSPackets()
+{
+   return (int)DS_SocketDropped(&state()->protocol.fms_socket);
+}
+
+/**
+ * Returns the number of radio packets that were discarded because they
+ * arrived faster than they could be processed.
+ *
+ * This value is reset when the protocol is changed.
+ */
+int DS_DroppedRadioPackets()
+{
+   return (int)DS_SocketDropped(&state()->protocol.radio_socket);
+}
+
+/**
+ * Returns the number of robot packets that were discarded because they
+ * arrived faster than they could be processed.
+ *
+ * This value is reset when the protocol is changed.
+ */
+int DS_DroppedRobotPackets()
+{
+   return (int)DS_SocketDropped(&state()->protocol.robot_socket);
+}
+
+/**
+ * Returns the number of NetConsole messages that were discarded because
+ * they arrived faster than they could be processed.
+ *
+ * This value is reset when the protocol is changed.
+ */
+int DS_DroppedNetConsolePackets()
+{
+   return (int)DS_SocketDropped(&state()->protocol.netconsole_socket);
 }
 
 /**
@@ -602,7 +1157,7 @@ int DS_ReceivedRadioPackets()
  */
 int DS_ReceivedRobotPackets()
 {
-   return received_robot_packets;
+   return state()->received_robot_packets;
 }
 
 /**
@@ -611,8 +1166,9 @@ int DS_ReceivedRobotPackets()
  */
 void DS_ResetFMSPackets()
 {
-   sent_fms_packets = 0;
-   received_fms_packets = 0;
+   state()->sent_fms_packets = 0;
+   state()->received_fms_packets = 0;
+   DS_LinkMonitorReset(&state()->links[DS_LINK_FMS]);
 }
 
 /**
@@ -621,8 +1177,9 @@ void DS_ResetFMSPackets()
  */
 void DS_ResetRadioPackets()
 {
-   sent_radio_packets = 0;
-   received_radio_packets = 0;
+   state()->sent_radio_packets = 0;
+   state()->received_radio_packets = 0;
+   DS_LinkMonitorReset(&state()->links[DS_LINK_RADIO]);
 }
 
 /**
@@ -631,6 +1188,99 @@ void DS_ResetRadioPackets()
  */
 void DS_ResetRobotPackets()
 {
-   sent_robot_packets = 0;
-   received_robot_packets = 0;
+   state()->sent_robot_packets = 0;
+   state()->received_robot_packets = 0;
+   DS_LinkMonitorReset(&state()->links[DS_LINK_ROBOT]);
+}
+
+/**
+ * Returns the round-trip time, jitter, loss and reordering statistics of the
+ * given \a link, along with its packet and byte counters
+ */
+DS_LinkStats DS_GetLinkStats(const DS_Link link)
+{
+   assert(link >= DS_LINK_FMS && link <= DS_LINK_ROBOT);
+
+   Contexts_Lock();
+   DS_LinkStats stats = get_link_stats(link);
+   Contexts_Unlock();
+
+   return stats;
+}
+
+/**
+ * Called by the protocol when it writes the sequence number \a seq in the
+ * packet that it is encoding for the given \a link. The packet is registered
+ * (see \c DS_LinkPacketSent()) once it has been sent successfully.
+ */
+void DS_LinkPacketEncoded(const DS_Link link, const unsigned int seq)
+{
+   assert(link >= DS_LINK_FMS && link <= DS_LINK_ROBOT);
+   state()->encoded_seq[link] = seq;
+   state()->encoded_time[link] = DS_GetMonotonicTime();
+   state()->seq_encoded[link] = 1;
+}
+
+/**
+ * Registers that the packet with the sequence number \a seq has been sent
+ * over the given \a link, used to measure the round-trip time and the loss
+ */
+void DS_LinkPacketSent(const DS_Link link, const unsigned int seq)
+{
+   assert(link >= DS_LINK_FMS && link <= DS_LINK_ROBOT);
+   DS_LinkMonitorSent(&state()->links[link], seq, DS_GetMonotonicTime());
+}
+
+/**
+ * Called by the protocol when the remote host of the given \a link echoes
+ * the sequence number \a seq of a packet that we sent
+ */
+void DS_LinkPacketEchoed(const DS_Link link, const unsigned int seq)
+{
+   assert(link >= DS_LINK_FMS && link <= DS_LINK_ROBOT);
+   DS_LinkMonitorEchoed(&state()->links[link], seq, DS_PacketTimestamp());
+}
+
+/**
+ * Returns the time at which the packet that is being interpreted by the
+ * protocol was received (see \c DS_SocketTimestamp()), or the current time
+ * if no packet is being interpreted
+ */
+uint64_t DS_PacketTimestamp()
+{
+   if (state()->rx_time > 0)
+      return state()->rx_time;
+
+   return DS_GetMonotonicTime();
+}
+
+/**
+ * Changes the transport used by the sockets of the current protocol (and of
+ * the protocols loaded afterwards), e.g. to talk to a simulated robot with
+ * \c DS_LoopbackTransport(). If a protocol is loaded, its sockets are
+ * re-opened with the new transport.
+ *
+ * \param transport the transport to use, or \c NULL to use the network
+ */
+void DS_SetTransport(const DS_Transport *transport)
+{
+   Contexts_Lock();
+
+   ProtocolState *ptr = state();
+   ptr->transport = transport;
+
+   if (ptr->enable_operations)
+   {
+      int i;
+      DS_Socket *sockets[4] = { &ptr->protocol.fms_socket, &ptr->protocol.radio_socket, &ptr->protocol.robot_socket,
+                                &ptr->protocol.netconsole_socket };
+      for (i = 0; i < 4; ++i)
+      {
+         DS_SocketClose(sockets[i]);
+         sockets[i]->transport = transport;
+         DS_SocketOpen(sockets[i]);
+      }
+   }
+
+   Contexts_Unlock();
 }
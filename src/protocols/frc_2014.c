@@ -22,11 +22,15 @@
  */
 
 #include <math.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
 
 #include "DS_Utils.h"
 #include "DS_Config.h"
 #include "DS_Protocol.h"
 #include "DS_Joysticks.h"
+#include "DS_PacketTemplate.h"
 #include "DS_DefaultProtocols.h"
 
 /*
@@ -49,10 +53,6 @@ static const uint8_t cAllianceBlue = 0x42;
 static const uint8_t cFMSAutonomous = 0x53;
 static const uint8_t cFMSTeleoperated = 0x43;
 
-/*
- * Sent robot packet counters, they are used as packet IDs
- */
-static unsigned int sent_robot_packets = 0;
 
 /*
  * Joystick properties
@@ -63,11 +63,44 @@ static int max_buttons = 10;
 static int max_joysticks = 4;
 
 /*
- * Control code flags
+ * Layout of the DS-to-robot packet, only the header (packet index, control
+ * code, team number and station) and the joystick data (4 joysticks with 6
+ * axes and 2 button bytes) change between packets, the rest is the DS
+ * version surrounded by zeroes
+ */
+#define ROBOT_PACKET_SIZE 1024
+#define ROBOT_PACKET_DYNAMIC (8 + 4 * (6 + 2))
+#define ROBOT_PACKET_VERSION 72
+#define ROBOT_PACKET_CRC 1020
+
+/*
+ * Template of the DS-to-robot packet (shared by all contexts)
+ */
+static uint8_t robot_frame[ROBOT_PACKET_SIZE];
+static DS_PacketTemplate robot_template;
+static pthread_once_t robot_template_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Holds the state of the protocol for the current context, it is stored in
+ * the block returned by \c DS_ProtocolData() (which is zeroed when the
+ * protocol is loaded)
+ */
+typedef struct
+{
+   unsigned int sent_robot_packets; /**< Used as packet IDs */
+   int synced; /**< Set to \c 0 to resync robot communications */
+   int reboot; /**< Set to \c 1 to reboot the robot */
+   int restart_code; /**< Set to \c 1 to restart the robot code */
+} ProtocolState;
+
+/**
+ * Returns the protocol state of the current context
  */
-static int resync = 1;
-static int reboot = 0;
-static int restart_code = 0;
+static ProtocolState *state(void)
+{
+   assert(sizeof(ProtocolState) <= DS_PROTOCOL_DATA_SIZE);
+   return (ProtocolState *)DS_ProtocolData();
+}
 
 /**
  * Gets the alliance type from the received \a byte
@@ -133,7 +166,7 @@ static uint8_t get_control_code(void)
    }
 
    /* Resync robot communications */
-   if (resync)
+   if (!state()->synced)
       code |= cResyncComms;
 
    /* Let robot know if we are connected to FMS */
@@ -145,7 +178,7 @@ static uint8_t get_control_code(void)
       code = cEmergencyStopOn;
 
    /* Send the reboot code if required */
-   if (reboot)
+   if (state()->reboot)
       code = cRebootRobot;
 
    return code;
@@ -196,8 +229,8 @@ static uint8_t get_digital_inputs(void)
 }
 
 /**
- * Adds joystick information to a DS-to-robot packet, beginning at the given
- * \a offset in the data packet.
+ * Writes joystick information into the given \a out buffer (which must be
+ * able to hold the data of \c max_joysticks joysticks).
  *
  * The 2014 communication protocol records the data for all four joysticks,
  * if a joystick or joystick member is not present, we will send a neutral
@@ -208,32 +241,38 @@ static uint8_t get_digital_inputs(void)
  *
  * Button states are stored in a similar way as enumerated flags in a C/C++
  * program.
+ *
+ * \returns the number of written bytes
  */
-static DS_String get_joystick_data(void)
+static size_t encode_joystick_data(uint8_t *out)
 {
    /* Initialize variables */
    int i = 0;
    int j = 0;
-   DS_String buf = DS_StrNewLen(0);
+   size_t len = 0;
 
    /* Add data for every joystick */
    for (i = 0; i < max_joysticks; ++i)
    {
+      /* Read all the values of the joystick at once (zero if not present) */
+      DS_JoystickState stick;
+      DS_GetJoystickState(i, &stick);
+
       /* Add axis data */
       for (j = 0; j < max_axes; ++j)
-         DS_StrAppend(&buf, DS_FloatToByte(DS_GetJoystickAxis(i, j), 1));
+         out[len++] = DS_FloatToByte(j < stick.num_axes ? stick.axes[j] : 0, 1);
 
       /* Generate button data */
       uint16_t button_flags = 0;
-      for (j = 0; j < max_buttons; ++j)
-         button_flags += (uint16_t)DS_GetJoystickButton(i, j) ? j * j : 0;
+      for (j = 0; j < max_buttons && j < stick.num_buttons; ++j)
+         button_flags += ((stick.buttons >> j) & 1) ? j * j : 0;
 
       /* Add button data */
-      DS_StrAppend(&buf, (button_flags & 0xff00) >> 8);
-      DS_StrAppend(&buf, (button_flags & 0xff));
+      out[len++] = (uint8_t)((button_flags & 0xff00) >> 8);
+      out[len++] = (uint8_t)((button_flags & 0xff));
    }
 
-   return buf;
+   return len;
 }
 
 /**
@@ -261,6 +300,16 @@ static DS_String robot_address(void)
    return DS_GetStaticIP(10, CFG_GetTeamNumber(), 2);
 }
 
+/**
+ * The 2014 protocol does not send packets to the FMS
+ */
+static size_t encode_fms_packet(uint8_t *out, const size_t cap)
+{
+   (void)out;
+   (void)cap;
+   return 0;
+}
+
 /**
  * Generates an empty (ignored) FMS packet.
  */
@@ -278,8 +327,22 @@ static DS_String create_radio_packet(void)
 }
 
 /**
- * Generates a DS-to-robot packet. The packet is 1024 bytes long and contains
- * the following data:
+ * Builds the constant bytes of the DS-to-robot packet: the version of the
+ * FRC Driver Station and zeroes (the CRC32 is calculated with zeroes in its
+ * place)
+ */
+static void init_robot_template(void)
+{
+   /* FRC Driver Station version (same as FRC DS 17.01) */
+   memcpy(robot_frame + ROBOT_PACKET_VERSION, "14021700", 8);
+
+   /* Only the header and joystick data change between packets */
+   DS_TemplateInit(&robot_template, robot_frame, ROBOT_PACKET_SIZE, 0, ROBOT_PACKET_DYNAMIC);
+}
+
+/**
+ * Writes a DS-to-robot packet into the given \a out buffer. The packet is
+ * 1024 bytes long and contains the following data:
  *     - The packet index / ID
  *     - The team number
  *     - The control code (which includes e-stop and other commands)
@@ -288,76 +351,79 @@ static DS_String create_radio_packet(void)
  *     - (Number?) of digital inputs
  *     - The version of the FRC Driver Station
  *     - The CRC32 checksum of the packet
+ *
+ * \returns the length of the packet, or \c 0 if \a cap is too small
  */
-static DS_String create_robot_packet(void)
+static size_t encode_robot_packet(uint8_t *out, const size_t cap)
 {
-   /* Create initial packet */
-   DS_String data = DS_StrNewLen(8);
+   pthread_once(&robot_template_once, &init_robot_template);
+
+   /* Copy the constant bytes (version and zeroes), if the packet fits */
+   if (!DS_TemplateCopy(&robot_template, out, cap))
+      return 0;
 
    /* Add packet index */
-   DS_StrSetChar(&data, 0, (sent_robot_packets & 0xff00) >> 8);
-   DS_StrSetChar(&data, 1, (sent_robot_packets & 0xff));
+   out[0] = (uint8_t)((state()->sent_robot_packets & 0xff00) >> 8);
+   out[1] = (uint8_t)((state()->sent_robot_packets & 0xff));
 
    /* Add control code and digital inputs */
-   DS_StrSetChar(&data, 2, get_control_code());
-   DS_StrSetChar(&data, 3, get_digital_inputs());
+   out[2] = get_control_code();
+   out[3] = get_digital_inputs();
 
    /* Add team number */
-   DS_StrSetChar(&data, 4, (CFG_GetTeamNumber() & 0xff00) >> 8);
-   DS_StrSetChar(&data, 5, (CFG_GetTeamNumber() & 0xff));
+   out[4] = (uint8_t)((CFG_GetTeamNumber() & 0xff00) >> 8);
+   out[5] = (uint8_t)((CFG_GetTeamNumber() & 0xff));
 
    /* Add alliance and position */
-   DS_StrSetChar(&data, 6, get_alliance_code());
-   DS_StrSetChar(&data, 7, get_position_code());
+   out[6] = get_alliance_code();
+   out[7] = get_position_code();
 
    /* Add joystick data */
-   DS_String jsData = get_joystick_data();
-   DS_StrJoin(&data, &jsData);
-
-   /* Now resize the datagram to 1024 bytes */
-   DS_StrResize(&data, 1024);
-
-   /* Add FRC Driver Station version (same as FRC DS 17.01) */
-   DS_StrSetChar(&data, 72, (uint8_t)0x31);
-   DS_StrSetChar(&data, 73, (uint8_t)0x34);
-   DS_StrSetChar(&data, 74, (uint8_t)0x30);
-   DS_StrSetChar(&data, 75, (uint8_t)0x32);
-   DS_StrSetChar(&data, 76, (uint8_t)0x31);
-   DS_StrSetChar(&data, 77, (uint8_t)0x37);
-   DS_StrSetChar(&data, 78, (uint8_t)0x30);
-   DS_StrSetChar(&data, 79, (uint8_t)0x30);
-
-   /* Add CRC32 checksum */
-   uint32_t checksum = DS_CRC32(data.buf, DS_StrLen(&data));
-   DS_StrSetChar(&data, 1020, (checksum & 0xff000000) >> 24);
-   DS_StrSetChar(&data, 1021, (checksum & 0xff0000) >> 16);
-   DS_StrSetChar(&data, 1022, (checksum & 0xff00) >> 8);
-   DS_StrSetChar(&data, 1023, (checksum & 0xff));
+   size_t joystick_len = encode_joystick_data(out + 8);
+   assert(8 + joystick_len <= ROBOT_PACKET_DYNAMIC);
+   (void)joystick_len;
+
+   /* Add CRC32 checksum (only the header and joystick data are read) */
+   uint32_t checksum = DS_TemplateCRC32(&robot_template, out);
+   out[ROBOT_PACKET_CRC + 0] = (uint8_t)((checksum & 0xff000000) >> 24);
+   out[ROBOT_PACKET_CRC + 1] = (uint8_t)((checksum & 0xff0000) >> 16);
+   out[ROBOT_PACKET_CRC + 2] = (uint8_t)((checksum & 0xff00) >> 8);
+   out[ROBOT_PACKET_CRC + 3] = (uint8_t)((checksum & 0xff));
 
    /* Increase sent robot packets */
-   ++sent_robot_packets;
+   ++state()->sent_robot_packets;
+
+   return ROBOT_PACKET_SIZE;
+}
 
-   /* Return address of data */
+/**
+ * Generates a DS-to-robot packet (see the \c encode_robot_packet() function
+ * for more information)
+ */
+static DS_String create_robot_packet(void)
+{
+   DS_String data = DS_StrNewLen(ROBOT_PACKET_SIZE);
+   DS_StrResize(&data, encode_robot_packet((uint8_t *)data.buf, data.len));
    return data;
 }
 
 /**
  * Gets the team station and the robot control mode from the FMS
  */
-static int read_fms_packet(const DS_String *data)
+static int read_fms_packet(const DS_ByteSpan *data)
 {
    /* Data pointer is invalid */
    if (!data)
       return 0;
 
    /* Packet is too small */
-   if (DS_StrLen(data) < 5)
+   if (data->n < 5)
       return 0;
 
    /* Read FMS packet */
-   uint8_t robotmod = (uint8_t)DS_StrCharAt(data, 2);
-   uint8_t alliance = (uint8_t)DS_StrCharAt(data, 3);
-   uint8_t position = (uint8_t)DS_StrCharAt(data, 4);
+   uint8_t robotmod = DS_SpanU8(data, 2);
+   uint8_t alliance = DS_SpanU8(data, 3);
+   uint8_t position = DS_SpanU8(data, 4);
 
    /* Switch to autonomous */
    if (robotmod & cFMSAutonomous)
@@ -381,7 +447,7 @@ static int read_fms_packet(const DS_String *data)
  * Since the DS does not interact directly with the radio/bridge, any incoming
  * packets shall be ignored.
  */
-static int read_radio_packet(const DS_String *data)
+static int read_radio_packet(const DS_ByteSpan *data)
 {
    (void)data;
    return 0;
@@ -391,26 +457,27 @@ static int read_radio_packet(const DS_String *data)
  * Interprets the given robot packet \a data and updates the emergency stop
  * state and the robot voltage values.
  */
-int read_robot_packet(const DS_String *data)
+int read_robot_packet(const DS_ByteSpan *data)
 {
    /* Data pointer is invalid */
    if (!data)
       return 0;
 
    /* Packet is too small */
-   if (DS_StrLen(data) < 1024)
+   if (data->n < 1024)
       return 0;
 
    /* Calculate voltage using the rule of three */
-   uint8_t upper = ((uint8_t)DS_StrCharAt(data, 1) * 12) / 0x12;
-   uint8_t lower = ((uint8_t)DS_StrCharAt(data, 2) * 12) / 0x12;
+   uint8_t upper = (DS_SpanU8(data, 1) * 12) / 0x12;
+   uint8_t lower = (DS_SpanU8(data, 2) * 12) / 0x12;
 
    /* Construct the voltage float */
    float voltage = ((float)upper) + ((float)lower / 0xff);
    CFG_SetRobotVoltage(voltage);
 
-   /* Check if robot is e-stopped */
-   CFG_SetEmergencyStopped((uint8_t)DS_StrCharAt(data, 0) == cEmergencyStopOn);
+   /* Check if robot is e-stopped (only the DS can release the e-stop) */
+   if (DS_SpanU8(data, 0) == cEmergencyStopOn)
+      CFG_SetEmergencyStopped(1);
 
    /* Assume that robot code is present (issue #31 in QDriverStation) */
    CFG_SetRobotCode(1);
@@ -441,9 +508,9 @@ static void reset_radio(void)
  */
 static void reset_robot(void)
 {
-   resync = 1;
-   reboot = 0;
-   restart_code = 0;
+   state()->synced = 0;
+   state()->reboot = 0;
+   state()->restart_code = 0;
 }
 
 /**
@@ -452,7 +519,7 @@ static void reset_robot(void)
  */
 static void reboot_robot(void)
 {
-   reboot = 1;
+   state()->reboot = 1;
 }
 
 /**
@@ -461,7 +528,7 @@ static void reboot_robot(void)
  */
 void restart_robot_code(void)
 {
-   restart_code = 1;
+   state()->restart_code = 1;
 }
 
 /**
@@ -485,6 +552,10 @@ DS_Protocol DS_GetProtocolFRC_2014(void)
    protocol.create_radio_packet = &create_radio_packet;
    protocol.create_robot_packet = &create_robot_packet;
 
+   /* Set packet encoder functions */
+   protocol.encode_fms_packet = &encode_fms_packet;
+   protocol.encode_robot_packet = &encode_robot_packet;
+
    /* Set packet interpretation functions */
    protocol.read_fms_packet = &read_fms_packet;
    protocol.read_radio_packet = &read_radio_packet;
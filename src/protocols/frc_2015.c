@@ -31,6 +31,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
 
 #if defined _WIN32
 #   include <windows.h>
@@ -70,18 +71,29 @@ static const uint8_t cRTagDiskInfo = 0x04;
 static const uint8_t cRequestTime = 0x01;
 static const uint8_t cRobotHasCode = 0x20;
 
-/*
- * Sent robot and FMS packet counters
+/**
+ * Holds the state of the protocol for the current context, it is stored in
+ * the block returned by \c DS_ProtocolData() (which is zeroed when the
+ * protocol is loaded)
  */
-static unsigned int send_time_data = 0;
-static unsigned int sent_fms_packets = 0;
-static unsigned int sent_robot_packets = 0;
+typedef struct
+{
+   unsigned int send_time_data; /**< Set when the robot requests the time */
+   unsigned int sent_fms_packets; /**< Used as FMS packet IDs */
+   unsigned int sent_robot_packets; /**< Used as robot packet IDs */
+   int reboot; /**< Set to \c 1 to reboot the robot */
+   int restart_code; /**< Set to \c 1 to restart the robot code */
+   DS_JoystickCache joysticks; /**< Joystick data sent in the last packet */
+} ProtocolState;
 
-/*
- * Control code flags
+/**
+ * Returns the protocol state of the current context
  */
-static int reboot = 0;
-static int restart_code = 0;
+static ProtocolState *state(void)
+{
+   assert(sizeof(ProtocolState) <= DS_PROTOCOL_DATA_SIZE);
+   return (ProtocolState *)DS_ProtocolData();
+}
 
 /**
  * Obtains the voltage float from the given \a upper and \a lower bytes
@@ -210,9 +222,9 @@ static uint8_t get_request_code(void)
    /* Robot has comms, check if we need to send additional flags */
    if (CFG_GetRobotCommunications())
    {
-      if (reboot)
+      if (state()->reboot)
          code = cRequestReboot;
-      else if (restart_code)
+      else if (state()->restart_code)
          code = cRequestRestartCode;
    }
 
@@ -261,31 +273,31 @@ static uint8_t get_station_code(void)
 }
 
 /**
- * Returns the size of the given \a joystick. This function is used to generate
- * joystick data (which is sent to the robot) and to resize the client->robot
- * datagram automatically.
+ * Returns the size of the joystick described by the given \a stick snapshot.
+ * This function is used to generate joystick data (which is sent to the robot)
+ * and to resize the client->robot datagram automatically.
  */
-static uint8_t get_joystick_size(const int joystick)
+static uint8_t get_joystick_size(const DS_JoystickState *stick)
 {
    int header_size = 2;
    int button_data = 3;
-   int axis_data = DS_GetJoystickNumAxes(joystick) + 1;
-   int hat_data = (DS_GetJoystickNumHats(joystick) * 2) + 1;
+   int axis_data = stick->num_axes + 1;
+   int hat_data = (stick->num_hats * 2) + 1;
 
    return header_size + button_data + axis_data + hat_data;
 }
 
 /**
- * Returns information regarding the current date and time and the timezone
- * of the client computer.
+ * Writes information regarding the current date and time and the timezone
+ * of the client computer into the given \a out buffer.
  *
  * The robot may ask for this information in some cases (e.g. when initializing
  * the robot code).
+ *
+ * \returns the number of written bytes, or \c 0 if \a cap is too small
  */
-static DS_String get_timezone_data(void)
+static size_t encode_timezone_data(uint8_t *out, const size_t cap)
 {
-   DS_String data = DS_StrNewLen(14);
-
    /* Get current time */
    time_t rt = 0;
    uint32_t ms = 0;
@@ -303,120 +315,133 @@ static DS_String get_timezone_data(void)
    GetTimeZoneInformation(&info);
 
    /* Convert the wchar to a standard string */
-   size_t len = wcslen(info.StandardName) + 1;
-   char *str = calloc(len, sizeof(char));
-   wcstombs_s(NULL, str, len, info.StandardName, wcslen(info.StandardName));
-
-   /* Convert the obtained cstring to a bstring */
-   DS_String tz = DS_StrNew(str);
-   free(str);
+   char tz[64] = { 0 };
+   wcstombs_s(NULL, tz, sizeof(tz), info.StandardName, _TRUNCATE);
 
    /* Get milliseconds */
    GetSystemTime(&info.StandardDate);
    ms = (uint32_t)info.StandardDate.wMilliseconds;
 #else
    /* Timezone is stored directly in time_t structure */
-   DS_String tz = DS_StrNew(timeinfo.tm_zone);
+   const char *tz = timeinfo.tm_zone ? timeinfo.tm_zone : "";
 #endif
 
+   /* Check if the data fits in the buffer */
+   size_t tz_len = strlen(tz);
+   if (cap < 14 + tz_len)
+      return 0;
+
    /* Encode date/time in datagram */
-   DS_StrSetChar(&data, 0, (uint8_t)0x0b);
-   DS_StrSetChar(&data, 1, (uint8_t)cTagDate);
-   DS_StrSetChar(&data, 2, (uint8_t)(ms >> 24));
-   DS_StrSetChar(&data, 3, (uint8_t)(ms >> 16));
-   DS_StrSetChar(&data, 4, (uint8_t)(ms >> 8));
-   DS_StrSetChar(&data, 5, (uint8_t)(ms));
-   DS_StrSetChar(&data, 6, (uint8_t)timeinfo.tm_sec);
-   DS_StrSetChar(&data, 7, (uint8_t)timeinfo.tm_min);
-   DS_StrSetChar(&data, 8, (uint8_t)timeinfo.tm_hour);
-   DS_StrSetChar(&data, 9, (uint8_t)timeinfo.tm_yday);
-   DS_StrSetChar(&data, 10, (uint8_t)timeinfo.tm_mon);
-   DS_StrSetChar(&data, 11, (uint8_t)timeinfo.tm_year);
+   out[0] = (uint8_t)0x0b;
+   out[1] = (uint8_t)cTagDate;
+   out[2] = (uint8_t)(ms >> 24);
+   out[3] = (uint8_t)(ms >> 16);
+   out[4] = (uint8_t)(ms >> 8);
+   out[5] = (uint8_t)(ms);
+   out[6] = (uint8_t)timeinfo.tm_sec;
+   out[7] = (uint8_t)timeinfo.tm_min;
+   out[8] = (uint8_t)timeinfo.tm_hour;
+   out[9] = (uint8_t)timeinfo.tm_yday;
+   out[10] = (uint8_t)timeinfo.tm_mon;
+   out[11] = (uint8_t)timeinfo.tm_year;
 
    /* Add timezone length and tag */
-   DS_StrSetChar(&data, 12, DS_StrLen(&tz));
-   DS_StrSetChar(&data, 13, cTagTimezone);
-
+   out[12] = (uint8_t)tz_len;
+   out[13] = cTagTimezone;
    /* Add timezone string */
-   DS_StrJoin(&data, &tz);
+   memcpy(out + 14, tz, tz_len);
 
-   /* Return the obtained data */
-   return data;
+   /* Return the length of the obtained data */
+   return 14 + tz_len;
 }
 
 /**
- * Constructs a joystick information structure for every attached joystick.
- * Unlike the 2014 protocol, the 2015 protocol only generates joystick data
- * for the attached joysticks.
+ * Writes the joystick information structure of the given \a joystick into
+ * the given \a out buffer.
+ *
+ * \returns the number of written bytes, or \c 0 if \a cap is too small
  */
-static DS_String get_joystick_data(void)
+static size_t encode_joystick(const int joystick, uint8_t *out, const size_t cap)
 {
-   /* Initialize the variables */
-   int i = 0;
+   /* Read all the values of the joystick at once */
    int j = 0;
-   DS_String data = DS_StrNewLen(0);
+   size_t len = 0;
+   DS_JoystickState stick;
+   DS_GetJoystickState(joystick, &stick);
+
+   /* Stop if the joystick does not fit in the buffer */
+   if ((size_t)(7 + stick.num_axes + (stick.num_hats * 2)) > cap)
+      return 0;
+
+   out[len++] = get_joystick_size(&stick);
+   out[len++] = cTagJoystick;
+
+   /* Add axis data */
+   out[len++] = (uint8_t)stick.num_axes;
+   for (j = 0; j < stick.num_axes; ++j)
+      out[len++] = DS_FloatToByte(stick.axes[j], 1);
 
-   /* Generate data for each joystick */
-   for (i = 0; i < DS_GetJoystickCount(); ++i)
+   /* Add button data (the protocol only sends the first 16 buttons) */
+   out[len++] = (uint8_t)stick.num_buttons;
+   out[len++] = (uint8_t)(stick.buttons >> 8);
+   out[len++] = (uint8_t)(stick.buttons);
+
+   /* Add hat data */
+   out[len++] = (uint8_t)stick.num_hats;
+   for (j = 0; j < stick.num_hats; ++j)
    {
-      DS_StrAppend(&data, get_joystick_size(i));
-      DS_StrAppend(&data, cTagJoystick);
-
-      /* Add axis data */
-      DS_StrAppend(&data, DS_GetJoystickNumAxes(i));
-      for (j = 0; j < DS_GetJoystickNumAxes(i); ++j)
-         DS_StrAppend(&data, DS_FloatToByte(DS_GetJoystickAxis(i, j), 1));
-
-      /* Generate button data */
-      uint16_t button_flags = 0;
-      for (j = 0; j < DS_GetJoystickNumButtons(i); ++j)
-         button_flags += DS_GetJoystickButton(i, j) ? (int)pow(2, j) : 0;
-
-      /* Add button data */
-      DS_StrAppend(&data, DS_GetJoystickNumButtons(i));
-      DS_StrAppend(&data, (uint8_t)(button_flags >> 8));
-      DS_StrAppend(&data, (uint8_t)(button_flags));
-
-      /* Add hat data */
-      DS_StrAppend(&data, DS_GetJoystickNumHats(i));
-      for (j = 0; j < DS_GetJoystickNumHats(i); ++j)
-      {
-         DS_StrAppend(&data, (uint8_t)(DS_GetJoystickHat(i, j) >> 8));
-         DS_StrAppend(&data, (uint8_t)(DS_GetJoystickHat(i, j)));
-      }
+      out[len++] = (uint8_t)(stick.hats[j] >> 8);
+      out[len++] = (uint8_t)(stick.hats[j]);
    }
 
-   /* Return obtained data */
-   return data;
+   /* Return the length of the obtained data */
+   return len;
+}
+
+/**
+ * Writes a joystick information structure for every attached joystick into
+ * the given \a out buffer.
+ * Unlike the 2014 protocol, the 2015 protocol only generates joystick data
+ * for the attached joysticks.
+ *
+ * Only the joysticks that changed since the last packet are encoded again,
+ * the others are copied from the data of the last packet.
+ *
+ * \returns the number of written bytes (joysticks that do not fit in the
+ *          buffer are omitted)
+ */
+static size_t encode_joystick_data(uint8_t *out, const size_t cap)
+{
+   return DS_JoystickCacheEncode(&state()->joysticks, &encode_joystick, out, cap);
 }
 
 /**
  * Obtains the CPU, RAM, Disk and CAN information from the robot packet
  */
-static void read_extended(const DS_String *data, const int offset)
+static void read_extended(const DS_ByteSpan *data, const int offset)
 {
    /* Check if data pointer is valid */
    if (!data)
       return;
 
    /* Get header tag */
-   uint8_t tag = (uint8_t)DS_StrCharAt(data, offset + 1);
+   uint8_t tag = DS_SpanU8(data, offset + 1);
 
    /* Get CAN information */
    if (tag == cRTagCANInfo)
-      CFG_SetCANUtilization((uint8_t)DS_StrCharAt(data, 10));
+      CFG_SetCANUtilization(DS_SpanU8(data, 10));
 
    /* Get CPU usage */
    else if (tag == cRTagCPUInfo)
-      CFG_SetRobotCPUUsage((uint8_t)DS_StrCharAt(data, 3));
+      CFG_SetRobotCPUUsage(DS_SpanU8(data, 3));
 
    /* Get RAM usage */
    else if (tag == cRTagRAMInfo)
-      CFG_SetRobotRAMUsage((uint8_t)DS_StrCharAt(data, 4));
+      CFG_SetRobotRAMUsage(DS_SpanU8(data, 4));
 
    /* Get disk usage */
    else if (tag == cRTagDiskInfo)
-      CFG_SetRobotDiskUsage((uint8_t)DS_StrCharAt(data, 4));
+      CFG_SetRobotDiskUsage(DS_SpanU8(data, 4));
 }
 
 /**
@@ -477,18 +502,22 @@ static DS_String robot_address(void)
 }
 
 /**
- * Generates a packet that the DS will send to the FMS, it contains:
+ * Writes the packet that the DS will send to the FMS into the given \a out
+ * buffer, it contains:
  *    - The FMS packet index
  *    - The robot voltage
  *    - Robot control code
  *    - DS version
  *    - Radio and robot ping flags
  *    - The team number
+ *
+ * \returns the length of the packet, or \c 0 if \a cap is too small
  */
-static DS_String create_fms_packet(void)
+static size_t encode_fms_packet(uint8_t *out, const size_t cap)
 {
-   /* Create an 8-byte long packet */
-   DS_String data = DS_StrNewLen(8);
+   /* The packet is 8 bytes long */
+   if (cap < 8)
+      return 0;
 
    /* Get voltage bytes */
    uint8_t integer = 0;
@@ -496,24 +525,38 @@ static DS_String create_fms_packet(void)
    encode_voltage(CFG_GetRobotVoltage(), &integer, &decimal);
 
    /* Add FMS packet count */
-   DS_StrSetChar(&data, 0, (sent_fms_packets >> 8));
-   DS_StrSetChar(&data, 1, (sent_fms_packets));
+   out[0] = (uint8_t)(state()->sent_fms_packets >> 8);
+   out[1] = (uint8_t)(state()->sent_fms_packets);
 
    /* Add DS version and FMS control code */
-   DS_StrSetChar(&data, 2, cFMS_DS_Version);
-   DS_StrSetChar(&data, 3, fms_control_code());
+   out[2] = cFMS_DS_Version;
+   out[3] = fms_control_code();
 
    /* Add team number */
-   DS_StrSetChar(&data, 4, (CFG_GetTeamNumber() >> 8));
-   DS_StrSetChar(&data, 5, (CFG_GetTeamNumber()));
+   out[4] = (uint8_t)(CFG_GetTeamNumber() >> 8);
+   out[5] = (uint8_t)(CFG_GetTeamNumber());
 
    /* Add robot voltage */
-   DS_StrSetChar(&data, 6, integer);
-   DS_StrSetChar(&data, 7, decimal);
+   out[6] = integer;
+   out[7] = decimal;
 
    /* Increase FMS packet counter */
-   ++sent_fms_packets;
+   ++state()->sent_fms_packets;
+
+   return 8;
+}
+
+/**
+ * Generates a packet that the DS will send to the FMS (see the
+ * \c encode_fms_packet() function for more information)
+ */
+static DS_String create_fms_packet(void)
+{
+   uint8_t buf[DS_PACKET_BUFFER_SIZE];
+   size_t len = encode_fms_packet(buf, sizeof(buf));
 
+   DS_String data = DS_StrNewLen(0);
+   DS_StrAppendBytes(&data, buf, len);
    return data;
 }
 
@@ -528,48 +571,62 @@ static DS_String create_radio_packet(void)
 }
 
 /**
- * Generates a packet that the DS will send to the robot, it contains the
- * following information:
+ * Writes the packet that the DS will send to the robot into the given \a out
+ * buffer, it contains the following information:
  *    - Packet index / ID
  *    - Control code (control modes, e-stop state, etc)
  *    - Request code (robot reboot, restart code, normal operation, etc)
  *    - Team station (alliance & position)
  *    - Date and time data (if robot requests it)
  *    - Joystick information (if the robot does not want date/time)
+ *
+ * \returns the length of the packet, or \c 0 if \a cap is too small
  */
-static DS_String create_robot_packet(void)
+static size_t encode_robot_packet(uint8_t *out, const size_t cap)
 {
-   DS_String data = DS_StrNewLen(6);
+   /* The packet header is 6 bytes long */
+   size_t len = 6;
+   if (cap < len)
+      return 0;
 
    /* Add packet index */
-   DS_StrSetChar(&data, 0, (sent_robot_packets >> 8));
-   DS_StrSetChar(&data, 1, (sent_robot_packets));
+   out[0] = (uint8_t)(state()->sent_robot_packets >> 8);
+   out[1] = (uint8_t)(state()->sent_robot_packets);
+   DS_LinkPacketEncoded(DS_LINK_ROBOT, state()->sent_robot_packets);
 
    /* Add packet header */
-   DS_StrSetChar(&data, 2, cTagGeneral);
+   out[2] = cTagGeneral;
 
    /* Add control code, request flags and team station */
-   DS_StrSetChar(&data, 3, get_control_code());
-   DS_StrSetChar(&data, 4, get_request_code());
-   DS_StrSetChar(&data, 5, get_station_code());
+   out[3] = get_control_code();
+   out[4] = get_request_code();
+   out[5] = get_station_code();
 
    /* Add timezone data (if robot wants it) */
-   if (send_time_data)
-   {
-      DS_String tz = get_timezone_data();
-      DS_StrJoin(&data, &tz);
-   }
+   if (state()->send_time_data)
+      len += encode_timezone_data(out + len, cap - len);
 
    /* Add joystick data */
-   else if (sent_robot_packets > 5)
-   {
-      DS_String js = get_joystick_data();
-      DS_StrJoin(&data, &js);
-   }
+   else if (state()->sent_robot_packets > 5)
+      len += encode_joystick_data(out + len, cap - len);
 
    /* Increase robot packet counter */
-   ++sent_robot_packets;
+   ++state()->sent_robot_packets;
 
+   return len;
+}
+
+/**
+ * Generates a packet that the DS will send to the robot (see the
+ * \c encode_robot_packet() function for more information)
+ */
+static DS_String create_robot_packet(void)
+{
+   uint8_t buf[DS_PACKET_BUFFER_SIZE];
+   size_t len = encode_robot_packet(buf, sizeof(buf));
+
+   DS_String data = DS_StrNewLen(0);
+   DS_StrAppendBytes(&data, buf, len);
    return data;
 }
 
@@ -581,30 +638,34 @@ static DS_String create_robot_packet(void)
  *   - Change team alliance
  *   - Change team position
  */
-static int read_fms_packet(const DS_String *data)
+static int read_fms_packet(const DS_ByteSpan *data)
 {
    /* Data pointer is invalid */
    if (!data)
       return 0;
 
    /* Packet is too small */
-   if (DS_StrLen(data) < 22)
+   if (data->n < 22)
       return 0;
 
    /* Read FMS packet */
-   uint8_t control = (uint8_t)DS_StrCharAt(data, 3);
-   uint8_t station = (uint8_t)DS_StrCharAt(data, 5);
+   uint8_t control = DS_SpanU8(data, 3);
+   uint8_t station = DS_SpanU8(data, 5);
+
+   /* The FMS may e-stop the robot, but it cannot release the e-stop */
+   if (control & cEmergencyStop)
+      CFG_SetEmergencyStopped(1);
 
    /* Change robot enabled state based on what FMS tells us to do*/
    CFG_SetRobotEnabled(control & cEnabled);
 
-   /* Get FMS robot mode */
-   if (control & cTeleoperated)
-      CFG_SetControlMode(DS_CONTROL_TELEOPERATED);
+   /* Get FMS robot mode (teleoperated has no flag of its own) */
+   if (control & cTest)
+      CFG_SetControlMode(DS_CONTROL_TEST);
    else if (control & cAutonomous)
       CFG_SetControlMode(DS_CONTROL_AUTONOMOUS);
-   else if (control & cTest)
-      CFG_SetControlMode(DS_CONTROL_TEST);
+   else
+      CFG_SetControlMode(DS_CONTROL_TELEOPERATED);
 
    /* Update to correct alliance and position */
    CFG_SetAlliance(get_alliance(station));
@@ -621,7 +682,7 @@ static int read_fms_packet(const DS_String *data)
  * Since the DS does not interact directly with the radio/bridge, any incoming
  * packets shall be ignored.
  */
-static int read_radio_packet(const DS_String *data)
+static int read_radio_packet(const DS_ByteSpan *data)
 {
    (void)data;
    return 0;
@@ -635,35 +696,42 @@ static int read_radio_packet(const DS_String *data)
  *    - The robot voltage
  *    - Extended information (CPU usage, RAM usage, Disk Usage and CAN status)
  */
-static int read_robot_packet(const DS_String *data)
+static int read_robot_packet(const DS_ByteSpan *data)
 {
    /* Data pointer is invalid */
    if (!data)
       return 0;
 
    /* Packet is too small */
-   if (DS_StrLen(data) < 7)
+   if (data->n < 7)
       return 0;
 
    /* Read robot packet */
-   uint8_t control = (uint8_t)DS_StrCharAt(data, 3);
-   uint8_t rstatus = (uint8_t)DS_StrCharAt(data, 4);
-   uint8_t request = (uint8_t)DS_StrCharAt(data, 7);
+   uint8_t control = DS_SpanU8(data, 3);
+   uint8_t rstatus = DS_SpanU8(data, 4);
+   uint8_t request = DS_SpanU8(data, 7);
+
+   /* The robot echoes the index of the packet it replies to */
+   DS_LinkPacketEchoed(DS_LINK_ROBOT, DS_SpanU16(data, 0));
 
    /* Update client information */
    CFG_SetRobotCode(rstatus & cRobotHasCode);
-   CFG_SetEmergencyStopped(control & cEmergencyStop);
+
+   /* The robot may e-stop itself, but it cannot release the e-stop (a reply
+    * sent before the robot read the e-stop command does not have the flag) */
+   if (control & cEmergencyStop)
+      CFG_SetEmergencyStopped(1);
 
    /* Update date/time request flag */
-   send_time_data = (request == cRequestTime);
+   state()->send_time_data = (request == cRequestTime);
 
    /* Calculate the voltage */
-   uint8_t upper = (uint8_t)DS_StrCharAt(data, 5);
-   uint8_t lower = (uint8_t)DS_StrCharAt(data, 6);
+   uint8_t upper = DS_SpanU8(data, 5);
+   uint8_t lower = DS_SpanU8(data, 6);
    CFG_SetRobotVoltage(decode_voltage(upper, lower));
 
    /* This is an extended packet, read its extra data */
-   if (DS_StrLen(data) > 9)
+   if (data->n > 9)
       read_extended(data, 8);
 
    /* Packet read, feed the watchdog some meat */
@@ -691,9 +759,9 @@ static void reset_radio(void)
  */
 static void reset_robot(void)
 {
-   reboot = 0;
-   restart_code = 0;
-   send_time_data = 0;
+   state()->reboot = 0;
+   state()->restart_code = 0;
+   state()->send_time_data = 0;
 }
 
 /**
@@ -701,7 +769,7 @@ static void reset_robot(void)
  */
 static void reboot_robot(void)
 {
-   reboot = 1;
+   state()->reboot = 1;
 }
 
 /**
@@ -710,7 +778,7 @@ static void reboot_robot(void)
  */
 static void restart_robot_code(void)
 {
-   restart_code = 1;
+   state()->restart_code = 1;
 }
 
 /**
@@ -734,6 +802,10 @@ DS_Protocol DS_GetProtocolFRC_2015(void)
    protocol.create_radio_packet = &create_radio_packet;
    protocol.create_robot_packet = &create_robot_packet;
 
+   /* Set packet encoder functions */
+   protocol.encode_fms_packet = &encode_fms_packet;
+   protocol.encode_robot_packet = &encode_robot_packet;
+
    /* Set packet interpretation functions */
    protocol.read_fms_packet = &read_fms_packet;
    protocol.read_radio_packet = &read_radio_packet;
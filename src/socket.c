@@ -21,12 +21,28 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#if defined __linux__ && !defined _GNU_SOURCE
+#   define _GNU_SOURCE /* For recvmmsg() */
+#endif
+
 #include "DS_Utils.h"
+#include "DS_Timer.h"
 #include "DS_Socket.h"
 
+#include <time.h>
 #include <socky.h>
+#include <errno.h>
 #include <assert.h>
 
+#if defined __linux__
+#   define USE_EPOLL 1
+#   define USE_RECVMMSG 1
+#   define USE_TIMESTAMPING 1
+#   include <sys/epoll.h>
+#   include <linux/errqueue.h>
+#   include <linux/net_tstamp.h>
+#endif
+
 #define SPRINTF_S snprintf
 #ifdef _WIN32
 #   ifndef __MINGW32__
@@ -35,38 +51,393 @@
 #   endif
 #endif
 
+/*
+ * On Linux, the input sockets are registered in a single epoll set that is
+ * processed by the protocol event loop, instead of running a select() loop
+ * in a separate thread for each socket
+ */
+#if defined USE_EPOLL
+static int poll_fd = -1;
+#endif
+
+/*
+ * Threads that wait for data with DS_SocketWait() sleep on this condition,
+ * which is signaled whenever new datagrams are moved to a receive ring
+ */
+static unsigned int waiters = 0;
+static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t wait_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Wakes up the threads that are blocked in \c DS_SocketWait()
+ */
+static void notify_waiters(void)
+{
+   /* Only take the lock if someone is actually waiting */
+   if (DS_AtomicAdd(&waiters, 0) > 0)
+   {
+      pthread_mutex_lock(&wait_lock);
+      pthread_cond_broadcast(&wait_cond);
+      pthread_mutex_unlock(&wait_lock);
+   }
+}
+
+#if defined USE_TIMESTAMPING
+/*
+ * Size of the buffer that receives the control messages of a datagram
+ */
+#define CONTROL_SIZE 256
+
+/**
+ * Converts a \c CLOCK_REALTIME timestamp reported by the kernel to the
+ * clock used by \c DS_GetMonotonicTime()
+ */
+static uint64_t to_monotonic(const struct timespec *ts)
+{
+   struct timespec real, mono;
+   clock_gettime(CLOCK_REALTIME, &real);
+   clock_gettime(CLOCK_MONOTONIC, &mono);
+
+   int64_t offset = ((int64_t)real.tv_sec - mono.tv_sec) * 1000000000LL + (real.tv_nsec - mono.tv_nsec);
+   int64_t value = (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec - offset;
+   return value > 0 ? (uint64_t)value : 0;
+}
+
+/**
+ * Returns the software timestamp found in the control messages of the given
+ * message, or \c 0 if the kernel did not timestamp it
+ */
+static uint64_t get_timestamp(struct msghdr *msg)
+{
+   struct cmsghdr *cmsg;
+   for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg))
+   {
+      if (cmsg->cmsg_level != SOL_SOCKET)
+         continue;
+
+      /* Obtained with SO_TIMESTAMPING, the first value is the software timestamp */
+      if (cmsg->cmsg_type == SCM_TIMESTAMPING)
+      {
+         struct scm_timestamping ts;
+         memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+         if (ts.ts[0].tv_sec || ts.ts[0].tv_nsec)
+            return to_monotonic(&ts.ts[0]);
+      }
+
+      /* Obtained with SO_TIMESTAMPNS */
+      else if (cmsg->cmsg_type == SCM_TIMESTAMPNS)
+      {
+         struct timespec ts;
+         memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+         return to_monotonic(&ts);
+      }
+   }
+
+   return 0;
+}
+
+/**
+ * Asks the kernel to timestamp the datagrams received by the input socket
+ * and the datagrams sent by the output socket. If \c SO_TIMESTAMPING is not
+ * available, \c SO_TIMESTAMPNS is used for received datagrams.
+ *
+ * \note Only software timestamps are used, hardware timestamps are taken
+ *       with the clock of the network card (and need root to be enabled)
+ */
+static void enable_timestamping(DS_Socket *ptr)
+{
+   int rx = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+   int tx = SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+
+   /* Timestamp received datagrams */
+   if (ptr->info.sock_in > 0 && setsockopt(ptr->info.sock_in, SOL_SOCKET, SO_TIMESTAMPING, &rx, sizeof(rx)) != 0)
+   {
+      int on = 1;
+      setsockopt(ptr->info.sock_in, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+   }
+
+   /* Timestamp sent datagrams */
+   ptr->info.tx_pending = 0;
+   ptr->info.timestamping = 0;
+   if (ptr->info.sock_out > 0)
+      ptr->info.timestamping = (setsockopt(ptr->info.sock_out, SOL_SOCKET, SO_TIMESTAMPING, &tx, sizeof(tx)) == 0);
+}
+#endif
+
 /**
- * Copies the received data from the socket in its data buffer
+ * Reads a datagram from the given socket and appends it to the receive ring
+ * of the socket. If the ring is full (e.g. the event loop did not keep up),
+ * the datagram is discarded and the drop counter of the socket is increased.
+ *
+ * \note Only one thread may read a given socket, the ring is lock-free
+ *       because it has a single producer and a single consumer
+ *
+ * \returns the number of bytes received, or a value <= 0 if there was no data
  */
-static void read_socket(DS_Socket *ptr)
+static int read_socket(DS_Socket *ptr)
 {
    /* Check arguments */
    assert(ptr);
 
-   /* Initialize temporary buffer */
+   /* Get the next free slot of the ring */
+   unsigned int head = ptr->info.ring_head;
+   int full = (head - DS_AtomicLoad(&ptr->info.ring_tail)) >= DS_SOCKET_RING_SIZE;
+   DS_SocketDatagram *slot = &ptr->info.ring[head & (DS_SOCKET_RING_SIZE - 1)];
+
+   /* Write directly into the slot, or into a scratch buffer if the ring is full */
    int read = -1;
-   char data[4096] = { 0 };
+   char scratch[DS_SOCKET_DATAGRAM_SIZE];
+   char *data = full ? scratch : slot->data;
 
    /* Read TCP socket */
    if (ptr->type == DS_SOCKET_TCP)
-      read = recv(ptr->info.sock_in, data, sizeof(data), 0);
+      read = recv(ptr->info.sock_in, data, DS_SOCKET_DATAGRAM_SIZE, 0);
 
    /* Read UDP socket */
    if (ptr->type == DS_SOCKET_UDP)
    {
-      read = udp_recvfrom(ptr->info.sock_in, data, sizeof(data), ptr->address, ptr->info.in_service, 0);
+      read = udp_recvfrom(ptr->info.sock_in, data, DS_SOCKET_DATAGRAM_SIZE, ptr->address, ptr->info.in_service, 0);
    }
 
-   /* We received some data, copy it to socket's buffer */
+   /* We received some data, publish it to the reader (or count the drop) */
    if (read > 0)
    {
-      ptr->info.buffer_size = read;
-      memset(ptr->info.buffer, 0, ptr->info.buffer_size);
+      if (full)
+         DS_AtomicAdd(&ptr->info.dropped, 1);
+
+      else
+      {
+         slot->size = read;
+         slot->timestamp = DS_GetMonotonicTime();
+         DS_AtomicStore(&ptr->info.ring_head, head + 1);
+      }
+   }
+
+   return read;
+}
+
+/**
+ * Reads as many pending datagrams from the given socket as the receive ring
+ * of the socket can hold. On Linux, UDP sockets are read with a single call
+ * to \c recvmmsg(), which writes the datagrams directly into the free slots
+ * of the ring. Other platforms (and TCP sockets) read one datagram at a time.
+ *
+ * If the ring is full, the pending datagrams are discarded and counted as
+ * dropped (like \c read_socket() does), so that \c DS_SocketDropped() reports
+ * the datagrams that the event loop could not keep up with.
+ *
+ * Each datagram is stamped with the time at which the kernel received it
+ * (if supported), or with the time at which it was read.
+ *
+ * \returns the number of datagrams that were received
+ */
+static int read_datagrams(DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+#if defined USE_RECVMMSG
+   if (ptr->type == DS_SOCKET_UDP)
+   {
+      /* Get the number of free slots in the ring */
+      unsigned int head = ptr->info.ring_head;
+      unsigned int used = head - DS_AtomicLoad(&ptr->info.ring_tail);
+      unsigned int space = DS_SOCKET_RING_SIZE - used;
+
+      unsigned int i;
+      struct iovec iov[DS_SOCKET_RING_SIZE];
+      struct mmsghdr msgs[DS_SOCKET_RING_SIZE];
+      char control[DS_SOCKET_RING_SIZE][CONTROL_SIZE];
 
-      int i;
-      for (i = 0; i < read; ++i)
-         ptr->info.buffer[i] = data[i];
+      /* Ring is full, discard the pending datagrams and count the drops */
+      if (used >= DS_SOCKET_RING_SIZE)
+      {
+         char scratch[DS_SOCKET_DATAGRAM_SIZE];
+         memset(msgs, 0, sizeof(msgs));
+         for (i = 0; i < DS_SOCKET_RING_SIZE; ++i)
+         {
+            iov[i].iov_base = scratch;
+            iov[i].iov_len = sizeof(scratch);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+         }
+
+         int dropped = recvmmsg(ptr->info.sock_in, msgs, DS_SOCKET_RING_SIZE, MSG_DONTWAIT, NULL);
+         if (dropped > 0)
+            DS_AtomicAdd(&ptr->info.dropped, (unsigned int)dropped);
+
+         return 0;
+      }
+
+      /* Point each message to a free slot */
+      memset(msgs, 0, space * sizeof(struct mmsghdr));
+      for (i = 0; i < space; ++i)
+      {
+         DS_SocketDatagram *slot = &ptr->info.ring[(head + i) & (DS_SOCKET_RING_SIZE - 1)];
+         iov[i].iov_base = slot->data;
+         iov[i].iov_len = DS_SOCKET_DATAGRAM_SIZE;
+         msgs[i].msg_hdr.msg_iov = &iov[i];
+         msgs[i].msg_hdr.msg_iovlen = 1;
+         msgs[i].msg_hdr.msg_control = control[i];
+         msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+      }
+
+      /* Receive the datagrams */
+      int count = recvmmsg(ptr->info.sock_in, msgs, space, MSG_DONTWAIT, NULL);
+      if (count <= 0)
+         return 0;
+
+      /* Publish the datagrams (and their timestamps) to the reader */
+      uint64_t now = DS_GetMonotonicTime();
+      for (i = 0; i < (unsigned int)count; ++i)
+      {
+         DS_SocketDatagram *slot = &ptr->info.ring[(head + i) & (DS_SOCKET_RING_SIZE - 1)];
+         uint64_t timestamp = get_timestamp(&msgs[i].msg_hdr);
+         slot->size = msgs[i].msg_len;
+         slot->timestamp = (timestamp > 0 && timestamp <= now) ? timestamp : now;
+      }
+
+      DS_AtomicStore(&ptr->info.ring_head, head + count);
+      return count;
    }
+#endif
+
+   return read_socket(ptr) > 0;
+}
+
+/*
+ * Remote addresses are resolved by a single resolver thread, so that a slow
+ * lookup (e.g. an mDNS name while the robot is off the network) never blocks
+ * the event loop or the thread that changed the address. The resolver lock
+ * also guards the cached remote address of every socket, which allows the
+ * address to be swapped while the socket keeps sending and receiving data.
+ */
+static int resolver_running = 0;
+static pthread_t resolver_thread;
+static DS_Socket *resolver_head = NULL;
+static DS_Socket *resolver_current = NULL;
+static pthread_cond_t resolver_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t resolver_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Removes the given socket from the resolver queue and discards the lookup
+ * that may be running for it.
+ *
+ * \note The resolver lock must be held by the caller
+ */
+static void unqueue_resolve(DS_Socket *ptr)
+{
+   /* Discard the running lookup */
+   if (resolver_current == ptr)
+      resolver_current = NULL;
+
+   /* Socket is not queued */
+   if (!ptr->info.resolve_queued)
+      return;
+
+   /* Unlink the socket */
+   DS_Socket **node = &resolver_head;
+   while (*node && *node != ptr)
+      node = (DS_Socket **)&(*node)->info.resolve_next;
+
+   if (*node)
+      *node = (DS_Socket *)ptr->info.resolve_next;
+
+   ptr->info.resolve_next = NULL;
+   ptr->info.resolve_queued = 0;
+}
+
+/**
+ * Asks the resolver thread to look up the remote address of the given socket.
+ * The previously resolved address is kept (and used to send data) until the
+ * new lookup completes.
+ *
+ * \note The resolver lock must be held by the caller
+ */
+static void queue_resolve(DS_Socket *ptr)
+{
+   /* Results of a lookup for the previous address are no longer valid */
+   if (resolver_current == ptr)
+      resolver_current = NULL;
+
+   /* Socket is already queued, the lookup will use the new address */
+   if (ptr->info.resolve_queued)
+      return;
+
+   /* Add the socket to the queue */
+   ptr->info.resolve_queued = 1;
+   ptr->info.resolve_next = resolver_head;
+   resolver_head = ptr;
+   pthread_cond_signal(&resolver_cond);
+}
+
+/**
+ * Resolves the remote addresses of the queued sockets and replaces the
+ * cached address of each socket, so that the send functions do not need to
+ * perform a lookup for every packet.
+ *
+ * This is only done when the socket is opened or when its address changes
+ * (e.g. when the team number is changed or when a watchdog expires).
+ *
+ * The output socket is then connected to the resolved address, so that the
+ * kernel does not need to look up the route for every datagram and reports
+ * the errors received from the remote host (e.g. ICMP port unreachable).
+ */
+static void *resolver_loop(void *data)
+{
+   (void)data;
+
+   pthread_mutex_lock(&resolver_mutex);
+   while (resolver_running)
+   {
+      /* Wait for a request */
+      if (!resolver_head)
+      {
+         pthread_cond_wait(&resolver_cond, &resolver_mutex);
+         continue;
+      }
+
+      /* Take the next socket from the queue */
+      DS_Socket *ptr = resolver_head;
+      resolver_head = (DS_Socket *)ptr->info.resolve_next;
+      ptr->info.resolve_next = NULL;
+      ptr->info.resolve_queued = 0;
+      resolver_current = ptr;
+
+      /* Copy the address, the socket may change (or close) during the lookup */
+      char address[sizeof(ptr->address)];
+      char service[sizeof(ptr->info.out_service)];
+      memcpy(address, ptr->address, sizeof(address));
+      memcpy(service, ptr->info.out_service, sizeof(service));
+
+      /* Resolve the address (same family as the client socket) */
+      int error = -1;
+      socklen_t addr_len = 0;
+      struct sockaddr_storage addr;
+      pthread_mutex_unlock(&resolver_mutex);
+      if (strlen(address) > 0)
+         error = resolve_address(address, service, SOCKY_UDP, SOCKY_IPv4, &addr, &addr_len);
+      pthread_mutex_lock(&resolver_mutex);
+
+      /* Apply the address, unless the request was discarded meanwhile */
+      if (resolver_current == ptr)
+      {
+         if (error == 0)
+         {
+            ptr->info.peer_addr = addr;
+            ptr->info.peer_addr_len = addr_len;
+            ptr->info.peer_connected = 0;
+            if (ptr->info.sock_out > 0)
+               ptr->info.peer_connected = (connect(ptr->info.sock_out, (struct sockaddr *)&addr, addr_len) == 0);
+         }
+
+         ptr->info.peer_valid = (error == 0);
+         resolver_current = NULL;
+      }
+   }
+   pthread_mutex_unlock(&resolver_mutex);
+
+   return NULL;
 }
 
 /**
@@ -107,24 +478,79 @@ static void server_loop(DS_Socket *ptr)
 #endif
 
       rc = select(fd, &set, NULL, NULL, &tv);
-      if (rc > 0 && FD_ISSET(ptr->info.sock_in, &set))
-         read_socket(ptr);
+      if (rc > 0 && FD_ISSET(ptr->info.sock_in, &set) && read_datagrams(ptr) > 0)
+         notify_waiters();
    }
 }
 
+/*
+ * Network transport functions
+ */
+static int network_open(DS_Socket *ptr);
+static void network_close(DS_Socket *ptr);
+static int network_fd(const DS_Socket *ptr);
+static int network_send(const DS_Socket *ptr, const void *data, const size_t len);
+static void network_set_address(DS_Socket *ptr, const char *address);
+
+/*
+ * Transport used by sockets that do not set one
+ */
+static const DS_Transport network_transport = {
+   "network", &network_open, &network_close, &network_fd, &read_datagrams, &network_send, &network_set_address,
+};
+
 /**
- * Initializes the given socket structure
+ * Returns the transport of the given socket
+ */
+static const DS_Transport *transport(const DS_Socket *ptr)
+{
+   return ptr->transport ? ptr->transport : &network_transport;
+}
+
+/**
+ * Registers the descriptor of the given socket structure (e.g. its input
+ * socket) in the epoll set of the module.
  *
- * \param data raw pointer to a \c DS_Socket structure
+ * \returns \c 1 on success, \c 0 if the socket must be read by its own
+ *          server loop (e.g. epoll is not available)
  */
-static void *create_socket(void *data)
+static int register_socket(DS_Socket *ptr)
 {
    /* Check arguments */
-   assert(data);
-   DS_Socket *ptr = (DS_Socket *)data;
+   assert(ptr);
+
+#if defined USE_EPOLL
+   int fd = transport(ptr)->fd(ptr);
+   if (poll_fd < 0 || fd <= 0)
+      return 0;
+
+   /* Reads are done by the event loop, they must never block it */
+   set_socket_block(fd, 0);
 
-   /* Ensure that buffer and service strings are set to 0 */
-   memset(ptr->info.buffer, 0, sizeof(ptr->info.buffer));
+   /* Add socket to the epoll set */
+   struct epoll_event event;
+   memset(&event, 0, sizeof(event));
+   event.events = EPOLLIN;
+   event.data.ptr = ptr;
+
+   return epoll_ctl(poll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * Creates the file descriptors of the given socket structure and requests
+ * the lookup of its remote address
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ */
+static void open_socket(DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   /* Ensure that service strings are set to 0 */
    memset(ptr->info.in_service, 0, sizeof(ptr->info.in_service));
    memset(ptr->info.out_service, 0, sizeof(ptr->info.out_service));
 
@@ -145,19 +571,61 @@ static void *create_socket(void *data)
    {
       ptr->info.sock_out = create_client_udp(SOCKY_IPv4, 0);
       ptr->info.sock_in = create_server_udp(ptr->info.in_service, SOCKY_IPv4, 0);
+
+      pthread_mutex_lock(&resolver_mutex);
+      queue_resolve(ptr);
+      pthread_mutex_unlock(&resolver_mutex);
    }
 
+   /* Let the kernel timestamp the datagrams */
+#if defined USE_TIMESTAMPING
+   if (ptr->type == DS_SOCKET_UDP)
+      enable_timestamping(ptr);
+#endif
+
    /* Update initialized states */
    ptr->info.server_init = (ptr->info.sock_in > 0);
    ptr->info.client_init = (ptr->info.sock_out > 0);
+}
 
-   /* Start server loop */
-   server_loop(ptr);
+/**
+ * Initializes the given socket structure and runs its server loop (if the
+ * event loop cannot read the socket)
+ *
+ * \param data raw pointer to a \c DS_Socket structure
+ */
+static void *create_socket(void *data)
+{
+   /* Check arguments */
+   assert(data);
+   DS_Socket *ptr = (DS_Socket *)data;
+
+   /* Open the socket */
+   open_socket(ptr);
+
+   /* Start server loop (only if the event loop cannot read the socket) */
+   if (!register_socket(ptr))
+      server_loop(ptr);
 
    /* Exit */
    return NULL;
 }
 
+/**
+ * Waits for the thread that initializes the given socket to finish, so that
+ * the socket is not modified by two threads at once (or after it has been
+ * deleted). If the thread runs the server loop, it exits once the
+ * \c server_init flag is cleared.
+ */
+static void join_socket_thread(DS_Socket *ptr)
+{
+   if (ptr->info.thread_valid)
+   {
+      pthread_join(ptr->info.thread, NULL);
+      ptr->info.thread_valid = 0;
+   }
+}
+
 /**
  * Returns an empty socket for safe initialization
  */
@@ -176,15 +644,27 @@ DS_Socket *DS_SocketEmpty(void)
    /* Fill socket info structure */
    socket->info.sock_in = 0;
    socket->info.sock_out = 0;
-   socket->info.buffer_size = 0;
+   socket->info.dropped = 0;
+   socket->info.ring_head = 0;
+   socket->info.ring_tail = 0;
    socket->info.server_init = 0;
    socket->info.client_init = 0;
+   socket->info.peer_valid = 0;
+   socket->info.peer_addr_len = 0;
+   socket->info.resolve_queued = 0;
+   socket->info.resolve_next = NULL;
+   socket->info.peer_connected = 0;
+   socket->info.unreachable = 0;
+   socket->info.timestamping = 0;
+   socket->info.tx_pending = 0;
+   socket->info.transport_data = NULL;
+   socket->transport = NULL;
 
    /* Fill strings with 0 */
    memset(socket->address, 0, sizeof(socket->address));
-   memset(socket->info.buffer, 0, sizeof(socket->info.buffer));
    memset(socket->info.in_service, 0, sizeof(socket->info.in_service));
    memset(socket->info.out_service, 0, sizeof(socket->info.out_service));
+   memset(&socket->info.peer_addr, 0, sizeof(socket->info.peer_addr));
 
    /* Return the socket data */
    return socket;
@@ -196,6 +676,15 @@ DS_Socket *DS_SocketEmpty(void)
 void Sockets_Init(void)
 {
    sockets_init(1);
+
+#if defined USE_EPOLL
+   poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+
+   /* Start the resolver thread */
+   resolver_running = 1;
+   if (pthread_create(&resolver_thread, NULL, &resolver_loop, NULL) != 0)
+      resolver_running = 0;
 }
 
 /**
@@ -203,27 +692,115 @@ void Sockets_Init(void)
  */
 void Sockets_Close(void)
 {
+   /* Stop the resolver thread (waits for the running lookup) */
+   pthread_mutex_lock(&resolver_mutex);
+   int running = resolver_running;
+   resolver_running = 0;
+   pthread_cond_signal(&resolver_cond);
+   pthread_mutex_unlock(&resolver_mutex);
+   if (running)
+      pthread_join(resolver_thread, NULL);
+
+#if defined USE_EPOLL
+   if (poll_fd >= 0)
+      close(poll_fd);
+
+   poll_fd = -1;
+#endif
+
    sockets_exit();
 }
 
 /**
- * Initializes and configures the given socket
+ * Returns a file descriptor that becomes readable when any of the opened
+ * sockets has received data, or \c -1 if the current platform does not
+ * support it (in that case, the sockets are read by their own threads).
  *
- * \note The socket will be initialzed in another thread to avoid blocking
- *       the main thread of the application
+ * This descriptor can be added to an event loop (e.g. with \c poll() or
+ * \c epoll), after which \c Sockets_Dispatch() should be called.
  */
-void DS_SocketOpen(DS_Socket *ptr)
+int Sockets_PollFd(void)
 {
-   /* Check arguments */
-   assert(ptr);
+#if defined USE_EPOLL
+   return poll_fd;
+#else
+   return -1;
+#endif
+}
 
-   /* Socket is disabled */
-   if (ptr->disabled)
-      return;
+/**
+ * Reads the pending datagrams of every socket that has received data, the
+ * data can then be obtained with \c DS_SocketRead(). If \a func is not
+ * \c NULL, it is called for every socket that has been read (e.g. to find
+ * the context that must process the data). This function never blocks.
+ *
+ * \returns the number of sockets that have been read
+ */
+int Sockets_Dispatch(void (*func)(DS_Socket *ptr))
+{
+#if defined USE_EPOLL
+   if (poll_fd < 0)
+      return 0;
+
+   /* Get the sockets with pending data */
+   struct epoll_event events[8];
+   int count = epoll_wait(poll_fd, events, 8, 0);
+
+   /* Copy the received data to the socket buffers */
+   int i;
+   for (i = 0; i < count; ++i)
+   {
+      DS_Socket *ptr = (DS_Socket *)events[i].data.ptr;
+      if (!ptr)
+         continue;
+
+      /* Move the pending datagrams to the socket's ring */
+      if (ptr->info.server_init)
+      {
+         transport(ptr)->recv(ptr);
+         if (func)
+            func(ptr);
+      }
+   }
+
+   /* Wake up the threads that wait for data */
+   if (count > 0)
+      notify_waiters();
+
+   return DS_Max(count, 0);
+#else
+   (void)func;
+   return 0;
+#endif
+}
+
+/**
+ * Opens the network sockets of the given socket structure.
+ *
+ * UDP sockets read by the event loop are created directly (binding a UDP
+ * socket does not block), other sockets are initialized in another thread
+ * to avoid blocking the main thread of the application.
+ *
+ * \returns \c 1 if the socket can be registered in the event loop now,
+ *          \c 0 if the socket is being initialized by another thread
+ */
+static int network_open(DS_Socket *ptr)
+{
+   /* Wait for the previous initialization thread (if any) */
+   join_socket_thread(ptr);
+
+   /* Open UDP socket in this thread, the remote address is resolved later */
+#if defined USE_EPOLL
+   if (ptr->type == DS_SOCKET_UDP && poll_fd >= 0)
+   {
+      open_socket(ptr);
+      return 1;
+   }
+#endif
 
    /* Initialize the socket in another thread */
-   pthread_t thread;
-   int error = pthread_create(&thread, NULL, &create_socket, (void *)ptr);
+   int error = pthread_create(&ptr->info.thread, NULL, &create_socket, (void *)ptr);
+   ptr->info.thread_valid = (error == 0);
 
    /* Warn the user when the socket cannot start */
    if (error)
@@ -237,22 +814,29 @@ void DS_SocketOpen(DS_Socket *ptr)
 
    /* Quit if socket cannot start */
    assert(!error);
+   return 0;
 }
 
 /**
- * Closes the socket file descriptors of the given socket structure
- * and resets the structure's information.
- *
- * \param ptr pointer to the \c DS_Socket to close
+ * Closes the network sockets of the given socket structure
  */
-void DS_SocketClose(DS_Socket *ptr)
+static void network_close(DS_Socket *ptr)
 {
-   /* Check arguments */
-   assert(ptr);
+   /* Wait until the socket is no longer being created (or read) */
+   join_socket_thread(ptr);
 
-   /* Reset socket properties */
-   ptr->info.server_init = 0;
-   ptr->info.client_init = 0;
+   /* Cancel any pending lookup */
+   pthread_mutex_lock(&resolver_mutex);
+   unqueue_resolve(ptr);
+   ptr->info.peer_valid = 0;
+   ptr->info.peer_connected = 0;
+   pthread_mutex_unlock(&resolver_mutex);
+
+   /* Remove the input socket from the epoll set */
+#if defined USE_EPOLL
+   if (poll_fd >= 0 && ptr->info.sock_in > 0)
+      epoll_ctl(poll_fd, EPOLL_CTL_DEL, ptr->info.sock_in, NULL);
+#endif
 
    /* Close sockets */
 #if defined(__ANDROID__)
@@ -266,16 +850,66 @@ void DS_SocketClose(DS_Socket *ptr)
    /* Reset socket information structure */
    ptr->info.sock_in = -1;
    ptr->info.sock_out = -1;
-   ptr->info.buffer_size = 0;
+   ptr->info.tx_pending = 0;
+   ptr->info.timestamping = 0;
 
    /* Reset strings */
-   memset(ptr->info.buffer, 0, sizeof(ptr->info.buffer));
    memset(ptr->info.in_service, 0, sizeof(ptr->info.in_service));
    memset(ptr->info.out_service, 0, sizeof(ptr->info.out_service));
 }
 
 /**
- * Returns any data received by the given socket
+ * Returns the input socket, which is polled by the event loop
+ */
+static int network_fd(const DS_Socket *ptr)
+{
+   return ptr->info.sock_in;
+}
+
+/**
+ * Initializes and configures the given socket with its transport
+ */
+void DS_SocketOpen(DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   /* Socket is disabled */
+   if (ptr->disabled)
+      return;
+
+   /* Open the socket and let the event loop read it */
+   if (transport(ptr)->open(ptr))
+      register_socket(ptr);
+}
+
+/**
+ * Closes the given socket structure and resets the structure's information.
+ *
+ * \param ptr pointer to the \c DS_Socket to close
+ */
+void DS_SocketClose(DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   /* Reset socket properties */
+   ptr->info.server_init = 0;
+   ptr->info.client_init = 0;
+
+   /* Release the resources of the transport */
+   transport(ptr)->close(ptr);
+   DS_AtomicStore(&ptr->info.unreachable, 0);
+
+   /* Discard any unread datagrams */
+   DS_AtomicStore(&ptr->info.ring_tail, 0);
+   DS_AtomicStore(&ptr->info.ring_head, 0);
+}
+
+/**
+ * Returns the oldest datagram received by the given socket and removes it
+ * from the socket's receive queue. Call this function until it returns an
+ * empty string to read every pending datagram (in the order they arrived).
  *
  * \param ptr pointer to a \c DS_Socket structure
  */
@@ -288,25 +922,254 @@ DS_String DS_SocketRead(DS_Socket *ptr)
    if ((ptr->info.server_init == 0) || (ptr->disabled == 1))
       return DS_StrNewLen(0);
 
-   /* Copy the current buffer and clear it */
-   if (ptr->info.buffer_size > 0)
+   /* No datagrams are pending */
+   unsigned int tail = ptr->info.ring_tail;
+   if (DS_AtomicLoad(&ptr->info.ring_head) == tail)
+      return DS_StrNewLen(0);
+
+   /* Copy the datagram to a string */
+   DS_SocketDatagram *slot = &ptr->info.ring[tail & (DS_SOCKET_RING_SIZE - 1)];
+   DS_String buffer = DS_StrNewLen(slot->size);
+   memcpy(buffer.buf, slot->data, slot->size);
+
+   /* Release the slot to the reader thread */
+   DS_AtomicStore(&ptr->info.ring_tail, tail + 1);
+
+   return buffer;
+}
+
+/**
+ * Points the given \a span to the oldest datagram received by the given
+ * socket, without copying it. The datagram stays in the socket's receive
+ * queue (and the \a span remains valid) until \c DS_SocketRelease() is
+ * called.
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ * \param span the view to update
+ *
+ * \returns \c 1 if a datagram is pending, \c 0 otherwise
+ */
+int DS_SocketPeek(const DS_Socket *ptr, DS_ByteSpan *span)
+{
+   /* Check arguments */
+   assert(ptr);
+   assert(span);
+
+   /* Clear the span */
+   *span = DS_SpanNew(NULL, 0);
+
+   /* Socket is disabled or uninitialized */
+   if ((ptr->info.server_init == 0) || (ptr->disabled == 1))
+      return 0;
+
+   /* No datagrams are pending */
+   unsigned int tail = ptr->info.ring_tail;
+   if (DS_AtomicLoad(&ptr->info.ring_head) == tail)
+      return 0;
+
+   /* Point the span to the datagram */
+   const DS_SocketDatagram *slot = &ptr->info.ring[tail & (DS_SOCKET_RING_SIZE - 1)];
+   *span = DS_SpanNew(slot->data, slot->size);
+   return 1;
+}
+
+/**
+ * Waits until the given socket has a pending datagram (or until \a timeout
+ * milliseconds have passed), the datagram can then be obtained with
+ * \c DS_SocketPeek() or \c DS_SocketRead().
+ *
+ * A negative \a timeout waits indefinitely, a \a timeout of \c 0 only checks
+ * if a datagram is pending.
+ *
+ * \note The sockets are read by the LibDS event loop, so \c DS_Init() must
+ *       have been called
+ *
+ * \returns \c 1 if a datagram is pending, \c 0 if the timeout expired
+ */
+int DS_SocketWait(const DS_Socket *ptr, const int timeout)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   /* Data is already available (or we shall not wait) */
+   if (DS_SocketPending(ptr) > 0)
+      return 1;
+   if (timeout == 0)
+      return 0;
+
+   /* Calculate the absolute deadline */
+   struct timespec deadline;
+#if defined _WIN32
+   timespec_get(&deadline, TIME_UTC);
+#else
+   clock_gettime(CLOCK_REALTIME, &deadline);
+#endif
+   deadline.tv_sec += timeout / 1000;
+   deadline.tv_nsec += (long)(timeout % 1000) * 1000000L;
+   if (deadline.tv_nsec >= 1000000000L)
    {
-      DS_String buffer = DS_StrNewLen(ptr->info.buffer_size);
+      deadline.tv_sec += 1;
+      deadline.tv_nsec -= 1000000000L;
+   }
+
+   /* Register as a waiter, so that the readers signal the condition */
+   int error = 0;
+   int pending = 0;
+   DS_AtomicAdd(&waiters, 1);
+   pthread_mutex_lock(&wait_lock);
+   while (!(pending = (DS_SocketPending(ptr) > 0)) && !error)
+   {
+      if (timeout < 0)
+         error = pthread_cond_wait(&wait_cond, &wait_lock);
+      else
+         error = pthread_cond_timedwait(&wait_cond, &wait_lock, &deadline);
+   }
+   pthread_mutex_unlock(&wait_lock);
+   DS_AtomicAdd(&waiters, (unsigned int)-1);
+
+   return pending;
+}
+
+/**
+ * Returns the time at which the datagram obtained with \c DS_SocketPeek()
+ * was received (in the clock used by \c DS_GetMonotonicTime()). On Linux,
+ * this is the time at which the kernel received the datagram, so it does not
+ * include the time that the datagram waited for the event loop.
+ *
+ * \returns the timestamp of the datagram, or \c 0 if no datagram is pending
+ */
+uint64_t DS_SocketTimestamp(const DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   /* No datagrams are pending */
+   unsigned int tail = ptr->info.ring_tail;
+   if (DS_AtomicLoad(&ptr->info.ring_head) == tail)
+      return 0;
+
+   return ptr->info.ring[tail & (DS_SOCKET_RING_SIZE - 1)].timestamp;
+}
+
+/**
+ * Removes the datagram obtained with \c DS_SocketPeek() from the receive
+ * queue of the given socket, so that its slot can be re-used
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ */
+void DS_SocketRelease(DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   /* Release the slot to the reader thread */
+   unsigned int tail = ptr->info.ring_tail;
+   if (DS_AtomicLoad(&ptr->info.ring_head) != tail)
+      DS_AtomicStore(&ptr->info.ring_tail, tail + 1);
+}
+
+/**
+ * Returns the number of datagrams that have been received by the given
+ * socket and that have not been read with \c DS_SocketRead()
+ */
+int DS_SocketPending(const DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   return (int)(DS_AtomicLoad(&ptr->info.ring_head) - DS_AtomicLoad(&ptr->info.ring_tail));
+}
+
+/**
+ * Returns the number of datagrams that were discarded because the receive
+ * queue of the given socket was full
+ */
+unsigned int DS_SocketDropped(const DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   return DS_AtomicLoad(&ptr->info.dropped);
+}
+
+/**
+ * Returns \c 1 if the remote host of the given socket reported that it
+ * cannot be reached (e.g. the robot is up, but nothing listens on the port)
+ * since the last call to this function
+ *
+ * \note This is only detected once the socket is connected to its remote
+ *       address (see \c resolver_loop())
+ */
+int DS_SocketUnreachable(DS_Socket *ptr)
+{
+   /* Check arguments */
+   assert(ptr);
+
+   if (!DS_AtomicLoad(&ptr->info.unreachable))
+      return 0;
+
+   DS_AtomicStore(&ptr->info.unreachable, 0);
+   return 1;
+}
+
+/**
+ * Obtains the time at which the kernel sent the oldest datagram whose send
+ * time has not been read yet. Timestamps are reported in the same order in
+ * which the datagrams were sent.
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ * \param time set to the send time (see \c DS_GetMonotonicTime())
+ *
+ * \returns \c 1 if a timestamp was read, \c 0 if none is available (or if
+ *          the kernel does not support timestamping)
+ */
+int DS_SocketSendTimestamp(DS_Socket *ptr, uint64_t *time)
+{
+   /* Check arguments */
+   assert(ptr);
+   assert(time);
 
-      /* Copy buffer to string */
-      int i;
-      for (i = 0; i < (int)ptr->info.buffer_size; ++i)
-         DS_StrSetChar(&buffer, i, ptr->info.buffer[i]);
+#if defined USE_TIMESTAMPING
+   /* Nothing to read */
+   if (!ptr->info.timestamping || ptr->info.tx_pending == 0 || ptr->info.sock_out <= 0)
+      return 0;
 
-      /* Clear buffer info */
-      memset(ptr->info.buffer, 0, ptr->info.buffer_size);
-      ptr->info.buffer_size = 0;
+   /* Read the error queue until we get a timestamp */
+   char control[CONTROL_SIZE];
+   struct msghdr msg;
+   while (1)
+   {
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (recvmsg(ptr->info.sock_out, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+         return 0;
 
-      /* Return copied buffer */
-      return buffer;
+      *time = get_timestamp(&msg);
+      if (*time > 0)
+      {
+         --ptr->info.tx_pending;
+         return 1;
+      }
    }
+#else
+   (void)time;
+   return 0;
+#endif
+}
 
-   return DS_StrNewLen(0);
+/**
+ * Returns \c 1 if the last send operation failed because of an error that
+ * was reported by the remote host (or by the network)
+ */
+static int send_unreachable(void)
+{
+#if defined _WIN32
+   int error = WSAGetLastError();
+   return error == WSAECONNRESET || error == WSAEHOSTUNREACH || error == WSAENETUNREACH;
+#else
+   return errno == ECONNREFUSED || errno == EHOSTUNREACH || errno == ENETUNREACH;
+#endif
 }
 
 /**
@@ -323,36 +1186,122 @@ int DS_SocketSend(const DS_Socket *ptr, const DS_String *data)
    assert(ptr);
    assert(data);
 
+   /* Data is empty */
+   if (DS_StrEmpty(data))
+      return DS_SocketSendBytes(ptr, NULL, 0);
+
+   return DS_SocketSendBytes(ptr, data->buf, data->len);
+}
+
+/**
+ * Sends \a len bytes from the given \a data buffer using the given socket,
+ * this function does not allocate any memory.
+ *
+ * \param ptr pointer to the socket to use to send the given \a data
+ * \param data the data buffer to send
+ * \param len the number of bytes to send
+ *
+ * \returns number of bytes written on success, -1 on failure
+ */
+int DS_SocketSendBytes(const DS_Socket *ptr, const void *data, const size_t len)
+{
+   /* Check arguments */
+   assert(ptr);
+
    /* Socket is disabled or uninitialized */
    if ((ptr->info.client_init == 0) || ptr->disabled)
       return -1;
 
    /* Data is empty */
-   if (DS_StrEmpty(data))
+   if (!data || len == 0)
       return 0;
 
+   return transport(ptr)->send(ptr, data, len);
+}
+
+/**
+ * Sends a datagram over the network, using the address obtained by the
+ * resolver thread
+ *
+ * \returns number of bytes written on success, -1 on failure
+ */
+static int network_send(const DS_Socket *ptr, const void *data, const size_t len)
+{
    /* Initialize variables*/
    int bytes_written = 0;
-   int len = DS_StrLen(data);
-   char *bytes = DS_StrToChar(data);
+   const char *bytes = (const char *)data;
 
    /* Send data using TCP */
    if (ptr->type == DS_SOCKET_TCP)
-      bytes_written = send(ptr->info.sock_out, bytes, len, 0);
+      bytes_written = send(ptr->info.sock_out, bytes, (int)len, 0);
 
-   /* Send data using UDP */
+   /* Send data using UDP (only if the remote address is known) */
    else if (ptr->type == DS_SOCKET_UDP)
    {
-      bytes_written = udp_sendto(ptr->info.sock_out, bytes, len, ptr->address, ptr->info.out_service, 0);
-   }
+      /* Copy the address, the resolver may replace it at any time */
+      int valid, connected;
+      socklen_t addr_len;
+      struct sockaddr_storage addr;
+      pthread_mutex_lock(&resolver_mutex);
+      valid = ptr->info.peer_valid;
+      connected = ptr->info.peer_connected;
+      addr_len = ptr->info.peer_addr_len;
+      if (valid && !connected)
+         memcpy(&addr, &ptr->info.peer_addr, addr_len);
+      pthread_mutex_unlock(&resolver_mutex);
+
+      /* Socket is connected to the remote address, no need to specify it */
+      if (valid && connected)
+         bytes_written = send(ptr->info.sock_out, bytes, (int)len, 0);
+      else if (valid)
+         bytes_written = udp_sendto_addr(ptr->info.sock_out, bytes, (int)len, (const struct sockaddr *)&addr, addr_len, 0);
+      else
+         bytes_written = -1;
 
-   /* Delete temp. buffer */
-   DS_FREE(bytes);
+      /* Let the protocol module know that the remote host is unreachable */
+      if (valid && bytes_written < 0 && send_unreachable())
+         DS_AtomicStore((unsigned int *)&ptr->info.unreachable, 1);
+
+      /* The kernel will report the send time of the datagram */
+      if (bytes_written > 0 && ptr->info.timestamping)
+         ++((DS_Socket *)ptr)->info.tx_pending;
+   }
 
    /* Return error code */
    return bytes_written;
 }
 
+/**
+ * Changes the remote address of a network socket.
+ *
+ * If the socket is open, it keeps its file descriptors (and the data that
+ * it has already received) and only its remote address is looked up again,
+ * otherwise the socket is re-opened.
+ */
+static void network_set_address(DS_Socket *ptr, const char *address)
+{
+   /* Socket is not working, re-assign the address and re-open the socket */
+   if (ptr->type != DS_SOCKET_UDP || !ptr->info.server_init || !ptr->info.client_init)
+   {
+      DS_SocketClose(ptr);
+      memset(ptr->address, 0, sizeof(ptr->address));
+      strncpy(ptr->address, address, sizeof(ptr->address) - 1);
+      DS_SocketOpen(ptr);
+      return;
+   }
+
+   /* Replace the address and look it up again */
+   pthread_mutex_lock(&resolver_mutex);
+   if (strncmp(ptr->address, address, sizeof(ptr->address)) != 0)
+   {
+      ptr->info.peer_valid = 0;
+      memset(ptr->address, 0, sizeof(ptr->address));
+      strncpy(ptr->address, address, sizeof(ptr->address) - 1);
+   }
+   queue_resolve(ptr);
+   pthread_mutex_unlock(&resolver_mutex);
+}
+
 /**
  * Changes the \a address of the given socket structre
  *
@@ -368,11 +1317,55 @@ void DS_SocketChangeAddress(DS_Socket *ptr, const char *address)
    if (!address)
       return;
 
-   /* Re-assign the address */
-   memset(ptr->address, 0, sizeof(ptr->address));
-   memcpy(ptr->address, address, strlen(address));
+   transport(ptr)->set_address(ptr, address);
+}
+
+/**
+ * Returns the transport that sends and receives data over the network (UDP
+ * or TCP sockets), which is used by sockets that do not set a transport
+ */
+const DS_Transport *DS_NetworkTransport(void)
+{
+   return &network_transport;
+}
+
+/**
+ * Appends a datagram to the receive ring of the given socket. This is used
+ * by transports that do not read their data from the network, the calling
+ * thread must be the only one that pushes data to the socket.
+ *
+ * \param ptr pointer to a \c DS_Socket structure
+ * \param data the datagram
+ * \param len the length of the datagram
+ * \param timestamp the time at which the datagram was received
+ *
+ * \returns the number of datagrams that were pending before this one, or
+ *          \c -1 if the datagram was discarded (e.g. the ring is full)
+ */
+int DS_SocketPush(DS_Socket *ptr, const void *data, const size_t len, const uint64_t timestamp)
+{
+   /* Check arguments */
+   assert(ptr);
+   assert(data || len == 0);
+
+   /* Ring is full (or datagram is too big) */
+   unsigned int head = ptr->info.ring_head;
+   unsigned int pending = head - DS_AtomicLoad(&ptr->info.ring_tail);
+   if (pending >= DS_SOCKET_RING_SIZE || len > DS_SOCKET_DATAGRAM_SIZE)
+   {
+      DS_AtomicAdd(&ptr->info.dropped, 1);
+      return -1;
+   }
+
+   /* Copy the datagram and publish it to the reader */
+   DS_SocketDatagram *slot = &ptr->info.ring[head & (DS_SOCKET_RING_SIZE - 1)];
+   if (len > 0)
+      memcpy(slot->data, data, len);
+
+   slot->size = len;
+   slot->timestamp = timestamp;
+   DS_AtomicStore(&ptr->info.ring_head, head + 1);
+   notify_waiters();
 
-   /* Re-open the socket */
-   DS_SocketClose(ptr);
-   DS_SocketOpen(ptr);
+   return (int)pending;
 }
@@ -37,6 +37,43 @@
 #   endif
 #endif
 
+/*
+ * Minimum number of bytes allocated when a string buffer grows
+ */
+#define MIN_CAPACITY 16
+
+/**
+ * Ensures that the buffer of the given \a string can hold at least \a size
+ * bytes. The buffer grows geometrically (doubling its capacity), so that
+ * appending data byte by byte only causes a logarithmic number of
+ * re-allocations.
+ *
+ * \note The length of the string is not modified
+ */
+static int grow(DS_String *string, size_t size)
+{
+   /* Buffer is already large enough */
+   if (string->buf && size <= string->capacity)
+      return DS_STR_SUCCESS;
+
+   /* Calculate new capacity */
+   size_t capacity = string->capacity * 2;
+   if (capacity < size)
+      capacity = size;
+   if (capacity < MIN_CAPACITY)
+      capacity = MIN_CAPACITY;
+
+   /* Re-allocate the buffer */
+   char *buf = (char *)realloc(string->buf, capacity);
+   if (!buf)
+      return DS_STR_FAILURE;
+
+   /* Update string information */
+   string->buf = buf;
+   string->capacity = capacity;
+   return DS_STR_SUCCESS;
+}
+
 /**
  * Returns the length of the given \a string
  * \warning The program will quit if \a string is \c NULL
@@ -108,6 +145,7 @@ int DS_StrRmBuf(DS_String *string)
    if (string->buf != NULL)
    {
       string->len = 0;
+      string->capacity = 0;
       free(string->buf);
       string->buf = NULL;
       return DS_STR_SUCCESS;
@@ -118,7 +156,8 @@ int DS_StrRmBuf(DS_String *string)
 }
 
 /**
- * Resizes the given \a string to the given \a size
+ * Resizes the given \a string to the given \a size, the new bytes (if any)
+ * are set to \c 0
  *
  * \param string the original string structure
  * \param size the new size to apply to the string
@@ -132,33 +171,45 @@ int DS_StrResize(DS_String *string, size_t size)
    assert(string);
    assert(string->buf);
 
-   /* Initialize variables */
-   int i;
-   int oldSize = (int)string->len;
+   /* Make room for the new size */
+   if (!grow(string, size))
+      return DS_STR_FAILURE;
 
-   /* Copy old buffer */
-   char *copy = calloc(oldSize, sizeof(char));
-   for (i = 0; i < oldSize; ++i)
-      copy[i] = string->buf[i];
+   /* Clear the new bytes */
+   if (size > string->len)
+      memset(string->buf + string->len, 0, size - string->len);
 
-   /* Re-initialize the buffer */
-   free(string->buf);
-   string->buf = calloc(size, sizeof(char));
+   string->len = size;
+   return DS_STR_SUCCESS;
+}
 
-   /* Copy old buffer into start of new buffer */
-   if (string->buf)
-   {
-      string->len = size;
-      for (i = 0; i < oldSize; ++i)
-         string->buf[i] = copy[i];
+/**
+ * Pre-allocates enough memory for the given \a string to hold \a capacity
+ * bytes, so that subsequent appends do not need to re-allocate its buffer.
+ * The length and contents of the string are not modified.
+ *
+ * \param string the string structure
+ * \param capacity the number of bytes to reserve
+ *
+ * \warning The program will quit if \a string is \c NULL
+ */
+int DS_StrReserve(DS_String *string, size_t capacity)
+{
+   /* Check arguments */
+   assert(string);
 
-      free(copy);
+   /* Capacity is already large enough */
+   if (string->buf && capacity <= string->capacity)
       return DS_STR_SUCCESS;
-   }
 
-   /* Could not initialize the buffer, restore data */
-   string->buf = copy;
-   return DS_STR_FAILURE;
+   /* Allocate exactly the requested size */
+   char *buf = (char *)realloc(string->buf, capacity > 0 ? capacity : 1);
+   if (!buf)
+      return DS_STR_FAILURE;
+
+   string->buf = buf;
+   string->capacity = capacity > 0 ? capacity : 1;
+   return DS_STR_SUCCESS;
 }
 
 /**
@@ -176,10 +227,43 @@ int DS_StrAppend(DS_String *string, const uint8_t byte)
    assert(string);
    assert(string->buf);
 
-   /* Resize string and add extra character */
-   if (DS_StrResize(string, string->len + 1))
+   /* Make room for the extra character */
+   if (grow(string, string->len + 1))
+   {
+      string->buf[string->len] = byte;
+      ++string->len;
+      return DS_STR_SUCCESS;
+   }
+
+   /* String cannot be resized */
+   return DS_STR_FAILURE;
+}
+
+/**
+ * Appends \a len bytes from the given \a bytes buffer to the end of the
+ * given \a string
+ *
+ * \param string the original string
+ * \param bytes the data to append at the end of the string
+ * \param len the number of bytes to append
+ *
+ * \warning The program will quit if \a string is \c NULL
+ */
+int DS_StrAppendBytes(DS_String *string, const void *bytes, size_t len)
+{
+   /* Check arguments */
+   assert(string);
+   assert(bytes || len == 0);
+
+   /* Nothing to append */
+   if (len == 0)
+      return DS_STR_SUCCESS;
+
+   /* Make room for the data and copy it */
+   if (grow(string, string->len + len))
    {
-      string->buf[string->len - 1] = byte;
+      memcpy(string->buf + string->len, bytes, len);
+      string->len += len;
       return DS_STR_SUCCESS;
    }
 
@@ -203,22 +287,8 @@ int DS_StrJoin(DS_String *first, const DS_String *second)
    assert(second->buf);
    assert(first->buf);
 
-   /* Get length of initial string */
-   int append_len = (int)second->len;
-   int original_len = (int)first->len;
-
-   /* Resize the string and append the other string */
-   if (DS_StrResize(first, original_len + append_len))
-   {
-      int i;
-      for (i = 0; i < append_len; ++i)
-         first->buf[original_len + i] = second->buf[i];
-
-      return DS_STR_SUCCESS;
-   }
-
-   /* String cannot be resized */
-   return DS_STR_FAILURE;
+   /* Append the other string */
+   return DS_StrAppendBytes(first, second->buf, second->len);
 }
 
 /**
@@ -232,15 +302,8 @@ int DS_StrJoinCStr(DS_String *string, const char *cstring)
    assert(string);
    assert(cstring);
 
-   /* Append each character to the string */
-   int i;
-   int len = (int)strlen(cstring);
-   for (i = 0; i < len; ++i)
-      if (!DS_StrAppend(string, cstring[i]))
-         return DS_STR_FAILURE;
-
-   /* Tell everyone how smart this function is */
-   return DS_STR_SUCCESS;
+   /* Append the characters to the string */
+   return DS_StrAppendBytes(string, cstring, strlen(cstring));
 }
 
 /**
@@ -355,6 +418,7 @@ DS_String DS_StrNewLen(const size_t length)
 {
    DS_String string;
    string.len = length;
+   string.capacity = length;
    string.buf = (char *)calloc(string.len, sizeof(char));
    return string;
 }
@@ -406,6 +470,7 @@ DS_String DS_StrFormat(const char *format, ...)
 
    /* Initialize string */
    DS_String string = DS_StrNewLen(init_len);
+   DS_StrReserve(&string, strlen(format) + MIN_CAPACITY);
 
    /* Initialize argument list */
    va_list args;
@@ -438,11 +503,8 @@ DS_String DS_StrFormat(const char *format, ...)
             else if (next == 'f')
                SPRINTF_S(str, sizeof(str), "%.2f", (double)va_arg(args, double));
 
-            /* Append every character to the string */
-            int i = 0;
-            int len = (int)strlen(str);
-            for (i = 0; i < len; ++i)
-               DS_StrAppend(&string, str[i]);
+            /* Append the number to the string */
+            DS_StrAppendBytes(&string, str, strlen(str));
          }
 
          /* Handle characters */
@@ -453,12 +515,7 @@ DS_String DS_StrFormat(const char *format, ...)
          else if (next == 's')
          {
             char *str = (char *)va_arg(args, char *);
-            int len = (int)strlen(str);
-
-            /* Append every character to the string */
-            int i = 0;
-            for (i = 0; i < len; ++i)
-               DS_StrAppend(&string, str[i]);
+            DS_StrAppendBytes(&string, str, strlen(str));
          }
 
          /* Handle everything else */
@@ -22,11 +22,12 @@
  */
 
 #include "DS_Utils.h"
-#include "DS_Array.h"
 #include "DS_Timer.h"
 
+#include <time.h>
 #include <stdio.h>
 #include <assert.h>
+#include <stdlib.h>
 
 #if defined _WIN32
 #   include <windows.h>
@@ -34,62 +35,326 @@
 #   include <unistd.h>
 #endif
 
-static DS_Array timers;
+/*
+ * Condition variables cannot be bound to the monotonic clock on these
+ * platforms, so we convert deadlines to wall-clock time before waiting
+ */
+#if defined _WIN32 || defined __APPLE__
+#   define REALTIME_CONDITION 1
+#endif
+
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC 1000000000ULL
+
+/*
+ * The enabled timers are kept in a binary min-heap (sorted by deadline).
+ * Timers expire when they are polled with DS_TimerPoll(). If the event loop
+ * cannot sleep until the next deadline by itself, a scheduler thread sleeps
+ * until the earliest deadline is reached and expires the timer.
+ */
 static int running = 0;
+static int scheduler = 0;
+static pthread_t thread;
+static pthread_cond_t cond;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Deadline until which the scheduler thread sleeps (\c UINT64_MAX if it
+ * waits for a timer to be scheduled, \c 0 if it is not sleeping)
+ */
+static uint64_t wake_deadline = 0;
+
+/*
+ * The min-heap of scheduled timers
+ */
+static int heap_count = 0;
+static int heap_size = 0;
+static DS_Timer **heap = NULL;
+
+/**
+ * Swaps the heap positions \a a and \a b and updates the indexes stored
+ * in each timer
+ */
+static void heap_swap(int a, int b)
+{
+   DS_Timer *tmp = heap[a];
+   heap[a] = heap[b];
+   heap[b] = tmp;
+
+   heap[a]->heap_index = a;
+   heap[b]->heap_index = b;
+}
+
+/**
+ * Moves the timer at the given heap \a index up until the heap is valid
+ */
+static void heap_sift_up(int index)
+{
+   while (index > 0)
+   {
+      int parent = (index - 1) / 2;
+      if (heap[parent]->deadline <= heap[index]->deadline)
+         break;
+
+      heap_swap(parent, index);
+      index = parent;
+   }
+}
+
+/**
+ * Moves the timer at the given heap \a index down until the heap is valid
+ */
+static void heap_sift_down(int index)
+{
+   while (1)
+   {
+      int smallest = index;
+      int left = (index * 2) + 1;
+      int right = (index * 2) + 2;
+
+      if (left < heap_count && heap[left]->deadline < heap[smallest]->deadline)
+         smallest = left;
+      if (right < heap_count && heap[right]->deadline < heap[smallest]->deadline)
+         smallest = right;
+
+      if (smallest == index)
+         break;
+
+      heap_swap(index, smallest);
+      index = smallest;
+   }
+}
+
+/**
+ * Removes the given \a timer from the scheduler heap (if its scheduled)
+ *
+ * \note The caller must hold the module lock
+ */
+static void unschedule(DS_Timer *timer)
+{
+   int index = timer->heap_index;
+   if (index < 0 || index >= heap_count || heap[index] != timer)
+      return;
+
+   /* Move the last timer to the freed position */
+   --heap_count;
+   if (index != heap_count)
+   {
+      heap[index] = heap[heap_count];
+      heap[index]->heap_index = index;
+      heap_sift_up(index);
+      heap_sift_down(heap[index]->heap_index);
+   }
+
+   timer->heap_index = -1;
+}
+
+/**
+ * Registers the given \a timer in the scheduler heap (or updates its position
+ * if it was already scheduled). The scheduler thread is only woken up if it
+ * sleeps past the new earliest deadline.
+ *
+ * \note The caller must hold the module lock
+ */
+static void schedule(DS_Timer *timer)
+{
+   /* Timer is already scheduled, just move it */
+   if (timer->heap_index >= 0 && timer->heap_index < heap_count && heap[timer->heap_index] == timer)
+   {
+      heap_sift_up(timer->heap_index);
+      heap_sift_down(timer->heap_index);
+   }
+
+   /* Add timer to the heap */
+   else
+   {
+      if (heap_count >= heap_size)
+      {
+         heap_size = DS_Max(heap_size * 2, 16);
+         heap = (DS_Timer **)realloc(heap, heap_size * sizeof(DS_Timer *));
+         assert(heap);
+      }
+
+      heap[heap_count] = timer;
+      timer->heap_index = heap_count;
+      ++heap_count;
+      heap_sift_up(timer->heap_index);
+   }
+
+   /* Let the scheduler re-calculate its sleep time */
+   if (heap[0]->deadline < wake_deadline)
+      pthread_cond_signal(&cond);
+}
+
+/**
+ * Blocks the scheduler thread until the given monotonic \a deadline is
+ * reached or until the condition variable is signaled
+ *
+ * \note The caller must hold the module lock
+ */
+static void wait_until(uint64_t deadline)
+{
+   struct timespec ts;
+
+#if defined REALTIME_CONDITION
+   uint64_t now = DS_GetMonotonicTime();
+   uint64_t wait = (deadline > now) ? deadline - now : 0;
+
+#   if defined _WIN32
+   timespec_get(&ts, TIME_UTC);
+#   else
+   clock_gettime(CLOCK_REALTIME, &ts);
+#   endif
+
+   uint64_t abs = ((uint64_t)ts.tv_sec * NSEC_PER_SEC) + (uint64_t)ts.tv_nsec + wait;
+#else
+   uint64_t abs = deadline;
+#endif
+
+   ts.tv_sec = (time_t)(abs / NSEC_PER_SEC);
+   ts.tv_nsec = (long)(abs % NSEC_PER_SEC);
+
+   wake_deadline = deadline;
+   pthread_cond_timedwait(&cond, &lock, &ts);
+   wake_deadline = 0;
+}
 
 /**
- * Updates the properties of the given \a timer
- * This function is called in a separate thread for each timer that we use.
- * This is **not** the best way to implement a timer, but its effective,
- * easy to understand and efficient. Also, this implementation does not need
- * to play with the kernel/OS to compare elapsed times periodically.
+ * Runs the scheduler loop, which marks timers as expired once their
+ * deadline is reached. The thread only wakes up when a timer expires or
+ * when a timer is scheduled before the deadline it sleeps until.
  */
-static void *update_timer(void *ptr)
+static void *run_scheduler(void *ptr)
 {
-   assert(ptr);
-   DS_Timer *timer = (DS_Timer *)ptr;
+   (void)ptr;
+
+   pthread_mutex_lock(&lock);
 
-   while (running == 1)
+   while (scheduler)
    {
-      if (timer->enabled && timer->time > 0 && !timer->expired)
+      /* Nothing to do, wait until a timer is scheduled */
+      if (heap_count <= 0)
       {
-         timer->elapsed += timer->precision;
+         wake_deadline = UINT64_MAX;
+         pthread_cond_wait(&cond, &lock);
+         wake_deadline = 0;
+         continue;
+      }
 
-         if (timer->elapsed >= timer->time)
-            timer->expired = 1;
+      /* Expire the first timer if its deadline has been reached */
+      DS_Timer *timer = heap[0];
+      if (timer->deadline <= DS_GetMonotonicTime())
+      {
+         unschedule(timer);
+         timer->expired = 1;
+         timer->elapsed = timer->time;
       }
 
-      DS_Sleep(timer->precision);
+      /* Sleep until the next deadline */
+      else
+         wait_until(timer->deadline);
    }
 
+   pthread_mutex_unlock(&lock);
    return NULL;
 }
 
 /**
- * Initializes the timer array, which is used to keep track of all the timers
- * used by the library. We need to do this so that we can terminate each timer
- * thread once the module is closed.
+ * Initializes the timers module, the scheduler thread is only started with
+ * \c Timers_StartScheduler()
  */
 void Timers_Init(void)
 {
+   pthread_mutex_lock(&lock);
+
+   /* Bind the condition variable to the monotonic clock */
+   pthread_condattr_t attr;
+   pthread_condattr_init(&attr);
+#if !defined REALTIME_CONDITION
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+   pthread_cond_init(&cond, &attr);
+   pthread_condattr_destroy(&attr);
+
    running = 1;
-   DS_ArrayInit(&timers, 10);
+   pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Starts the scheduler thread, which expires the timers as soon as their
+ * deadline is reached. It is only needed when the timers are not polled
+ * as soon as their deadline is reached (e.g. by an event loop that sleeps
+ * for a fixed time).
+ */
+void Timers_StartScheduler(void)
+{
+   pthread_mutex_lock(&lock);
+
+   if (running && !scheduler)
+   {
+      scheduler = 1;
+      int error = pthread_create(&thread, NULL, &run_scheduler, NULL);
+      assert(!error);
+   }
+
+   pthread_mutex_unlock(&lock);
 }
 
 /**
- * Breaks all the timer loops and stops every thread used by this module
+ * Stops the scheduler thread and removes all the scheduled timers
  */
 void Timers_Close(void)
 {
+   /* Stop the scheduler loop */
+   pthread_mutex_lock(&lock);
+   int joinable = scheduler;
    running = 0;
-   DS_ArrayFree(&timers);
+   scheduler = 0;
+   pthread_cond_signal(&cond);
+   pthread_mutex_unlock(&lock);
+
+   /* Wait for the scheduler thread to finish */
+   if (joinable)
+      pthread_join(thread, NULL);
+
+   /* Clear the heap */
+   pthread_mutex_lock(&lock);
+   int i;
+   for (i = 0; i < heap_count; ++i)
+      heap[i]->heap_index = -1;
+
+   DS_FREE(heap);
+   heap_size = 0;
+   heap_count = 0;
+   pthread_cond_destroy(&cond);
+   pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Returns the current time of the monotonic clock in nanoseconds. This
+ * clock is not affected by changes to the system time, and should only be
+ * used to measure time intervals.
+ */
+uint64_t DS_GetMonotonicTime(void)
+{
+#if defined _WIN32
+   LARGE_INTEGER freq, count;
+   QueryPerformanceFrequency(&freq);
+   QueryPerformanceCounter(&count);
+
+   uint64_t secs = (uint64_t)(count.QuadPart / freq.QuadPart);
+   uint64_t rest = (uint64_t)(count.QuadPart % freq.QuadPart);
+   return (secs * NSEC_PER_SEC) + ((rest * NSEC_PER_SEC) / (uint64_t)freq.QuadPart);
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ((uint64_t)ts.tv_sec * NSEC_PER_SEC) + (uint64_t)ts.tv_nsec;
+#endif
 }
 
 /**
  * Pauses the execution state of the program/thread for the given
  * number of \a millisecs.
- *
- * We use this function to update each timer based on its precision
  */
 void DS_Sleep(const int millisecs)
 {
@@ -107,9 +372,14 @@ void DS_TimerStop(DS_Timer *timer)
 {
    assert(timer);
 
+   pthread_mutex_lock(&lock);
+
    timer->enabled = 0;
    timer->expired = 0;
    timer->elapsed = 0;
+   unschedule(timer);
+
+   pthread_mutex_unlock(&lock);
 }
 
 /**
@@ -119,32 +389,150 @@ void DS_TimerStart(DS_Timer *timer)
 {
    assert(timer);
 
+   pthread_mutex_lock(&lock);
+
    timer->enabled = 1;
    timer->expired = 0;
    timer->elapsed = 0;
+   timer->deadline = DS_GetMonotonicTime() + ((uint64_t)timer->time * NSEC_PER_MSEC);
+
+   if (timer->time > 0 && running)
+      schedule(timer);
+   else
+      unschedule(timer);
+
+   pthread_mutex_unlock(&lock);
 }
 
 /**
- * Resets the elapsed time and expired state of the given \a timer
+ * Resets the elapsed time and expired state of the given \a timer.
+ *
+ * If the timer had already expired, the next deadline is calculated from
+ * the previous deadline (and not from the current time), so that periodic
+ * timers (e.g. the packet senders) do not accumulate drift.
  */
 void DS_TimerReset(DS_Timer *timer)
 {
    assert(timer);
 
+   pthread_mutex_lock(&lock);
+
+   uint64_t now = DS_GetMonotonicTime();
+   uint64_t interval = (uint64_t)timer->time * NSEC_PER_MSEC;
+
+   /* Calculate the next deadline */
+   if (timer->expired && timer->deadline + interval > now)
+      timer->deadline += interval;
+   else
+      timer->deadline = now + interval;
+
    timer->expired = 0;
    timer->elapsed = 0;
+
+   /* Re-schedule the timer */
+   if (timer->enabled && timer->time > 0 && running)
+      schedule(timer);
+
+   pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Checks if the deadline of the given \a timer has been reached and updates
+ * its expired state immediately, without waiting for the scheduler thread
+ * (which only runs if the event loop cannot sleep until a deadline).
+ *
+ * This allows an event loop that sleeps until a timer deadline to act on
+ * the timer as soon as it wakes up.
+ *
+ * \returns \c 1 if the timer has expired, \c 0 otherwise
+ */
+int DS_TimerPoll(DS_Timer *timer)
+{
+   assert(timer);
+
+   pthread_mutex_lock(&lock);
+
+   if (timer->enabled && !timer->expired && timer->time > 0 && timer->deadline <= DS_GetMonotonicTime())
+   {
+      unschedule(timer);
+      timer->expired = 1;
+      timer->elapsed = timer->time;
+   }
+
+   int expired = timer->expired;
+   pthread_mutex_unlock(&lock);
+
+   return expired;
+}
+
+/**
+ * Returns the monotonic time (in nanoseconds) at which the given \a timer
+ * will expire, or \c 0 if the timer is disabled or has already expired
+ */
+uint64_t DS_TimerDeadline(DS_Timer *timer)
+{
+   assert(timer);
+
+   pthread_mutex_lock(&lock);
+
+   uint64_t deadline = 0;
+   if (timer->enabled && !timer->expired && timer->time > 0)
+      deadline = timer->deadline;
+
+   pthread_mutex_unlock(&lock);
+
+   return deadline;
+}
+
+/**
+ * Returns the monotonic time (in nanoseconds) at which the next scheduled
+ * timer will expire, or \c 0 if no timer is running
+ */
+uint64_t DS_TimerNextDeadline(void)
+{
+   pthread_mutex_lock(&lock);
+   uint64_t deadline = (heap_count > 0) ? heap[0]->deadline : 0;
+   pthread_mutex_unlock(&lock);
+
+   return deadline;
 }
 
 /**
- * Initializes the given \a timer with the given \a time and \a precision.
- * The timers are updated using a threaded while loop (that sleeps the number
- * of milliseconds specified with \a precision). As stated before, this is
- * probably not the best timer implementation out there, but its simple and
- * it works perfectly for this library.
+ * Expires the scheduled timer with the earliest deadline if that deadline
+ * has been reached, and writes the owner of the timer to \a owner.
  *
- * A word of advice, using a higher \a precision (lower value in msecs) will
- * result in increased CPU usage, this thing does not have morals and will eat
- * the whole cake if you allow it.
+ * This allows an event loop to find the timers that it must act on without
+ * polling every one of them.
+ *
+ * \returns \c 1 if a timer has expired, \c 0 otherwise
+ */
+int DS_TimerExpireNext(void **owner)
+{
+   assert(owner);
+
+   pthread_mutex_lock(&lock);
+
+   int expired = 0;
+   if (heap_count > 0 && heap[0]->deadline <= DS_GetMonotonicTime())
+   {
+      DS_Timer *timer = heap[0];
+      unschedule(timer);
+      timer->expired = 1;
+      timer->elapsed = timer->time;
+
+      *owner = timer->owner;
+      expired = 1;
+   }
+
+   pthread_mutex_unlock(&lock);
+
+   return expired;
+}
+
+/**
+ * Initializes the given \a timer with the given \a time. The \a precision
+ * argument is no longer used, since the scheduler thread sleeps exactly until
+ * the next timer deadline is reached.
  */
 void DS_TimerInit(DS_Timer *timer, const int time, const int precision)
 {
@@ -159,14 +547,10 @@ void DS_TimerInit(DS_Timer *timer, const int time, const int precision)
    timer->enabled = 0;
    timer->expired = 0;
    timer->elapsed = 0;
+   timer->deadline = 0;
+   timer->owner = NULL;
    timer->time = time;
+   timer->heap_index = -1;
    timer->initialized = 1;
    timer->precision = precision;
-
-   /* Configure the thread */
-   pthread_t thread;
-   int error = pthread_create(&thread, NULL, &update_timer, (void *)timer);
-
-   /* Check if thread was started */
-   assert(!error);
 }
@@ -680,6 +680,14 @@ void DriverStation::start()
    if (!DS_Initialized())
    {
       DS_Init();
+
+      /* Process LibDS events as soon as they are generated */
+      if (DS_GetEventFd() >= 0)
+      {
+         m_notifier = new QSocketNotifier(DS_GetEventFd(), QSocketNotifier::Read, this);
+         connect(m_notifier, SIGNAL(activated(int)), this, SLOT(processEvents()));
+      }
+
       processEvents();
       updateElapsedTime();
       emit statusChanged(generalStatus());
@@ -1034,6 +1042,13 @@ void DriverStation::quitDS()
    if (DS_Initialized())
    {
       LOG << "Stopping DS Engine...";
+
+      if (m_notifier)
+      {
+         m_notifier->setEnabled(false);
+         delete m_notifier;
+      }
+
       DS_Close();
       LOG << "DS Engine Stopped";
    }
@@ -1041,7 +1056,9 @@ void DriverStation::quitDS()
 
 /**
  * Polls for new LibDS events and emits Qt signals as appropiate.
- * This function is called every 5 milliseconds.
+ *
+ * This function is called when the LibDS event descriptor becomes readable,
+ * or every 5 milliseconds if the current platform does not support it.
  */
 void DriverStation::processEvents()
 {
@@ -1105,7 +1122,8 @@ void DriverStation::processEvents()
       }
    }
 
-   QTimer::singleShot(5, Qt::CoarseTimer, this, SLOT(processEvents()));
+   if (!m_notifier && DS_Initialized())
+      QTimer::singleShot(5, Qt::CoarseTimer, this, SLOT(processEvents()));
 }
 
 /**
@@ -28,8 +28,10 @@
 #endif
 
 #include <QObject>
+#include <QPointer>
 #include <QStringList>
 #include <QElapsedTimer>
+#include <QSocketNotifier>
 
 #include <DS_Protocol.h>
 
@@ -263,6 +265,7 @@ signals:
 private:
    QElapsedTimer m_timer;
    QString m_elapsedTime;
+   QPointer<QSocketNotifier> m_notifier;
 };
 
 #endif